@@ -0,0 +1,338 @@
+// -*- symbian-c++ -*-
+
+//
+// apnbuffer.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "local_epoc_py_utils.h"
+#include "settings.h"
+#include "panic.h"
+#include "apnbuffer.h"
+#include "bufferpool.h"
+
+#if PY_VERSION_HEX < 0x02050000
+typedef int Py_ssize_t;
+typedef inquiry lenfunc;
+typedef intargfunc ssizeargfunc;
+typedef intintargfunc ssizessizeargfunc;
+typedef getreadbufferproc readbufferproc;
+typedef getsegcountproc segcountproc;
+typedef getcharbufferproc charbufferproc;
+#endif
+
+// --------------------------------------------------------------------
+// object structure...
+
+/** A read-only view of data received into a pooled buffer, handed
+	to read callbacks in place of a string when an AoSocket is in
+	zero copy mode. It supports the buffer interface, len(),
+	indexing and slicing (which copy), and str() for a copy of all
+	of the data.
+*/
+typedef struct
+	{
+	PyObject_HEAD;
+	TUint8* iBuf;
+	TInt iLength;
+	TInt iCapacity;
+	// the pool to give the buffer back to
+	CBufferPool* iPool;
+	TInt iKeep;
+	} apn_buffer_object;
+
+#define AoBufferType \
+	((PyTypeObject*)SPyGetGlobalString("AoBuffer"))
+
+static void ReleaseBuffer(TUint8* aBuf, TInt aCapacity,
+						  CBufferPool* aPool, TInt aKeep)
+	{
+	// The object may be released by some other thread than the one
+	// whose pool the buffer came from. We may not touch that pool,
+	// but as the threads of the interpreter share a heap, we may
+	// free the buffer.
+	if (aPool && aPool == CBufferPool::Current())
+		{
+		aPool->Free(aBuf, aCapacity, aKeep);
+		}
+	else
+		{
+		User::Free(aBuf);
+		}
+	}
+
+PyObject* NewReadBuffer(TUint8* aBuf, TInt aLength, TInt aCapacity,
+						CBufferPool* aPool, TInt aKeep)
+	{
+	apn_buffer_object* self =
+		PyObject_New(apn_buffer_object, AoBufferType);
+	if (!self)
+		{
+		ReleaseBuffer(aBuf, aCapacity, aPool, aKeep);
+		return NULL;
+		}
+	self->iBuf = aBuf;
+	self->iLength = aLength;
+	self->iCapacity = aCapacity;
+	self->iPool = aPool;
+	self->iKeep = aKeep;
+	return reinterpret_cast<PyObject*>(self);
+	}
+
+static void apn_dealloc_buffer(apn_buffer_object* self)
+	{
+	ReleaseBuffer(self->iBuf, self->iCapacity, self->iPool, self->iKeep);
+	self->iBuf = NULL;
+	PyObject_Del(self);
+	}
+
+static PyObject* apn_buffer_str(apn_buffer_object* self)
+	{
+	return PyString_FromStringAndSize((char*)self->iBuf, self->iLength);
+	}
+
+// --------------------------------------------------------------------
+// sequence interface...
+
+static Py_ssize_t apn_buffer_length(apn_buffer_object* self)
+	{
+	return self->iLength;
+	}
+
+static PyObject* apn_buffer_item(apn_buffer_object* self, Py_ssize_t aIndex)
+	{
+	if (aIndex < 0 || aIndex >= self->iLength)
+		{
+		PyErr_SetString(PyExc_IndexError, "buffer index out of range");
+		return NULL;
+		}
+	return PyString_FromStringAndSize((char*)self->iBuf + aIndex, 1);
+	}
+
+static PyObject* apn_buffer_slice(apn_buffer_object* self,
+								  Py_ssize_t aLow, Py_ssize_t aHigh)
+	{
+	// the interpreter has already adjusted negative indices
+	if (aLow < 0)
+		{
+		aLow = 0;
+		}
+	if (aHigh > self->iLength)
+		{
+		aHigh = self->iLength;
+		}
+	if (aHigh < aLow)
+		{
+		aHigh = aLow;
+		}
+	return PyString_FromStringAndSize((char*)self->iBuf + aLow,
+									  aHigh - aLow);
+	}
+
+static PySequenceMethods apn_buffer_as_sequence =
+	{
+	(lenfunc)apn_buffer_length,				   /*sq_length*/
+	0,										   /*sq_concat*/
+	0,										   /*sq_repeat*/
+	(ssizeargfunc)apn_buffer_item,			   /*sq_item*/
+	(ssizessizeargfunc)apn_buffer_slice,	   /*sq_slice*/
+	};
+
+// --------------------------------------------------------------------
+// buffer interface...
+
+static Py_ssize_t apn_buffer_getreadbuf(apn_buffer_object* self,
+										Py_ssize_t aSegment, void** aPtr)
+	{
+	if (aSegment != 0)
+		{
+		PyErr_SetString(PyExc_SystemError,
+						"accessing non-existent buffer segment");
+		return -1;
+		}
+	*aPtr = self->iBuf;
+	return self->iLength;
+	}
+
+static Py_ssize_t apn_buffer_getsegcount(apn_buffer_object* self,
+										 Py_ssize_t* aLength)
+	{
+	if (aLength)
+		{
+		*aLength = self->iLength;
+		}
+	return 1;
+	}
+
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+static int apn_buffer_getbuffer(apn_buffer_object* self,
+								Py_buffer* aView, int aFlags)
+	{
+	return PyBuffer_FillInfo(aView, (PyObject*)self, self->iBuf,
+							 self->iLength, 1, aFlags);
+	}
+#endif
+
+static PyBufferProcs apn_buffer_as_buffer =
+	{
+	(readbufferproc)apn_buffer_getreadbuf,	   /*bf_getreadbuffer*/
+	0,										   /*bf_getwritebuffer*/
+	(segcountproc)apn_buffer_getsegcount,	   /*bf_getsegcount*/
+	(charbufferproc)apn_buffer_getreadbuf,	   /*bf_getcharbuffer*/
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+	(getbufferproc)apn_buffer_getbuffer,	   /*bf_getbuffer*/
+	0,										   /*bf_releasebuffer*/
+#endif
+	};
+
+// --------------------------------------------------------------------
+// type...
+
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+#define APN_BUFFER_FLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER)
+#else
+#define APN_BUFFER_FLAGS Py_TPFLAGS_DEFAULT
+#endif
+
+const PyTypeObject apn_buffer_typetmpl =
+	{
+	PyObject_HEAD_INIT(NULL)
+	0,										   /*ob_size*/
+	"pyaosocket.AoBuffer",					   /*tp_name*/
+	sizeof(apn_buffer_object),				   /*tp_basicsize*/
+	0,										   /*tp_itemsize*/
+	/* methods */
+	(destructor)apn_dealloc_buffer,			   /*tp_dealloc*/
+	0,										   /*tp_print*/
+	0,										   /*tp_getattr*/
+	0,										   /*tp_setattr*/
+	0,										   /*tp_compare*/
+	0,										   /*tp_repr*/
+	0,										   /*tp_as_number*/
+	&apn_buffer_as_sequence,				   /*tp_as_sequence*/
+	0,										   /*tp_as_mapping*/
+	0,										   /*tp_hash*/
+	0,										   /*tp_call*/
+	(reprfunc)apn_buffer_str,				   /*tp_str*/
+	0,										   /*tp_getattro*/
+	0,										   /*tp_setattro*/
+	&apn_buffer_as_buffer,					   /*tp_as_buffer*/
+	APN_BUFFER_FLAGS						   /*tp_flags*/
+	};
+
+TInt apn_buffer_ConstructType()
+	{
+	return ConstructType(&apn_buffer_typetmpl, "AoBuffer");
+	}
+
+// --------------------------------------------------------------------
+// TPinnedBuffer...
+
+TPinnedBuffer::TPinnedBuffer() :
+	iObject(NULL), iPtr(NULL), iLength(0)
+	{
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+	iHaveView = EFalse;
+#endif
+	}
+
+TBool TPinnedBuffer::Pin(PyObject* aObject, TBool aWritable)
+	{
+	Release();
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+	if (PyObject_CheckBuffer(aObject))
+		{
+		if (PyObject_GetBuffer(aObject, &iView, aWritable ?
+							   (PyBUF_WRITABLE | PyBUF_SIMPLE) :
+							   PyBUF_SIMPLE) < 0)
+			{
+			return EFalse;
+			}
+		iHaveView = ETrue;
+		iPtr = static_cast<TUint8*>(iView.buf);
+		iLength = iView.len;
+		Py_INCREF(aObject);
+		iObject = aObject;
+		return ETrue;
+		}
+#endif
+	Py_ssize_t length;
+	if (aWritable)
+		{
+		void* ptr;
+		if (PyObject_AsWriteBuffer(aObject, &ptr, &length) < 0)
+			{
+			return EFalse;
+			}
+		iPtr = static_cast<TUint8*>(ptr);
+		}
+	else
+		{
+		const void* ptr;
+		if (PyObject_AsReadBuffer(aObject, &ptr, &length) < 0)
+			{
+			return EFalse;
+			}
+		iPtr = static_cast<TUint8*>(const_cast<void*>(ptr));
+		}
+	iLength = length;
+	Py_INCREF(aObject);
+	iObject = aObject;
+	return ETrue;
+	}
+
+void TPinnedBuffer::Release()
+	{
+	if (!iObject)
+		{
+		return;
+		}
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+	if (iHaveView)
+		{
+		PyBuffer_Release(&iView);
+		iHaveView = EFalse;
+		}
+#endif
+	PyObject* object = iObject;
+	iObject = NULL;
+	iPtr = NULL;
+	iLength = 0;
+	Py_DECREF(object);
+	}
+
+void TPinnedBuffer::TakeFrom(TPinnedBuffer& aOther)
+	{
+	Release();
+	*this = aOther;
+	aOther.iObject = NULL;
+	aOther.iPtr = NULL;
+	aOther.iLength = 0;
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+	aOther.iHaveView = EFalse;
+#endif
+	}
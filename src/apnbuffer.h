@@ -0,0 +1,78 @@
+// -*- symbian-c++ -*-
+
+//
+// apnbuffer.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __APNBUFFER_H__
+#define __APNBUFFER_H__
+
+#include "local_epoc_py_utils.h"
+
+class CBufferPool;
+
+// Wraps a receive buffer in a read-only Python buffer object, which
+// gives the buffer back to aPool (with aKeep, as for
+// CBufferPool::Free()) once released. Takes ownership of aBuf even
+// on failure, in which case NULL is returned with an exception set.
+PyObject* NewReadBuffer(TUint8* aBuf, TInt aLength, TInt aCapacity,
+						CBufferPool* aPool, TInt aKeep);
+
+TInt apn_buffer_ConstructType();
+
+/** Holds on to the memory of a Python object that supports the
+	buffer interface, for as long as a request that uses the memory
+	is pending. Where the object supports the new buffer interface,
+	it cannot be resized meanwhile (a bytearray refuses to); with
+	the old one we can only keep a reference, and trust the caller.
+	Pin() and Release() must be called holding the interpreter lock.
+*/
+class TPinnedBuffer
+	{
+public:
+	TPinnedBuffer();
+	// returns EFalse with an exception set upon failure
+	TBool Pin(PyObject* aObject, TBool aWritable);
+	// okay to call even when nothing is pinned
+	void Release();
+	// releases what we have, and takes over what aOther has
+	void TakeFrom(TPinnedBuffer& aOther);
+	TBool IsPinned() const { return iObject != NULL; }
+	TUint8* Ptr() const { return iPtr; }
+	TInt Length() const { return iLength; }
+private:
+	PyObject* iObject;
+	TUint8* iPtr;
+	TInt iLength;
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+	Py_buffer iView;
+	TBool iHaveView;
+#endif
+	};
+
+#endif // __APNBUFFER_H__
@@ -139,8 +139,8 @@ static PyObject* apn_flogger_createlog(apn_flogger_object* self,
 		return NULL;
 		}
 	// TInt sizeOfUni = sizeof(Py_UNICODE); // 2
-	TPtrC dirName((TUint16*)fb, fl);
-	TPtrC fileName((TUint16*)tb, tl);
+	TPtrC dirName((TText*)fb, fl);
+	TPtrC fileName((TText*)tb, tl);
 
 	AssertNonNull(self);
 	if (!self->iLogger)
@@ -170,7 +170,7 @@ static PyObject* apn_flogger_write(apn_flogger_object* self,
 		{
 		return NULL;
 		}
-	TPtrC sss((TUint16*)sb, sl);
+	TPtrC sss((TText*)sb, sl);
 
 	AssertNonNull(self);
 	if (!self->iLogger)
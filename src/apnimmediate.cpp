@@ -35,6 +35,7 @@
 #include "local_epoc_py_utils.h"
 #include "settings.h"
 #include "panic.h"
+#include "pydispatch.h"
 #include <e32base.h>
 
 // --------------------------------------------------------------------
@@ -46,6 +47,8 @@ public:
 	static CAoImmediate* NewL();
 	~CAoImmediate();
 	void Complete(PyObject* aCallback, PyObject* aParam);
+	// takes effect once there is no request pending
+	void SetRequestPriority(TInt aPriority);
 private:
 	CAoImmediate();
 	void RunL();
@@ -67,6 +70,9 @@ private:
 	*/
 	PyThreadState* iThreadState;
 
+	// zero, i.e. EPriorityStandard, unless set otherwise
+	TInt iRequestPriority;
+
 	CTC_DEF_HANDLE(ctc);
 	};
 
@@ -125,7 +131,7 @@ void CAoImmediate::RunL()
 	AssertNonNull(iCallback);
 	AssertNonNull(iParam);
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
 	PyObject* arg = Py_BuildValue("(iO)", error, iParam);
 	if (arg)
@@ -153,13 +159,22 @@ void CAoImmediate::RunL()
 		AoSocketPanic(EPanicOutOfMemory);
 		}
 
-	PyEval_SaveThread();
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
 	// so do not attempt to access any property anymore
 	}
 
+void CAoImmediate::SetRequestPriority(TInt aPriority)
+	{
+	iRequestPriority = aPriority;
+	if (!IsActive())
+		{
+		SetPriority(aPriority);
+		}
+	}
+
 void CAoImmediate::Complete(PyObject* aCallback, PyObject* aParam)
 	{
 	if (IsActive())
@@ -175,6 +190,12 @@ void CAoImmediate::Complete(PyObject* aCallback, PyObject* aParam)
 	iParam = aParam;
 	Py_INCREF(aParam);
 
+	// CActive::SetPriority() may not be called while active
+	if (Priority() != iRequestPriority)
+		{
+		SetPriority(iRequestPriority);
+		}
+
 	iStatus = KRequestPending;
 	SetActive();
 
@@ -238,6 +259,22 @@ static PyObject* apn_immediate_complete(apn_immediate_object* self,
 	RETURN_NO_VALUE;
 	}
 
+/** Sets the active object priority to use for requests.
+	Any request already pending is not affected.
+*/
+static PyObject* apn_immediate_setpriority(apn_immediate_object* self,
+										   PyObject* args)
+	{
+	TInt priority;
+	if (!PyArg_ParseTuple(args, "i", &priority))
+		{
+		return NULL;
+		}
+	AssertNonNull(self->iImmediate);
+	self->iImmediate->SetRequestPriority(priority);
+	RETURN_NO_VALUE;
+	}
+
 static PyObject* apn_immediate_cancel(apn_immediate_object* self,
 									  PyObject* /*args*/)
 	{
@@ -281,6 +318,7 @@ const static PyMethodDef apn_immediate_methods[] =
 	{"complete", (PyCFunction)apn_immediate_complete, METH_VARARGS},
 	{"cancel", (PyCFunction)apn_immediate_cancel, METH_NOARGS},
 	{"close", (PyCFunction)apn_immediate_close, METH_NOARGS},
+	{"set_priority", (PyCFunction)apn_immediate_setpriority, METH_VARARGS},
 	{NULL, NULL} // sentinel
 	};
 
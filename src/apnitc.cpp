@@ -35,6 +35,7 @@
 #include "local_epoc_py_utils.h"
 #include "settings.h"
 #include "panic.h"
+#include "pydispatch.h"
 #include <e32base.h>
 
 // --------------------------------------------------------------------
@@ -47,6 +48,8 @@ public:
 	~CAoItc();
 	void Request(PyObject* aCallback, PyObject* aParam);
 	void Complete();
+	// takes effect once there is no request pending
+	void SetRequestPriority(TInt aPriority);
 private:
 	CAoItc();
 	void RunL();
@@ -57,6 +60,8 @@ private:
 	PyObject* iParam;
 	PyThreadState* iThreadState;
 	TThreadId iThreadId;
+	// zero, i.e. EPriorityStandard, unless set otherwise
+	TInt iRequestPriority;
 	CTC_DEF_HANDLE(ctc);
 	};
 
@@ -104,7 +109,7 @@ void CAoItc::RunL()
 	AssertNonNull(iCallback);
 	AssertNonNull(iParam);
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
 	PyObject* arg = Py_BuildValue("(iO)", error, iParam);
 	if (arg)
@@ -132,7 +137,7 @@ void CAoItc::RunL()
 		AoSocketPanic(EPanicOutOfMemory);
 		}
 
-	PyEval_SaveThread();
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
@@ -159,6 +164,15 @@ void CAoItc::Complete()
 		}
 	}
 
+void CAoItc::SetRequestPriority(TInt aPriority)
+	{
+	iRequestPriority = aPriority;
+	if (!IsActive())
+		{
+		SetPriority(aPriority);
+		}
+	}
+
 void CAoItc::Request(PyObject* aCallback, PyObject* aParam)
 	{
 	if (IsActive())
@@ -183,6 +197,12 @@ void CAoItc::Request(PyObject* aCallback, PyObject* aParam)
 	// what we want.
 	iThreadId = RThread().Id();
 
+	// CActive::SetPriority() may not be called while active
+	if (Priority() != iRequestPriority)
+		{
+		SetPriority(iRequestPriority);
+		}
+
 	iStatus = KRequestPending;
 	SetActive();
 
@@ -253,6 +273,22 @@ static PyObject* apn_itc_complete(apn_itc_object* self,
 	RETURN_NO_VALUE;
 	}
 
+/** Sets the active object priority to use for requests.
+	Any request already pending is not affected.
+*/
+static PyObject* apn_itc_setpriority(apn_itc_object* self,
+									 PyObject* args)
+	{
+	TInt priority;
+	if (!PyArg_ParseTuple(args, "i", &priority))
+		{
+		return NULL;
+		}
+	AssertNonNull(self->iItc);
+	self->iItc->SetRequestPriority(priority);
+	RETURN_NO_VALUE;
+	}
+
 // We are providing a cancel method in case the thread that
 // is supposed to signal completion cannot be started or
 // something. This may only be called by the thread that
@@ -298,6 +334,7 @@ const static PyMethodDef apn_itc_methods[] =
 	{"complete", (PyCFunction)apn_itc_complete, METH_NOARGS},
 	{"cancel", (PyCFunction)apn_itc_cancel, METH_NOARGS},
 	{"close", (PyCFunction)apn_itc_close, METH_NOARGS},
+	{"set_priority", (PyCFunction)apn_itc_setpriority, METH_VARARGS},
 	{"open", (PyCFunction)apn_itc_open, METH_NOARGS},
 	{NULL, NULL} // sentinel
 	};
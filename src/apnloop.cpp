@@ -33,9 +33,110 @@
 
 #include "local_epoc_py_utils.h"
 #include "settings.h"
+#include "bufferpool.h"
 #include "panic.h"
+#include "pydispatch.h"
+#include "runstats.h"
+#include "threadlocal.h"
 #include <e32base.h>
 
+// --------------------------------------------------------------------
+// CLoopStep...
+
+/** Marks the end of a single step of an AoLoop. Its priority is
+	below that of any other active object, so once it has been
+	completed, its RunL() only gets to run after every other request
+	that has completed by then has been handled. Before the first
+	such request, it is instead completed by a timer, if at all.
+*/
+NONSHARABLE_CLASS(CLoopStep) : public CActive
+	{
+public:
+	static CLoopStep* NewL();
+	~CLoopStep();
+	// a negative timeout means no timeout
+	void Start(TInt aTimeout);
+	// ends the step once the requests completed so far are done
+	void Finish();
+	TBool IsImmediate() const { return iImmediate; }
+	TBool IsDone() const { return iDone; }
+private:
+	CLoopStep();
+	void ConstructL();
+	void RunL();
+	void DoCancel();
+private:
+	RTimer iTimer;
+	TBool iImmediate;
+	TBool iDone;
+	};
+
+CLoopStep* CLoopStep::NewL()
+	{
+	CLoopStep* object = new (ELeave) CLoopStep;
+	CleanupStack::PushL(object);
+	object->ConstructL();
+	CleanupStack::Pop();
+	return object;
+	}
+
+CLoopStep::CLoopStep() : CActive(EPriorityIdle - 1)
+	{
+	CActiveScheduler::Add(this);
+	}
+
+void CLoopStep::ConstructL()
+	{
+	User::LeaveIfError(iTimer.CreateLocal());
+	}
+
+CLoopStep::~CLoopStep()
+	{
+	Cancel();
+	iTimer.Close();
+	}
+
+void CLoopStep::Start(TInt aTimeout)
+	{
+	iDone = EFalse;
+	iImmediate = EFalse;
+	if (aTimeout == 0)
+		{
+		Finish();
+		}
+	else if (aTimeout > 0)
+		{
+		if (aTimeout > KMaxTInt / 1000)
+			{
+			aTimeout = KMaxTInt / 1000;
+			}
+		iTimer.After(iStatus, aTimeout * 1000);
+		SetActive();
+		}
+	}
+
+void CLoopStep::Finish()
+	{
+	Cancel();
+	iImmediate = ETrue;
+	TRequestStatus* status = &iStatus;
+	User::RequestComplete(status, KErrNone);
+	SetActive();
+	}
+
+void CLoopStep::RunL()
+	{
+	iDone = ETrue;
+	}
+
+void CLoopStep::DoCancel()
+	{
+	if (!iImmediate)
+		{
+		iTimer.Cancel();
+		}
+	}
+
 // --------------------------------------------------------------------
 // CAoLoop...
 
@@ -50,11 +151,26 @@ public:
 	~CAoLoop();
 	void Start();
 	void AsyncStop();
+	TInt RunOnce(TInt aTimeout);
+#if ON_HOST
+	TInt Fd();
+	TInt ProcessReady();
+#endif
+	void SetBatchingL(TInt aLimit);
+	void SetStatsL(TBool aEnable);
 private:
 	CAoLoop() {} // just to declare as private
 	void ConstructL();
 private:
 	CActiveSchedulerWait* iWait;
+	CLoopStep* iStep;
+	// set once counted among the loops of the thread
+	TAoThreadLocals* iLocals;
+	// set while within RunOnce(), to tell it if we get deleted
+	TBool* iDeleted;
+	// the maximum number of callbacks per interpreter lock
+	// acquisition, or zero for no batching
+	TInt iBatchLimit;
 	CTC_DEF_HANDLE(ctc);
 	};
 
@@ -69,7 +185,24 @@ CAoLoop* CAoLoop::NewL()
 
 void CAoLoop::ConstructL()
 	{
+#if !ON_HOST
+	// Threads started from Python need not have a scheduler, so we
+	// give one to any worker thread lacking it. It is left installed
+	// until the last loop of the thread is closed, as per-thread
+	// objects such as the timing wheel get added to it. On the host
+	// every thread gets one on demand.
+	TAoThreadLocals& locals = AoThreadLocalsL();
+	if (!CActiveScheduler::Current())
+		{
+		CActiveScheduler* scheduler = new (ELeave) CActiveScheduler;
+		CActiveScheduler::Install(scheduler);
+		locals.iScheduler = scheduler;
+		}
+	locals.iLoopCount++;
+	iLocals = &locals;
+#endif
 	iWait = new (ELeave) CActiveSchedulerWait;
+	iStep = CLoopStep::NewL();
 	CTC_STORE_HANDLE(ctc);
 	}
 
@@ -78,6 +211,22 @@ CAoLoop::~CAoLoop()
 	CTC_CHECK(ctc);
 	// Stops any looping prior to destruction.
 	delete iWait;
+	delete iStep;
+	if (iDeleted)
+		{
+		*iDeleted = ETrue;
+		}
+#if !ON_HOST
+	// the per-thread objects were added to the scheduler that we
+	// installed, and so go first
+	if (iLocals && --iLocals->iLoopCount == 0 && iLocals->iScheduler)
+		{
+		CActiveScheduler* scheduler = iLocals->iScheduler;
+		FreeAoThreadLocals();
+		CActiveScheduler::Install(NULL);
+		delete scheduler;
+		}
+#endif
 	}
 
 // The loop is run within this method call, so do not hold
@@ -85,7 +234,17 @@ CAoLoop::~CAoLoop()
 void CAoLoop::Start()
 	{
 	CTC_CHECK(ctc);
+	CPyDispatcher* dispatcher = CPyDispatcher::Current();
+	if (!dispatcher)
+		{
+		iWait->Start();
+		return;
+		}
+	CPyDispatcher::TFrame frame;
+	dispatcher->Push(frame, iBatchLimit);
 	iWait->Start();
+	// note that we may have been deleted by now
+	dispatcher->Pop(frame);
 	}
 
 // Call this from within a RunL() to cause a break from the loop.
@@ -101,6 +260,133 @@ void CAoLoop::AsyncStop()
 	iWait->AsyncStop();
 	}
 
+// Runs the RunL()s of all the requests that have completed by the
+// time this method is called, and then returns. If there are none,
+// waits for at most aTimeout milliseconds (indefinitely if negative)
+// for one to complete first. Returns the number of RunL()s run,
+// which includes those of any internal active objects.
+//
+// Active objects are run one at a time, in the same way as the
+// active scheduler would, so this may be called from anywhere that
+// Start() can, and the loop may be stopped or deleted from within.
+TInt CAoLoop::RunOnce(TInt aTimeout)
+	{
+	CTC_CHECK(ctc);
+	if (iStep->IsActive())
+		{
+		// already stepping this loop further up the stack
+		AoSocketPanic(EPanicRequestAlreadyPending);
+		}
+	CPyDispatcher* dispatcher = CPyDispatcher::Current();
+	CPyDispatcher::TFrame frame;
+	if (dispatcher)
+		{
+		dispatcher->Push(frame, iBatchLimit);
+		}
+	TBool deleted = EFalse;
+	iDeleted = &deleted;
+	iStep->Start(aTimeout);
+	TInt count = 0;
+	FOREVER
+		{
+		User::WaitForAnyRequest();
+		TInt error = KErrNone;
+		TBool ran = CActiveScheduler::RunIfReady(
+			error, CActive::EPriorityIdle - 1);
+		if (error)
+			{
+			CActiveScheduler::Current()->Error(error);
+			}
+		if (deleted || iStep->IsDone())
+			{
+			break;
+			}
+		if (ran)
+			{
+			count++;
+			if (!iStep->IsImmediate())
+				{
+				iStep->Finish();
+				}
+			}
+		}
+	if (!deleted)
+		{
+		iDeleted = NULL;
+		}
+	if (dispatcher)
+		{
+		dispatcher->Pop(frame);
+		}
+	return count;
+	}
+
+#if ON_HOST
+// Returns a descriptor that polls readable whenever ProcessReady()
+// has something to do, so that the loop may be driven by another
+// event loop that waits on descriptors, without a thread of its own.
+TInt CAoLoop::Fd()
+	{
+	CTC_CHECK(ctc);
+	return CActiveScheduler::HostCurrent().HostPollFd();
+	}
+
+// Runs the RunL()s of the requests that have completed by now,
+// without waiting for any. Returns the number of RunL()s run.
+TInt CAoLoop::ProcessReady()
+	{
+	CTC_CHECK(ctc);
+	CPyDispatcher* dispatcher = CPyDispatcher::Current();
+	if (!dispatcher)
+		{
+		return CActiveScheduler::HostCurrent().HostProcessReady();
+		}
+	CPyDispatcher::TFrame frame;
+	dispatcher->Push(frame, iBatchLimit);
+	TInt count = CActiveScheduler::HostCurrent().HostProcessReady();
+	dispatcher->Pop(frame);
+	return count;
+	}
+#endif
+
+// Takes effect the next time the loop is started.
+void CAoLoop::SetBatchingL(TInt aLimit)
+	{
+	CTC_CHECK(ctc);
+	if (aLimit > 0)
+		{
+		CPyDispatcher::InstanceL();
+		}
+	iBatchLimit = (aLimit > 0) ? aLimit : 0;
+	}
+
+// Starts or stops keeping statistics on the active objects run by
+// the scheduler of this thread, for all loops of the thread.
+// Restarting discards the statistics kept so far. Only supported
+// on the host, as the scheduler of Symbian offers no way to observe
+// the RunL()s it makes.
+void CAoLoop::SetStatsL(TBool aEnable)
+	{
+	CTC_CHECK(ctc);
+#if ON_HOST
+	TAoThreadLocals& locals = AoThreadLocalsL();
+	CActiveScheduler& scheduler = CActiveScheduler::HostCurrent();
+	scheduler.HostSetMonitor(NULL);
+	delete locals.iRunStats;
+	locals.iRunStats = NULL;
+	if (aEnable)
+		{
+		locals.iRunStats = CRunStats::NewL();
+		scheduler.HostSetMonitor(locals.iRunStats);
+		}
+#else
+	if (aEnable)
+		{
+		User::Leave(KErrNotSupported);
+		}
+#endif
+	}
+
 // --------------------------------------------------------------------
 // object structure...
 
@@ -128,6 +414,54 @@ static PyObject* apn_loop_start(apn_loop_object* self,
 	RETURN_NO_VALUE;
 	}
 
+/** Handles whatever completions are ready, waiting for at most the
+	given number of milliseconds for one if there are none, without
+	blocking in a nested loop. A negative timeout means no timeout.
+	Returns the number of active objects that were run.
+*/
+static PyObject* apn_loop_runonce(apn_loop_object* self,
+								  PyObject* args)
+	{
+	TInt timeout;
+	if (!PyArg_ParseTuple(args, "i", &timeout))
+		{
+		return NULL;
+		}
+	AssertNonNull(self->iLoop);
+	TInt count;
+	Py_BEGIN_ALLOW_THREADS;
+	count = self->iLoop->RunOnce(timeout);
+	Py_END_ALLOW_THREADS;
+	return Py_BuildValue("i", count);
+	}
+
+#if ON_HOST
+/** Returns a file descriptor that polls readable whenever there
+	are completions for ``process_ready`` to handle. Host only.
+*/
+static PyObject* apn_loop_fileno(apn_loop_object* self,
+								 PyObject* /*args*/)
+	{
+	AssertNonNull(self->iLoop);
+	return Py_BuildValue("i", self->iLoop->Fd());
+	}
+
+/** Handles the completions that are ready, without waiting for
+	any, and returns the number of active objects that were run.
+	Host only.
+*/
+static PyObject* apn_loop_processready(apn_loop_object* self,
+									   PyObject* /*args*/)
+	{
+	AssertNonNull(self->iLoop);
+	TInt count;
+	Py_BEGIN_ALLOW_THREADS;
+	count = self->iLoop->ProcessReady();
+	Py_END_ALLOW_THREADS;
+	return Py_BuildValue("i", count);
+	}
+#endif
+
 static PyObject* apn_loop_stop(apn_loop_object* self,
 							   PyObject* /*args*/)
 	{
@@ -148,6 +482,162 @@ static PyObject* apn_loop_open(apn_loop_object* self,
 	RETURN_NO_VALUE;
 	}
 
+/** Makes the loop deliver completions to Python in batches, each
+	under a single acquisition of the interpreter lock, with at most
+	the specified number of callbacks per batch. A limit of zero
+	disables batching, which is the default.
+*/
+static PyObject* apn_loop_setbatching(apn_loop_object* self,
+									  PyObject* args)
+	{
+	TInt limit;
+	if (!PyArg_ParseTuple(args, "i", &limit))
+		{
+		return NULL;
+		}
+	AssertNonNull(self->iLoop);
+	TRAPD(error, self->iLoop->SetBatchingL(limit));
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+	RETURN_NO_VALUE;
+	}
+
+/** Starts (with a true argument) or stops keeping statistics on
+	the active objects run in this thread. Host only.
+*/
+static PyObject* apn_loop_setstats(apn_loop_object* self,
+								   PyObject* args)
+	{
+	TInt enable;
+	if (!PyArg_ParseTuple(args, "i", &enable))
+		{
+		return NULL;
+		}
+	AssertNonNull(self->iLoop);
+	TRAPD(error, self->iLoop->SetStatsL(enable));
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+	RETURN_NO_VALUE;
+	}
+
+#if ON_HOST
+// Returns a new reference, or NULL with an exception set.
+static PyObject* HistogramToPython(const THistogram& aHist)
+	{
+	PyObject* buckets = PyList_New(0);
+	if (!buckets)
+		{
+		return NULL;
+		}
+	for (TInt i = 0; i < THistogram::KBuckets; i++)
+		{
+		if (aHist.BucketCount(i))
+			{
+			PyObject* bucket = Py_BuildValue(
+				"(Li)", THistogram::BucketLow(i), aHist.BucketCount(i));
+			if (!bucket || PyList_Append(buckets, bucket))
+				{
+				Py_XDECREF(bucket);
+				Py_DECREF(buckets);
+				return NULL;
+				}
+			Py_DECREF(bucket);
+			}
+		}
+	return Py_BuildValue(
+		"{s:i,s:L,s:L,s:L,s:L,s:L,s:L,s:L,s:N}",
+		"count", aHist.Count(),
+		"min", aHist.Min(),
+		"max", aHist.Max(),
+		"mean", aHist.Mean(),
+		"p50", aHist.Percentile(500),
+		"p90", aHist.Percentile(900),
+		"p99", aHist.Percentile(990),
+		"p999", aHist.Percentile(999),
+		"buckets", buckets);
+	}
+#endif
+
+/** Returns a dictionary that maps the names of the classes of the
+	active objects run so far to a dictionary holding a "delay" and
+	a "run" histogram, of the time from completion to RunL, and of
+	the time spent in RunL, respectively, in nanoseconds. Each
+	histogram is a dictionary with a few summary values, plus the
+	nonempty buckets as (lower bound, count) pairs. The dictionary
+	is empty unless statistics are being kept.
+*/
+static PyObject* apn_loop_stats(apn_loop_object* self,
+								PyObject* /*args*/)
+	{
+	AssertNonNull(self->iLoop);
+	PyObject* dict = PyDict_New();
+	if (!dict)
+		{
+		return NULL;
+		}
+#if ON_HOST
+	TAoThreadLocals* locals = AoThreadLocals();
+	CRunStats* stats = locals ? locals->iRunStats : NULL;
+	for (TInt i = 0; stats && i < stats->ClassCount(); i++)
+		{
+		const CRunStats::CClassStats& entry = stats->Class(i);
+		PyObject* delay = HistogramToPython(entry.iDelay);
+		PyObject* run = delay ? HistogramToPython(entry.iRun) : NULL;
+		PyObject* value = run ?
+			Py_BuildValue("{s:N,s:N}", "delay", delay, "run", run) : NULL;
+		if (!value)
+			{
+			if (!run)
+				{
+				Py_XDECREF(delay);
+				}
+			Py_DECREF(dict);
+			return NULL;
+			}
+		TInt error = PyDict_SetItemString(
+			dict, (char*)CRunStats::ClassName(entry), value);
+		Py_DECREF(value);
+		if (error)
+			{
+			Py_DECREF(dict);
+			return NULL;
+			}
+		}
+#endif
+	return dict;
+	}
+
+/** Returns a dictionary of statistics on the receive buffer pool of
+	this thread: the number of buffers taken from the pool ("hits")
+	and allocated instead ("misses"), the number given back and kept
+	("recycled") and freed instead ("discarded"), and the number and
+	total size of the buffers that the pool currently holds.
+*/
+static PyObject* apn_loop_poolstats(apn_loop_object* self,
+									PyObject* /*args*/)
+	{
+	AssertNonNull(self->iLoop);
+	CBufferPool::TStats stats;
+	Mem::FillZ(&stats, sizeof(stats));
+	CBufferPool* pool = CBufferPool::Current();
+	if (pool)
+		{
+		stats = pool->Stats();
+		}
+	return Py_BuildValue(
+		"{s:i,s:i,s:i,s:i,s:i,s:i}",
+		"hits", stats.iHits,
+		"misses", stats.iMisses,
+		"recycled", stats.iRecycled,
+		"discarded", stats.iDiscarded,
+		"idle_count", stats.iIdleCount,
+		"idle_bytes", stats.iIdleBytes);
+	}
+
 /** It is okay to call this method multiple times,
 	or without having ever called ``open``.
 */
@@ -163,8 +653,17 @@ const static PyMethodDef apn_loop_methods[] =
 	{
 	{"start", (PyCFunction)apn_loop_start, METH_NOARGS},
 	{"stop", (PyCFunction)apn_loop_stop, METH_NOARGS},
+	{"run_once", (PyCFunction)apn_loop_runonce, METH_VARARGS},
+#if ON_HOST
+	{"fileno", (PyCFunction)apn_loop_fileno, METH_NOARGS},
+	{"process_ready", (PyCFunction)apn_loop_processready, METH_NOARGS},
+#endif
 	{"open", (PyCFunction)apn_loop_open, METH_NOARGS},
 	{"close", (PyCFunction)apn_loop_close, METH_NOARGS},
+	{"set_batching", (PyCFunction)apn_loop_setbatching, METH_VARARGS},
+	{"set_stats", (PyCFunction)apn_loop_setstats, METH_VARARGS},
+	{"stats", (PyCFunction)apn_loop_stats, METH_NOARGS},
+	{"pool_stats", (PyCFunction)apn_loop_poolstats, METH_NOARGS},
 	{NULL, NULL} // sentinel
 	};
 
@@ -34,6 +34,7 @@
 #include "btengine.h"
 #include "local_epoc_py_utils.h"
 #include "panic.h"
+#include "pydispatch.h"
 #include "settings.h"
 
 // --------------------------------------------------------------------
@@ -132,7 +133,7 @@ void CAoPortDiscoverer::PortDiscovered(TInt anError, TInt aPort)
 	AssertNonNull(iCallback);
 	AssertNonNull(iParam);
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
 	PyObject* arg;
 	arg = Py_BuildValue("(iiO)", anError, aPort, iParam);
@@ -162,7 +163,7 @@ void CAoPortDiscoverer::PortDiscovered(TInt anError, TInt aPort)
 		AoSocketPanic(EPanicOutOfMemory);
 		}
 
-	PyEval_SaveThread();
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
@@ -208,7 +209,7 @@ static PyObject* apn_portdisc_discover(apn_portdisc_object* self,
 		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
 		return NULL;
 		}
-	TPtrC address((TUint16*)b, l);
+	TPtrC address((TText*)b, l);
 
 	if (!self->iDiscoverer)
 		{
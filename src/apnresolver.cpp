@@ -37,6 +37,7 @@
 #include <es_sock.h>
 #include "local_epoc_py_utils.h"
 #include "panic.h"
+#include "pydispatch.h"
 #include "settings.h"
 
 // --------------------------------------------------------------------
@@ -182,7 +183,7 @@ void CAoResolver::RunL()
 	AssertNonNull(iCallback);
 	AssertNonNull(iParam);
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
 	PyObject* arg;
 	if (error == KErrNone)
@@ -231,7 +232,7 @@ void CAoResolver::RunL()
 		AoSocketPanic(EPanicOutOfMemory);
 		}
 
-	PyEval_SaveThread();
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
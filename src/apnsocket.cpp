@@ -32,27 +32,35 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "settings.h"
+#if !ON_HOST
 #include <apgcli.h> // apgrfx.lib
 #include <eikenv.h>
-#include <e32std.h>
 #include <f32file.h>
+#endif
+#include <e32std.h>
 #include <es_sock.h>
 #include <in_sock.h>
 
+#if SUPPORT_BT
 #include "btengine.h"
+#endif
 #include "local_epoc_py_utils.h"
 #include "logging.h"
 #include "panic.h"
+#include "pydispatch.h"
 #include "resolution.h"
-#include "settings.h"
 #include "socketaos.h"
+#include "timerwheel.h"
 #include "apnsocketserv.h"
+#include "apnbuffer.h"
 #include "apnconnection.h"
 
 // --------------------------------------------------------------------
 // CAoSocket interface...
 
-NONSHARABLE_CLASS(CAoSocket) : public CBase, public MAoSockObserver
+NONSHARABLE_CLASS(CAoSocket) : public CBase, public MAoSockObserver,
+	public MWheelTimerObserver
 	{
 public:
 	static CAoSocket* NewL();
@@ -68,26 +76,34 @@ public:
 	//// socket opening methods (synchronous)
 	TInt Blank();
 	TInt OpenTcp();
+#if SUPPORT_BT
 	TInt OpenBt();
 
 	void GetAvailableBtPortL(TInt& aPort);
+#endif
 
 	//// listening methods (synchronous)
 	TInt ListenTcp(const TDesC& aHostName, TInt aPort, TInt aQueueSize);
+#if SUPPORT_BT
 	void ListenBtL(TInt aPort, TInt aQueueSize,
 				   TUint aServiceId, const TDesC& aServiceName);
+#endif
 
-	//// methods for connecting to a server (asynchronously)
+	//// methods for connecting to a server (asynchronously);
+	//// a timeout in milliseconds of zero means no deadline
 	void ConnectTcpL(const TDesC& aHostName,
 					 TInt aPort,
 					 PyObject* aCallback,
-					 PyObject* aParam);
+					 PyObject* aParam,
+					 TInt aTimeout);
+#if SUPPORT_BT
 	void ConnectBtL(const TDesC& aBtAddress,
 					TInt aPort,
 					PyObject* aCallback,
 					PyObject* aParam);
 
 	void ConfigBtL(PyObject* aCallback, PyObject* aParam);
+#endif
 
 	//// for accepting a client (asynchronously)
 	void AcceptL(PyObject* aBlankSocket, PyObject* aCallback,
@@ -101,34 +117,136 @@ public:
 	// synchronous -- returns an error code
 	TInt SendEof();
 
+	// A timeout in milliseconds of zero means no deadline. Writes
+	// may be made while others are in progress; a deadline applies
+	// to all that are queued.
 	void WriteDataL(const TDesC8& aData, PyObject* aCallback,
-					PyObject* aParam);
+					PyObject* aParam, TInt aTimeout);
+	// Sends straight from the memory of aBuffer, taking over the
+	// pinning of aBuffer, which is released before the callback,
+	// or upon cancellation.
+	void WritePinnedL(TPinnedBuffer& aBuffer, PyObject* aCallback,
+					  PyObject* aParam, TInt aTimeout);
+	// Sends from each of the aCount buffers of aBuffers in turn,
+	// taking over the array, which was allocated with new[], and the
+	// pinning, which is released before the one callback.
+	void WriteBatchL(TPinnedBuffer* aBuffers, TInt aCount,
+					 PyObject* aCallback, PyObject* aParam,
+					 TInt aTimeout);
+	// Sends aCount bytes of a file from aOffset, or up to the end if
+	// aCount is negative, as CFileSender::StartL() does. The callback
+	// gets the number of bytes sent.
+	void WriteFileL(const TDesC& aPath, TInt aFd, TInt aOffset,
+					TInt aCount, PyObject* aCallback, PyObject* aParam);
 	void ReadSomeL(TInt aMaxSize, PyObject* aCallback,
-				   PyObject* aParam);
+				   PyObject* aParam, TInt aTimeout);
 	void ReadExactL(TInt aSize, PyObject* aCallback,
-					PyObject* aParam);
+					PyObject* aParam, TInt aTimeout);
+	// reads up to and including aDelim, which must occur within
+	// aMaxLen bytes
+	void ReadUntilL(const TDesC8& aDelim, TInt aMaxLen,
+					PyObject* aCallback, PyObject* aParam,
+					TInt aTimeout);
+	// Reads into aBuffer at aOffset, taking over the pinning of
+	// aBuffer, which is released upon delivery or cancellation. The
+	// callback gets the number of bytes read in place of the data.
+	void ReadIntoL(TPinnedBuffer& aBuffer, TInt aOffset, TInt aMaxSize,
+				   PyObject* aCallback, PyObject* aParam,
+				   TInt aTimeout);
+	// reads a length-prefixed frame, delivering the payload
+	void ReadFrameL(CSocketReader::TFrameHeader aHeader, TInt aMaxSize,
+					PyObject* aCallback, PyObject* aParam,
+					TInt aTimeout);
+	// keeps reading chunks of at most aMaxSize bytes until
+	// StopReading(), or until an error is delivered
+	void StartReadingL(TInt aMaxSize, PyObject* aCallback,
+					   PyObject* aParam);
+	void StopReading();
+	// Writes what is received into the file at aPath starting at
+	// aOffset, until aLength bytes, or until the end of the stream
+	// if aLength is negative. The callback gets the byte count,
+	// with KRequestPending as the code for a progress report made
+	// each time another aInterval bytes have been written.
+	void ReadToFileL(const TDesC& aPath, TInt aOffset, TInt aLength,
+					 TInt aInterval, PyObject* aCallback,
+					 PyObject* aParam);
+
+	// relays what we receive to aTo, until the end of the stream
+	// or an error
+	void RelayToL(CAoSocket& aTo, PyObject* aCallback, PyObject* aParam);
 
 	//// these are safe to call even if the socket is not open
 	void CancelWrite();
 	void CancelRead();
 	void CancelAccept();
 	void CancelConnect();
+	void CancelRelay();
 	void CancelAll();
 
 	TInt WriteSync(const TDesC8& aData);
 	TInt ReadSync(TDes8& aData);
 
 	void ApplyAccepter(CSocketAccepter& anAccepter);
+#if SUPPORT_BT
 	void ApplyAccepterL(CBtAccepter& anAccepter);
+#endif
+
+	// takes effect for each active object as soon as it has
+	// no request pending
+	void SetPriority(TInt aPriority);
+
+	// whether read callbacks get the receive buffer itself
+	// instead of a copy
+	void SetZeroCopy(TBool aZeroCopy) { iZeroCopy = aZeroCopy; }
+
+	// With a positive aHigh, writes get throttled once as many bytes
+	// are queued, until no more than aLow are, at which point
+	// aCallback gets called. Takes ownership of the parameters, if
+	// any, until Close().
+	void SetWriteWatermarks(TInt aHigh, TInt aLow,
+							PyObject* aCallback, PyObject* aParam);
+	// whether the producer should wait for the drain callback
+	TBool IsWriteThrottled() const { return iThrottled; }
+
+	// whether write_data sends straight from the memory of the
+	// object given, rather than from a copy
+	void SetZeroCopyWrite(TBool aZeroCopy) { iZeroCopyWrite = aZeroCopy; }
+	TBool IsZeroCopyWrite() const { return iZeroCopyWrite; }
+
+	// bounds for the receive size of ReadSomeL() and
+	// StartReadingL(), or zero for the size asked for
+	void SetAdaptiveRead(TInt aMin, TInt aMax)
+		{ iAdaptMin = aMin; iAdaptMax = aMax; }
+
+	// how StartReadingL() coalesces small arrivals, if at all;
+	// see CSocketReader::SetCoalescingL()
+	void SetReadCoalescing(TInt aBytes, TInt aMicroSeconds)
+		{ iCoalesceBytes = aBytes; iCoalesceTime = aMicroSeconds; }
+
+	// for handing the socket over to the loop of another thread;
+	// detaching fails with KErrInUse unless the socket is idle
+	TInt Detach();
+	void Attach();
 
 private:
 	CAoSocket();
 	void ConstructL();
 
+	// gives the active object our priority, unless it is active
+	void ApplyPriority(CActive* aActive);
+
+	// queues the deadline if aTimeout is positive
+	void StartDeadlineL(TWheelTimer& aDeadline, TInt aTimeout);
+	void StopDeadline(TWheelTimer& aDeadline);
+
 	RSocket iRSocket;
 	DEF_SESSION_OPEN(iRSocket);
 
 	TBool IsSocketOpen() const { return IS_SUBSESSION_OPEN(iRSocket); }
+	void CheckAttached() const
+		{ if (iDetached) AoSocketPanic(EPanicSocketDetached); }
+	// for making a read, which a relay would get in the way of
+	void CheckReadL() const;
 	TBool HaveSocketServ() const { return (iSocketServ != NULL); }
 
 	// calls Close() with the specified parameter if a session exists
@@ -150,8 +268,18 @@ private:
 	CSocketWriter* iSocketWriter;
 	CSocketAccepter* iTcpAccepter; // for TCP only
 	CResolvingConnecter* iTcpConnecter; // for TCP only
+#if SUPPORT_BT
 	CBtConnecter* iBtConnecter; // for BT only
 	CBtAccepter* iBtAccepter; // for BT only
+#endif
+	CSocketRelay* iRelay;
+	CFileReceiver* iFileReceiver;
+	CFileSender* iFileSender;
+
+	// while relaying, the socket relayed to, which in turn points
+	// back to us, so that neither can go away without telling
+	CAoSocket* iRelayTarget;
+	CAoSocket* iRelaySource;
 
 	enum TMode
 		{
@@ -168,9 +296,27 @@ private:
 	PyObject* iReadCallback; // for Recv()
 	PyObject* iReadCallbackParam; // for Recv()
 	void FreeReadParams();
-	PyObject* iWriteCallback; // for Write()
-	PyObject* iWriteCallbackParam; // for Write()
+	// for Write(), one for each write queued, in order
+	class TWriteRequest
+		{
+	public:
+		TWriteRequest() :
+			iNext(NULL), iCallback(NULL), iParam(NULL),
+			iBuffers(NULL), iBufferCount(0) {}
+		TWriteRequest* iNext;
+		PyObject* iCallback;
+		PyObject* iParam;
+		// any memory sent from, allocated with new[]
+		TPinnedBuffer* iBuffers;
+		TInt iBufferCount;
+		void ReleaseBuffers();
+		};
+	TWriteRequest* iWriteHead;
+	TWriteRequest* iWriteTail;
 	void FreeWriteParams();
+	void QueueWriteL(const TPtrC8* aData, TInt aCount,
+					 TPinnedBuffer* aBuffers, PyObject* aCallback,
+					 PyObject* aParam, TInt aTimeout);
 	PyObject* iAcceptCallback; // for Accept()
 	PyObject* iAcceptCallbackParam; // for Accept()
 	PyObject* iBlankSocket; // for Accept()
@@ -178,10 +324,54 @@ private:
 	PyObject* iConnectCallback; // for Connect()
 	PyObject* iConnectCallbackParam; // for Connect()
 	void FreeConnectParams();
+	PyObject* iRelayCallback; // for RelayToL()
+	PyObject* iRelayCallbackParam; // for RelayToL()
+	void FreeRelayParams();
 
 	// may not be valid if there is no request pending
 	PyThreadState* iThreadState;
 
+	// for all of our active objects;
+	// zero, i.e. EPriorityStandard, unless set otherwise
+	TInt iPriority;
+
+	// see SetZeroCopy()
+	TBool iZeroCopy;
+
+	// see SetZeroCopyWrite()
+	TBool iZeroCopyWrite;
+
+	// see SetWriteWatermarks()
+	TInt iHighMark;
+	TInt iLowMark;
+	TBool iThrottled;
+	PyObject* iDrainCallback;
+	PyObject* iDrainParam;
+	void FreeDrainParams();
+
+	// see SetAdaptiveRead()
+	TInt iAdaptMin;
+	TInt iAdaptMax;
+
+	// see SetReadCoalescing()
+	TInt iCoalesceBytes;
+	TInt iCoalesceTime;
+
+	// the memory being read into by ReadIntoL(), if any
+	TPinnedBuffer iReadInto;
+
+	// Deadlines for the pending requests, if any. Upon expiry the
+	// request is cancelled, and the callback told KErrTimedOut.
+	// The wheel is looked up the first time a deadline is given.
+	CTimerWheel* iTimerWheel;
+	TWheelTimer iReadDeadline;
+	TWheelTimer iWriteDeadline;
+	TWheelTimer iConnectDeadline;
+
+	// set between Detach() and Attach(), during which time we have
+	// no active objects, and belong to no thread
+	TBool iDetached;
+
 	CTC_DEF_HANDLE(ctc);
 
 private: // MAoSockObserver
@@ -190,6 +380,12 @@ private: // MAoSockObserver
 	void ClientAccepted(TInt aError);
 	void ClientConnected(TInt aError);
 	void SocketConfigured(TInt aError);
+	void DataRelayed(TInt aError, TInt64 aCount);
+	void DataSaved(TInt aError, TInt aCount);
+	void FileSent(TInt aError, TInt aCount);
+
+private: // MWheelTimerObserver
+	void TimerExpired(TWheelTimer& aTimer);
 	};
 
 // --------------------------------------------------------------------
@@ -209,10 +405,18 @@ static apn_socket_object* NewSocketObject();
 
 TInt CAoSocket::WriteSync(const TDesC8& aData)
 	{
+	CheckAttached();
 	if (!IsSocketOpen())
 		{
 		AoSocketPanic(EPanicSocketNotOpen);
 		}
+	// it would get in between the writes queued, or replace the
+	// send of a relay into this socket
+	if ((iSocketWriter && iSocketWriter->IsBusy()) ||
+		(iFileSender && iFileSender->IsActive()) || iRelaySource)
+		{
+		return KErrInUse;
+		}
 
 	TRequestStatus status;
 	iRSocket.Write(aData, status);
@@ -222,10 +426,26 @@ TInt CAoSocket::WriteSync(const TDesC8& aData)
 
 TInt CAoSocket::ReadSync(TDes8& aData)
 	{
+	CheckAttached();
 	if (!IsSocketOpen())
 		{
 		AoSocketPanic(EPanicSocketNotOpen);
 		}
+	// the receive pending for a relay, a save to a file, or
+	// a record being read ahead would get replaced
+	if ((iRelay && iRelay->IsActive()) ||
+		(iFileReceiver && iFileReceiver->IsActive()) ||
+		(iSocketReader && iSocketReader->IsBusy()))
+		{
+		return KErrInUse;
+		}
+
+	// anything read ahead by an asynchronous read comes first
+	if (iSocketReader && iSocketReader->HasReadAhead())
+		{
+		iSocketReader->TakeReadAhead(aData);
+		return KErrNone;
+		}
 
 	TRequestStatus status;
 	TSockXfrLength len;
@@ -236,6 +456,7 @@ TInt CAoSocket::ReadSync(TDes8& aData)
 
 TInt CAoSocket::SendEof()
 	{
+	CheckAttached();
 	if (!IsSocketOpen())
 		{
 		AoSocketPanic(EPanicSocketNotOpen);
@@ -289,6 +510,7 @@ static TBool CallCallback(PyObject* aCallback, PyObject* aArgList)
 
 void CAoSocket::FreeReadParams()
 	{
+	iReadInto.Release();
 	if (iReadCallback)
 		{
 		Py_DECREF(iReadCallback);
@@ -301,18 +523,64 @@ void CAoSocket::FreeReadParams()
 		}
 	}
 
-void CAoSocket::FreeWriteParams()
+void CAoSocket::FreeRelayParams()
+	{
+	if (iRelayCallback)
+		{
+		Py_DECREF(iRelayCallback);
+		iRelayCallback = NULL;
+		}
+	if (iRelayCallbackParam)
+		{
+		Py_DECREF(iRelayCallbackParam);
+		iRelayCallbackParam = NULL;
+		}
+	}
+
+void CAoSocket::TWriteRequest::ReleaseBuffers()
 	{
-	if (iWriteCallback)
+	for (TInt i = 0; i < iBufferCount; i++)
 		{
-		Py_DECREF(iWriteCallback);
-		iWriteCallback = NULL;
+		iBuffers[i].Release();
 		}
-	if (iWriteCallbackParam)
+	delete[] iBuffers;
+	iBuffers = NULL;
+	iBufferCount = 0;
+	}
+
+void CAoSocket::FreeDrainParams()
+	{
+	Py_XDECREF(iDrainCallback);
+	iDrainCallback = NULL;
+	Py_XDECREF(iDrainParam);
+	iDrainParam = NULL;
+	}
+
+void CAoSocket::SetWriteWatermarks(TInt aHigh, TInt aLow,
+								   PyObject* aCallback, PyObject* aParam)
+	{
+	Py_XINCREF(aCallback);
+	Py_XINCREF(aParam);
+	FreeDrainParams();
+	iDrainCallback = aCallback;
+	iDrainParam = aParam;
+	iHighMark = aHigh;
+	iLowMark = aLow;
+	iThrottled = EFalse;
+	}
+
+void CAoSocket::FreeWriteParams()
+	{
+	while (iWriteHead)
 		{
-		Py_DECREF(iWriteCallbackParam);
-		iWriteCallbackParam = NULL;
+		TWriteRequest* request = iWriteHead;
+		iWriteHead = request->iNext;
+		request->ReleaseBuffers();
+		Py_DECREF(request->iCallback);
+		Py_DECREF(request->iParam);
+		delete request;
 		}
+	iWriteTail = NULL;
 	}
 
 void CAoSocket::FreeAcceptParams()
@@ -378,6 +646,7 @@ TInt CAoSocket::OpenTcp()
 	return error;
 	}
 
+#if SUPPORT_BT
 TInt CAoSocket::OpenBt()
 	{
 	if (!HaveSocketServ())
@@ -396,6 +665,7 @@ TInt CAoSocket::OpenBt()
 		}
 	return error;
 	}
+#endif
 
 /** Note that this method is not dependent on transport type.
  */
@@ -418,11 +688,13 @@ TInt CAoSocket::Blank()
 	return error;
 	}
 
+#if SUPPORT_BT
 void CAoSocket::ConnectBtL(const TDesC& aBtAddress,
 						   TInt aPort,
 						   PyObject* aCallback,
 						   PyObject* aParam)
 	{
+	CheckAttached();
 	if (!IsSocketOpen())
 		{
 		AoSocketPanic(EPanicSocketNotOpen);
@@ -447,14 +719,18 @@ void CAoSocket::ConnectBtL(const TDesC& aBtAddress,
 	TBTDevAddr btDevAddr;
 	BtEngine::StringToDevAddr(btDevAddr, aBtAddress);
 
+	ApplyPriority(iBtConnecter);
 	iBtConnecter->ConnectL(btDevAddr, aPort);
 	}
+#endif
 
 void CAoSocket::ConnectTcpL(const TDesC& aHostName,
 							TInt aPort,
 							PyObject* aCallback,
-							PyObject* aParam)
+							PyObject* aParam,
+							TInt aTimeout)
 	{
+	CheckAttached();
 	if (!IsSocketOpen())
 		{
 		AoSocketPanic(EPanicSocketNotOpen);
@@ -469,6 +745,7 @@ void CAoSocket::ConnectTcpL(const TDesC& aHostName,
 			*this, iRSocket, SocketServ(),
 			iConnection ? (&ToCxxConnection(iConnection)) : NULL);
 		}
+	StartDeadlineL(iConnectDeadline, aTimeout);
 
 	Py_INCREF(aCallback);
 	Py_INCREF(aParam);
@@ -478,6 +755,7 @@ void CAoSocket::ConnectTcpL(const TDesC& aHostName,
 
 	iThreadState = PyThreadState_Get();
 
+	ApplyPriority(iTcpConnecter);
 	iTcpConnecter->Connect(aHostName, aPort);
 	}
 
@@ -487,6 +765,102 @@ void CAoSocket::CancelAll()
 	CancelWrite();
 	CancelAccept();
 	CancelConnect();
+	CancelRelay();
+	}
+
+/** It is okay to call this method even when not relaying,
+	or even when the socket is closed. No callback is made.
+*/
+void CAoSocket::CancelRelay()
+	{
+	if (iRelay)
+		{
+		iRelay->Cancel();
+		}
+	if (iRelayTarget)
+		{
+		iRelayTarget->iRelaySource = NULL;
+		iRelayTarget = NULL;
+		}
+	}
+
+void CAoSocket::CheckReadL() const
+	{
+	CheckAttached();
+	if ((iRelay && iRelay->IsActive()) ||
+		(iFileReceiver && iFileReceiver->IsActive()))
+		{
+		User::Leave(KErrInUse);
+		}
+	}
+
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts).
+*/
+void CAoSocket::RelayToL(CAoSocket& aTo,
+						 PyObject* aCallback,
+						 PyObject* aParam)
+	{
+	CheckAttached();
+	aTo.CheckAttached();
+	if (&aTo == this)
+		{
+		User::Leave(KErrArgument);
+		}
+	if (!IsSocketOpen() || !aTo.IsSocketOpen())
+		{
+		User::Leave(KErrNotReady);
+		}
+	if ((iRelay && iRelay->IsActive()) ||
+		(iSocketReader && iSocketReader->IsBusy()) ||
+		aTo.iRelaySource ||
+		(aTo.iSocketWriter && aTo.iSocketWriter->IsBusy()) ||
+		(aTo.iFileSender && aTo.iFileSender->IsActive()))
+		{
+		User::Leave(KErrInUse);
+		}
+	if (!iRelay)
+		{
+		iRelay = new (ELeave) CSocketRelay(*this, iRSocket);
+		}
+
+	Py_INCREF(aCallback);
+	Py_INCREF(aParam);
+	FreeRelayParams();
+	iRelayCallback = aCallback;
+	iRelayCallbackParam = aParam;
+
+	iThreadState = PyThreadState_Get();
+
+	ApplyPriority(iRelay);
+	iRelay->StartL(aTo.iRSocket, iSocketReader);
+	iRelayTarget = &aTo;
+	aTo.iRelaySource = this;
+	}
+
+void CAoSocket::DataRelayed(TInt aError, TInt64 aCount)
+	{
+	AssertNonNull(iRelayCallback);
+	AssertNonNull(iRelayCallbackParam);
+	if (iRelayTarget)
+		{
+		iRelayTarget->iRelaySource = NULL;
+		iRelayTarget = NULL;
+		}
+
+	PyDispatchEnter(iThreadState);
+
+	PyObject* arg = Py_BuildValue("(iLO)", aError,
+								  static_cast<PY_LONG_LONG>(aCount),
+								  iRelayCallbackParam);
+
+	CallCallback(iRelayCallback, arg); // owns 'arg'
+
+	PyDispatchLeave();
+
+	// the callback may have done anything, including
+	// deleting the object whose method we are in,
+	// so do not attempt to access any property anymore
 	}
 
 /** It is okay to call this method even when there is
@@ -494,16 +868,19 @@ void CAoSocket::CancelAll()
 */
 void CAoSocket::CancelConnect()
 	{
+	StopDeadline(iConnectDeadline);
 	if (IsSocketOpen())
 		{
 		if (iMode == ETcpMode && iTcpConnecter)
 			{
 			iTcpConnecter->Cancel();
 			}
+#if SUPPORT_BT
 		if (iMode == EBtMode && iBtConnecter)
 			{
 			iBtConnecter->Cancel();
 			}
+#endif
 		}
 	}
 
@@ -512,13 +889,13 @@ void CAoSocket::SocketConfigured(TInt aError)
 	AssertNonNull(iAcceptCallback);
 	AssertNonNull(iAcceptCallbackParam);
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
 	PyObject* arg;
 	arg = Py_BuildValue("(iO)", aError, iAcceptCallbackParam);
 	CallCallback(iAcceptCallback, arg); // owns 'arg'
 
-	PyEval_SaveThread();
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
@@ -532,16 +909,17 @@ void CAoSocket::SocketConfigured(TInt aError)
 */
 void CAoSocket::ClientConnected(TInt aError)
 	{
+	StopDeadline(iConnectDeadline);
 	AssertNonNull(iConnectCallback);
 	AssertNonNull(iConnectCallbackParam);
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
 	PyObject* arg;
 	arg = Py_BuildValue("(iO)", aError, iConnectCallbackParam);
 	CallCallback(iConnectCallback, arg); // owns 'arg'
 
-	PyEval_SaveThread();
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
@@ -559,10 +937,12 @@ void CAoSocket::CancelAccept()
 			{
 			iTcpAccepter->Cancel();
 			}
+#if SUPPORT_BT
 		if (iMode == EBtMode && iBtAccepter)
 			{
 			iBtAccepter->Cancel();
 			}
+#endif
 		}
 	}
 
@@ -573,6 +953,7 @@ void CAoSocket::AcceptL(PyObject* aBlankSocket,
 						PyObject* aCallback,
 						PyObject* aParam)
 	{
+	CheckAttached();
 	if (iMode == ETcpMode)
 		{
 		if (!iTcpAccepter)
@@ -580,6 +961,7 @@ void CAoSocket::AcceptL(PyObject* aBlankSocket,
 			iTcpAccepter = new (ELeave) CSocketAccepter(*this, iRSocket);
 			}
 		}
+#if SUPPORT_BT
 	else if (iMode == EBtMode)
 		{
 		if (!iBtAccepter)
@@ -587,6 +969,7 @@ void CAoSocket::AcceptL(PyObject* aBlankSocket,
 			AoSocketPanic(EPanicAcceptBeforeListen);
 			}
 		}
+#endif
 	else
 		{
 		AoSocketPanic(EPanicAcceptBeforeListen);
@@ -607,12 +990,203 @@ void CAoSocket::AcceptL(PyObject* aBlankSocket,
 	AssertNonNull(blsock->iAoSocket);
 	if (iMode == ETcpMode)
 		{
+		ApplyPriority(iTcpAccepter);
 		blsock->iAoSocket->ApplyAccepter(*iTcpAccepter);
 		}
+#if SUPPORT_BT
 	else
 		{
+		ApplyPriority(iBtAccepter);
 		blsock->iAoSocket->ApplyAccepterL(*iBtAccepter);
 		}
+#endif
+	}
+
+void CAoSocket::SetPriority(TInt aPriority)
+	{
+	iPriority = aPriority;
+	ApplyPriority(iSocketReader);
+	ApplyPriority(iSocketWriter);
+	ApplyPriority(iTcpAccepter);
+	ApplyPriority(iTcpConnecter);
+	ApplyPriority(iRelay);
+	ApplyPriority(iFileReceiver);
+	ApplyPriority(iFileSender);
+#if SUPPORT_BT
+	ApplyPriority(iBtConnecter);
+	ApplyPriority(iBtAccepter);
+#endif
+	}
+
+/** Note that CActive::SetPriority() must not be called while
+	there is a request pending, which is why we may have to
+	leave it until the next request.
+*/
+void CAoSocket::ApplyPriority(CActive* aActive)
+	{
+	if (aActive && !aActive->IsActive() &&
+		aActive->Priority() != iPriority)
+		{
+		aActive->SetPriority(iPriority);
+		}
+	}
+
+/** Every request either sets or clears its deadline, so that one
+	left behind by a request that failed to be made cannot affect
+	later ones.
+*/
+void CAoSocket::StartDeadlineL(TWheelTimer& aDeadline, TInt aTimeout)
+	{
+	if (aTimeout <= 0)
+		{
+		StopDeadline(aDeadline);
+		return;
+		}
+	if (!iTimerWheel)
+		{
+		iTimerWheel = CTimerWheel::InstanceL();
+		}
+	iTimerWheel->Add(aDeadline, aTimeout);
+	}
+
+void CAoSocket::StopDeadline(TWheelTimer& aDeadline)
+	{
+	if (iTimerWheel)
+		{
+		iTimerWheel->Remove(aDeadline);
+		}
+	}
+
+/** Called from the RunL() of the timing wheel. If the request has
+	completed already, but we have not yet been told, we let the
+	result stand; the same goes for one that completes while being
+	cancelled, as it may with a completion not yet collected.
+*/
+void CAoSocket::TimerExpired(TWheelTimer& aTimer)
+	{
+	if (&aTimer == &iReadDeadline)
+		{
+		if (iSocketReader && iSocketReader->IsActive() &&
+			iSocketReader->iStatus == KRequestPending)
+			{
+			if (iSocketReader->Expire())
+				{
+				DataRead(KErrTimedOut, KNullDesC8);
+				}
+			else
+				{
+				// should the data only be part of a record, the
+				// receive for the rest times out on the next tick
+				iTimerWheel->Add(iReadDeadline, 1);
+				}
+			}
+		}
+	else if (&aTimer == &iWriteDeadline)
+		{
+		if (iSocketWriter && iSocketWriter->IsActive() &&
+			iSocketWriter->iStatus == KRequestPending)
+			{
+			// every write queued fails
+			iSocketWriter->Fail(KErrTimedOut);
+			}
+		}
+	else if (&aTimer == &iConnectDeadline)
+		{
+		if (iTcpConnecter && iTcpConnecter->IsActive() &&
+			iTcpConnecter->iStatus == KRequestPending)
+			{
+			iTcpConnecter->Cancel();
+			TInt error = iTcpConnecter->iStatus.Int();
+			ClientConnected((error == KErrCancel) ? KErrTimedOut : error);
+			}
+		}
+	// the callback may have done anything, including
+	// deleting this object
+	}
+
+/** Our active objects are registered with the scheduler of this
+	thread, and the timing wheel is that of this thread, so we get
+	rid of all of them. They get created again as needed once
+	attached to another thread. Note that on Symbian the socket
+	server session must have been shared for the socket to be usable
+	in another thread.
+*/
+TInt CAoSocket::Detach()
+	{
+	CTC_CHECK(ctc);
+	if (iDetached)
+		{
+		return KErrNone;
+		}
+	// any data read ahead would get lost with the reader
+	if ((iSocketReader &&
+		 (iSocketReader->IsBusy() || iSocketReader->HasReadAhead())) ||
+		(iSocketWriter && iSocketWriter->IsBusy()) ||
+		(iTcpAccepter && iTcpAccepter->IsActive()) ||
+		(iTcpConnecter && iTcpConnecter->IsActive()) ||
+		(iRelay && iRelay->IsActive()) || iRelaySource ||
+		(iFileReceiver && iFileReceiver->IsActive()) ||
+		(iFileSender && iFileSender->IsActive()))
+		{
+		return KErrInUse;
+		}
+#if SUPPORT_BT
+	if ((iBtAccepter && iBtAccepter->IsActive()) ||
+		(iBtConnecter && iBtConnecter->IsActive()))
+		{
+		return KErrInUse;
+		}
+#endif
+
+	StopDeadline(iReadDeadline);
+	StopDeadline(iWriteDeadline);
+	StopDeadline(iConnectDeadline);
+	iTimerWheel = NULL;
+
+	delete iSocketReader;
+	iSocketReader = NULL;
+	delete iSocketWriter;
+	iSocketWriter = NULL;
+	delete iTcpAccepter;
+	iTcpAccepter = NULL;
+	delete iTcpConnecter;
+	iTcpConnecter = NULL;
+	delete iRelay;
+	iRelay = NULL;
+	delete iFileReceiver;
+	iFileReceiver = NULL;
+	delete iFileSender;
+	iFileSender = NULL;
+#if SUPPORT_BT
+	delete iBtAccepter;
+	iBtAccepter = NULL;
+	delete iBtConnecter;
+	iBtConnecter = NULL;
+#endif
+
+#if ON_HOST
+	if (IsSocketOpen())
+		{
+		iRSocket.HostDetach();
+		}
+#endif
+
+	iDetached = ETrue;
+	return KErrNone;
+	}
+
+/** Makes this thread the owner. Attaching a socket that is not
+	detached is only okay in the thread that owns it already.
+*/
+void CAoSocket::Attach()
+	{
+	if (!iDetached)
+		{
+		CTC_CHECK(ctc);
+		return;
+		}
+	CTC_STORE_HANDLE(ctc);
+	iDetached = EFalse;
 	}
 
 void CAoSocket::ApplyAccepter(CSocketAccepter& anAccepter)
@@ -621,11 +1195,13 @@ void CAoSocket::ApplyAccepter(CSocketAccepter& anAccepter)
 	anAccepter.Accept(iRSocket);
 	}
 
+#if SUPPORT_BT
 void CAoSocket::ApplyAccepterL(CBtAccepter& anAccepter)
 	{
 	if (iMode != EPipeMode) AssertFail();
 	anAccepter.AcceptL(iRSocket);
 	}
+#endif
 
 void CAoSocket::ClientAccepted(TInt aError)
 	{
@@ -633,7 +1209,7 @@ void CAoSocket::ClientAccepted(TInt aError)
 	AssertNonNull(iAcceptCallbackParam);
 	AssertNonNull(iBlankSocket);
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
 	PyObject* arg;
 	if (aError == KErrNone)
@@ -651,7 +1227,7 @@ void CAoSocket::ClientAccepted(TInt aError)
 
 	CallCallback(iAcceptCallback, arg); // owns 'arg'
 
-	PyEval_SaveThread();
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
@@ -663,10 +1239,18 @@ void CAoSocket::ClientAccepted(TInt aError)
 */
 void CAoSocket::CancelRead()
 	{
+	StopDeadline(iReadDeadline);
 	if (IsSocketOpen() && iSocketReader)
 		{
-		iSocketReader->Cancel();
+		// also ends any streaming
+		iSocketReader->StopStreaming();
 		}
+	if (iFileReceiver)
+		{
+		iFileReceiver->Cancel();
+		}
+	// no longer in use by the reader
+	iReadInto.Release();
 	}
 
 /** Always takes ownership of the parameters
@@ -674,14 +1258,17 @@ void CAoSocket::CancelRead()
 */
 void CAoSocket::ReadExactL(TInt aSize,
 						   PyObject* aCallback,
-						   PyObject* aParam)
+						   PyObject* aParam,
+						   TInt aTimeout)
 	{
+	CheckReadL();
 	if (!iSocketReader)
 		{
 		//// note that neither CActive (the base class) or this
 		//// class has ConstructL() to call
 		iSocketReader = new (ELeave) CSocketReader(*this, iRSocket);
 		}
+	StartDeadlineL(iReadDeadline, aTimeout);
 
 	Py_INCREF(aCallback);
 	Py_INCREF(aParam);
@@ -691,6 +1278,8 @@ void CAoSocket::ReadExactL(TInt aSize,
 
 	iThreadState = PyThreadState_Get();
 
+	ApplyPriority(iSocketReader);
+	iSocketReader->SetPoolKeep(SocketServPoolSize(iSocketServ));
 	iSocketReader->ReadExactL(aSize);
 	}
 
@@ -699,12 +1288,15 @@ void CAoSocket::ReadExactL(TInt aSize,
 */
 void CAoSocket::ReadSomeL(TInt aMaxSize,
 						  PyObject* aCallback,
-						  PyObject* aParam)
+						  PyObject* aParam,
+						  TInt aTimeout)
 	{
+	CheckReadL();
 	if (!iSocketReader)
 		{
 		iSocketReader = new (ELeave) CSocketReader(*this, iRSocket);
 		}
+	StartDeadlineL(iReadDeadline, aTimeout);
 
 	Py_INCREF(aCallback);
 	Py_INCREF(aParam);
@@ -714,97 +1306,532 @@ void CAoSocket::ReadSomeL(TInt aMaxSize,
 
 	iThreadState = PyThreadState_Get();
 
+	ApplyPriority(iSocketReader);
+	iSocketReader->SetPoolKeep(SocketServPoolSize(iSocketServ));
+	iSocketReader->SetAdaptive(iAdaptMin, iAdaptMax);
 	iSocketReader->ReadSomeL(aMaxSize);
 	}
 
-void CAoSocket::DataRead(TInt aError, const TDesC8& aData)
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts).
+*/
+void CAoSocket::ReadUntilL(const TDesC8& aDelim,
+						   TInt aMaxLen,
+						   PyObject* aCallback,
+						   PyObject* aParam,
+						   TInt aTimeout)
 	{
-	AssertNonNull(iReadCallback);
-	AssertNonNull(iReadCallbackParam);
-
-	PyEval_RestoreThread(iThreadState);
-
-	PyObject* arg;
-	if (aError == KErrNone)
-		{
-		// this call increments the 'cbParam' reference count
-		arg = Py_BuildValue("(is#O)", aError,
-							aData.Ptr(), aData.Length(),
-							iReadCallbackParam);
-		}
-#if 0
-	else if (aError == KErrEof)
-		{
-		arg = Py_BuildValue("(is#O)", 0, NULL, 0, iReadCallbackParam);
-		}
-#endif
-	else
+	CheckReadL();
+	if (!iSocketReader)
 		{
-		arg = Py_BuildValue("(is#O)", aError, NULL,
-							0, iReadCallbackParam);
+		iSocketReader = new (ELeave) CSocketReader(*this, iRSocket);
 		}
+	StartDeadlineL(iReadDeadline, aTimeout);
 
-	CallCallback(iReadCallback, arg); // owns 'arg'
+	Py_INCREF(aCallback);
+	Py_INCREF(aParam);
+	FreeReadParams();
+	iReadCallback = aCallback;
+	iReadCallbackParam = aParam;
 
-	PyEval_SaveThread();
+	iThreadState = PyThreadState_Get();
 
-	// the callback may have done anything, including
-	// deleting the object whose method we are in,
-	// so do not attempt to access any property anymore
+	ApplyPriority(iSocketReader);
+	iSocketReader->SetPoolKeep(SocketServPoolSize(iSocketServ));
+	iSocketReader->ReadUntilL(aDelim, aMaxLen);
 	}
 
-/** It is okay to call this method even when there is
-	no request pending, or even when the socket is closed.
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts), but only takes over
+	aBuffer if it does not leave.
 */
-void CAoSocket::CancelWrite()
+void CAoSocket::ReadIntoL(TPinnedBuffer& aBuffer,
+						  TInt aOffset,
+						  TInt aMaxSize,
+						  PyObject* aCallback,
+						  PyObject* aParam,
+						  TInt aTimeout)
 	{
-	if (IsSocketOpen() && iSocketWriter)
+	CheckReadL();
+	if (!iSocketReader)
 		{
-		iSocketWriter->Cancel();
+		iSocketReader = new (ELeave) CSocketReader(*this, iRSocket);
 		}
+	StartDeadlineL(iReadDeadline, aTimeout);
+
+	Py_INCREF(aCallback);
+	Py_INCREF(aParam);
+	FreeReadParams();
+	iReadCallback = aCallback;
+	iReadCallbackParam = aParam;
+	iReadInto.TakeFrom(aBuffer);
+
+	iThreadState = PyThreadState_Get();
+
+	ApplyPriority(iSocketReader);
+	iSocketReader->ReadInto(iReadInto.Ptr() + aOffset, aMaxSize);
 	}
 
 /** Always takes ownership of the parameters
 	(i.e. will take care of the refcounts).
 */
-void CAoSocket::WriteDataL(const TDesC8& aData,
+void CAoSocket::ReadFrameL(CSocketReader::TFrameHeader aHeader,
+						   TInt aMaxSize,
 						   PyObject* aCallback,
-						   PyObject* aParam)
+						   PyObject* aParam,
+						   TInt aTimeout)
 	{
-	if (!iSocketWriter)
+	CheckReadL();
+	if (!iSocketReader)
 		{
-		iSocketWriter = new (ELeave) CSocketWriter(*this, iRSocket);
+		iSocketReader = new (ELeave) CSocketReader(*this, iRSocket);
 		}
+	StartDeadlineL(iReadDeadline, aTimeout);
 
 	Py_INCREF(aCallback);
 	Py_INCREF(aParam);
-	FreeWriteParams();
-	iWriteCallback = aCallback;
-	iWriteCallbackParam = aParam;
+	FreeReadParams();
+	iReadCallback = aCallback;
+	iReadCallbackParam = aParam;
 
 	iThreadState = PyThreadState_Get();
 
-	iSocketWriter->WriteDataL(aData);
+	ApplyPriority(iSocketReader);
+	iSocketReader->SetPoolKeep(SocketServPoolSize(iSocketServ));
+	iSocketReader->ReadFrameL(aHeader, aMaxSize);
 	}
 
-void CAoSocket::DataWritten(TInt aError)
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts).
+*/
+void CAoSocket::StartReadingL(TInt aMaxSize,
+							  PyObject* aCallback,
+							  PyObject* aParam)
+	{
+	CheckReadL();
+	if (!iSocketReader)
+		{
+		iSocketReader = new (ELeave) CSocketReader(*this, iRSocket);
+		}
+	StopDeadline(iReadDeadline);
+
+	Py_INCREF(aCallback);
+	Py_INCREF(aParam);
+	FreeReadParams();
+	iReadCallback = aCallback;
+	iReadCallbackParam = aParam;
+
+	iThreadState = PyThreadState_Get();
+
+	ApplyPriority(iSocketReader);
+	iSocketReader->SetPoolKeep(SocketServPoolSize(iSocketServ));
+	iSocketReader->SetAdaptive(iAdaptMin, iAdaptMax);
+	iSocketReader->SetCoalescingL(iCoalesceBytes, iCoalesceTime);
+	iSocketReader->StartStreamingL(aMaxSize);
+	}
+
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts).
+*/
+void CAoSocket::ReadToFileL(const TDesC& aPath,
+							TInt aOffset,
+							TInt aLength,
+							TInt aInterval,
+							PyObject* aCallback,
+							PyObject* aParam)
+	{
+	CheckReadL();
+	if (!IsSocketOpen())
+		{
+		User::Leave(KErrNotReady);
+		}
+	if (iSocketReader && iSocketReader->IsBusy())
+		{
+		User::Leave(KErrInUse);
+		}
+	if (!iFileReceiver)
+		{
+		iFileReceiver = new (ELeave) CFileReceiver(*this, iRSocket);
+		}
+	StopDeadline(iReadDeadline);
+
+	ApplyPriority(iFileReceiver);
+	iFileReceiver->StartL(aPath, aOffset, aLength, aInterval,
+						  iSocketReader);
+
+	Py_INCREF(aCallback);
+	Py_INCREF(aParam);
+	FreeReadParams();
+	iReadCallback = aCallback;
+	iReadCallbackParam = aParam;
+
+	iThreadState = PyThreadState_Get();
+	}
+
+/** Called both for progress reports and upon completion.
+*/
+void CAoSocket::DataSaved(TInt aError, TInt aCount)
+	{
+	AssertNonNull(iReadCallback);
+	AssertNonNull(iReadCallbackParam);
+
+	PyDispatchEnter(iThreadState);
+
+	PyObject* arg = Py_BuildValue("(iiO)", aError, aCount,
+								  iReadCallbackParam);
+
+	CallCallback(iReadCallback, arg); // owns 'arg'
+
+	PyDispatchLeave();
+
+	// the callback may have done anything, including
+	// deleting the object whose method we are in,
+	// so do not attempt to access any property anymore
+	}
+
+/** It is okay to call this method even when not streaming,
+	or even when the socket is closed. Any read request pending
+	gets cancelled.
+*/
+void CAoSocket::StopReading()
+	{
+	CancelRead();
+	}
+
+void CAoSocket::DataRead(TInt aError, const TDesC8& aData)
+	{
+	StopDeadline(iReadDeadline);
+	AssertNonNull(iReadCallback);
+	AssertNonNull(iReadCallbackParam);
+
+	PyDispatchEnter(iThreadState);
+
+	PyObject* arg;
+	TUint8* buf = NULL;
+	if (iReadInto.IsPinned())
+		{
+		// the callback is free to do what it likes with the
+		// memory, which is no longer written to
+		iReadInto.Release();
+		arg = Py_BuildValue("(iiO)", aError, aError ? 0 : aData.Length(),
+							iReadCallbackParam);
+		CallCallback(iReadCallback, arg); // owns 'arg'
+		PyDispatchLeave();
+		return;
+		}
+	TInt capacity;
+	CBufferPool* pool;
+	TInt keep;
+	if (aError == KErrNone && iZeroCopy)
+		{
+		// data from the read-ahead buffer cannot be handed over
+		buf = iSocketReader->DetachData(capacity, pool, keep);
+		}
+	if (buf)
+		{
+		PyObject* data = NewReadBuffer(buf, aData.Length(),
+									   capacity, pool, keep);
+		arg = data ? Py_BuildValue("(iNO)", aError, data,
+								   iReadCallbackParam) : NULL;
+		}
+	else if (aError == KErrNone)
+		{
+		// this call increments the 'cbParam' reference count
+		arg = Py_BuildValue("(is#O)", aError,
+							aData.Ptr(), aData.Length(),
+							iReadCallbackParam);
+		}
+#if 0
+	else if (aError == KErrEof)
+		{
+		arg = Py_BuildValue("(is#O)", 0, NULL, 0, iReadCallbackParam);
+		}
+#endif
+	else
+		{
+		arg = Py_BuildValue("(is#O)", aError, NULL,
+							0, iReadCallbackParam);
+		}
+
+	CallCallback(iReadCallback, arg); // owns 'arg'
+
+	PyDispatchLeave();
+
+	// the callback may have done anything, including
+	// deleting the object whose method we are in,
+	// so do not attempt to access any property anymore
+	}
+
+/** It is okay to call this method even when there is
+	no request pending, or even when the socket is closed.
+	Every write queued gets dropped, without a callback.
+*/
+void CAoSocket::CancelWrite()
+	{
+	StopDeadline(iWriteDeadline);
+	if (iSocketWriter)
+		{
+		iSocketWriter->Clear();
+		}
+	if (iFileSender)
+		{
+		iFileSender->Cancel();
+		}
+	FreeWriteParams();
+	// nothing is queued, and there is no drain callback
+	iThrottled = EFalse;
+	}
+
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts).
+*/
+void CAoSocket::WriteDataL(const TDesC8& aData,
+						   PyObject* aCallback,
+						   PyObject* aParam,
+						   TInt aTimeout)
+	{
+	TPtrC8 data(aData);
+	QueueWriteL(&data, 1, NULL, aCallback, aParam, aTimeout);
+	}
+
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts), but only takes over
+	aBuffer if it does not leave.
+*/
+void CAoSocket::WritePinnedL(TPinnedBuffer& aBuffer,
+							 PyObject* aCallback,
+							 PyObject* aParam,
+							 TInt aTimeout)
+	{
+	TPinnedBuffer* buffers = new (ELeave) TPinnedBuffer[1];
+	buffers[0].TakeFrom(aBuffer);
+	TPtrC8 data(buffers[0].Ptr(), buffers[0].Length());
+	TRAPD(error, QueueWriteL(&data, 1, buffers, aCallback, aParam,
+							 aTimeout));
+	if (error)
+		{
+		aBuffer.TakeFrom(buffers[0]);
+		delete[] buffers;
+		User::Leave(error);
+		}
+	}
+
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts), but only takes over
+	aBuffers if it does not leave.
+*/
+void CAoSocket::WriteBatchL(TPinnedBuffer* aBuffers,
+							TInt aCount,
+							PyObject* aCallback,
+							PyObject* aParam,
+							TInt aTimeout)
+	{
+	TPtrC8* data = new (ELeave) TPtrC8[aCount > 0 ? aCount : 1];
+	for (TInt i = 0; i < aCount; i++)
+		{
+		data[i].Set(aBuffers[i].Ptr(), aBuffers[i].Length());
+		}
+	TRAPD(error, QueueWriteL(data, aCount, aBuffers, aCallback, aParam,
+							 aTimeout));
+	delete[] data;
+	User::LeaveIfError(error);
+	}
+
+// A single aData is copied unless aBuffers is given, in which case
+// aData is their memory, and the array gets taken over unless we
+// leave. Either way there is a single callback.
+void CAoSocket::QueueWriteL(const TPtrC8* aData,
+							TInt aCount,
+							TPinnedBuffer* aBuffers,
+							PyObject* aCallback,
+							PyObject* aParam,
+							TInt aTimeout)
+	{
+	CheckAttached();
+	if (iRelaySource || (iFileSender && iFileSender->IsActive()))
+		{
+		User::Leave(KErrInUse);
+		}
+	if (!iSocketWriter)
+		{
+		iSocketWriter = new (ELeave) CSocketWriter(*this, iRSocket);
+		}
+	if (aTimeout > 0)
+		{
+		StartDeadlineL(iWriteDeadline, aTimeout);
+		}
+
+	TWriteRequest* request = new (ELeave) TWriteRequest;
+	ApplyPriority(iSocketWriter);
+	TInt error;
+	if (aBuffers)
+		{
+		TRAP(error, iSocketWriter->WriteBatchL(aData, aCount));
+		}
+	else
+		{
+		TRAP(error, iSocketWriter->WriteDataL(aData[0]));
+		}
+	if (error)
+		{
+		delete request;
+		User::Leave(error);
+		}
+	request->iBuffers = aBuffers;
+	request->iBufferCount = aBuffers ? aCount : 0;
+	if (iHighMark > 0 && iSocketWriter->QueuedBytes() >= iHighMark)
+		{
+		iThrottled = ETrue;
+		}
+
+	Py_INCREF(aCallback);
+	Py_INCREF(aParam);
+	request->iNext = NULL;
+	request->iCallback = aCallback;
+	request->iParam = aParam;
+	if (iWriteTail)
+		{
+		iWriteTail->iNext = request;
+		}
+	else
+		{
+		iWriteHead = request;
+		}
+	iWriteTail = request;
+
+	iThreadState = PyThreadState_Get();
+	}
+
+/** Always takes ownership of the parameters
+	(i.e. will take care of the refcounts).
+*/
+void CAoSocket::WriteFileL(const TDesC& aPath,
+						   TInt aFd,
+						   TInt aOffset,
+						   TInt aCount,
+						   PyObject* aCallback,
+						   PyObject* aParam)
+	{
+	CheckAttached();
+	if (!IsSocketOpen())
+		{
+		User::Leave(KErrNotReady);
+		}
+	// the file goes out on its own, not in between other writes
+	if (iRelaySource ||
+		(iSocketWriter && iSocketWriter->IsBusy()) ||
+		(iFileSender && iFileSender->IsActive()))
+		{
+		User::Leave(KErrInUse);
+		}
+	if (!iFileSender)
+		{
+		iFileSender = new (ELeave) CFileSender(*this, iRSocket);
+		}
+	StopDeadline(iWriteDeadline);
+
+	TWriteRequest* request = new (ELeave) TWriteRequest;
+	ApplyPriority(iFileSender);
+	TRAPD(error, iFileSender->StartL(aPath, aFd, aOffset, aCount));
+	if (error)
+		{
+		delete request;
+		User::Leave(error);
+		}
+
+	Py_INCREF(aCallback);
+	Py_INCREF(aParam);
+	request->iNext = NULL;
+	request->iCallback = aCallback;
+	request->iParam = aParam;
+	iWriteHead = iWriteTail = request;
+
+	iThreadState = PyThreadState_Get();
+	}
+
+void CAoSocket::FileSent(TInt aError, TInt aCount)
 	{
-	AssertNonNull(iWriteCallback);
-	AssertNonNull(iWriteCallbackParam);
+	TWriteRequest* request = iWriteHead;
+	AssertNonNull(request);
+	iWriteHead = iWriteTail = NULL;
 
-	PyEval_RestoreThread(iThreadState);
+	PyDispatchEnter(iThreadState);
 
-	PyObject* arg = Py_BuildValue("(iO)", aError, iWriteCallbackParam);
+	PyObject* arg = Py_BuildValue("(iiO)", aError, aCount,
+								  request->iParam);
 
-	CallCallback(iWriteCallback, arg); // owns 'arg'
+	CallCallback(request->iCallback, arg); // owns 'arg'
 
-	PyEval_SaveThread();
+	Py_DECREF(request->iCallback);
+	Py_DECREF(request->iParam);
+	delete request;
+
+	PyDispatchLeave();
 
 	// the callback may have done anything, including
 	// deleting the object whose method we are in,
 	// so do not attempt to access any property anymore
 	}
 
+/** Called once for each write, in the order made. Any drain
+	callback comes after that of the write that let the queue drain.
+*/
+void CAoSocket::DataWritten(TInt aError)
+	{
+	TWriteRequest* request = iWriteHead;
+	AssertNonNull(request);
+	iWriteHead = request->iNext;
+	if (!iWriteHead)
+		{
+		iWriteTail = NULL;
+		StopDeadline(iWriteDeadline);
+		}
+	TBool drained = EFalse;
+	if (iThrottled && iSocketWriter->QueuedBytes() <= iLowMark)
+		{
+		iThrottled = EFalse;
+		drained = (iDrainCallback != NULL);
+		}
+
+	PyDispatchEnter(iThreadState);
+
+	// held on to, as the write callback might close us
+	PyObject* drainCallback = NULL;
+	PyObject* drainParam = NULL;
+	if (drained)
+		{
+		drainCallback = iDrainCallback;
+		drainParam = iDrainParam;
+		Py_INCREF(drainCallback);
+		Py_INCREF(drainParam);
+		}
+
+	// the callback is free to do what it likes with the memory,
+	// which is no longer sent from
+	request->ReleaseBuffers();
+	PyObject* arg = Py_BuildValue("(iO)", aError, request->iParam);
+
+	CallCallback(request->iCallback, arg); // owns 'arg'
+
+	Py_DECREF(request->iCallback);
+	Py_DECREF(request->iParam);
+	delete request;
+
+	if (drainCallback)
+		{
+		arg = Py_BuildValue("(iO)", aError, drainParam);
+		CallCallback(drainCallback, arg); // owns 'arg'
+		Py_DECREF(drainCallback);
+		Py_DECREF(drainParam);
+		}
+
+	PyDispatchLeave();
+
+	// the callbacks may have done anything, including
+	// deleting the object whose method we are in,
+	// so do not attempt to access any property anymore
+	}
+
 void CAoSocket::SetSocketServ(PyObject* aSocketServ)
 	{
 	// The socket server session is shared by RConnection,
@@ -860,12 +1887,14 @@ CAoSocket* CAoSocket::NewL()
 	return object;
 	}
 
-CAoSocket::CAoSocket()
+CAoSocket::CAoSocket() :
+	iReadDeadline(*this),
+	iWriteDeadline(*this),
+	iConnectDeadline(*this)
 	{
 	// Doing this here to make sure it is available when
-	// calling Close(), even though doing it here means
-	// that it becomes impossible to change ownership
-	// of this object between threads.
+	// calling Close(). Ownership may only change hands
+	// between threads by way of Detach() and Attach().
 	CTC_STORE_HANDLE(ctc);
 	}
 
@@ -876,32 +1905,62 @@ CAoSocket::~CAoSocket()
 
 void CAoSocket::Close(TBool aFull)
 	{
+	if (iDetached)
+		{
+		// there are no active objects to worry about, and once
+		// closed the socket belongs to whichever thread reopens it
+		CTC_STORE_HANDLE(ctc);
+		iDetached = EFalse;
+		}
 	CTC_CHECK(ctc);
 
 	CancelRead();
 	delete iSocketReader;
 	iSocketReader = NULL;
+	delete iFileReceiver;
+	iFileReceiver = NULL;
 
 	CancelWrite();
 	delete iSocketWriter;
 	iSocketWriter = NULL;
+	delete iFileSender;
+	iFileSender = NULL;
 
 	CancelAccept();
 	delete iTcpAccepter;
 	iTcpAccepter = NULL;
+#if SUPPORT_BT
 	delete iBtAccepter;
 	iBtAccepter = NULL;
+#endif
 
 	CancelConnect();
 	delete iTcpConnecter;
 	iTcpConnecter = NULL;
+#if SUPPORT_BT
 	delete iBtConnecter;
 	iBtConnecter = NULL;
+#endif
+
+	// a relay must not write to a closed socket, and the
+	// relaying socket gets told, with KErrCancel
+	if (iRelaySource)
+		{
+		CAoSocket* source = iRelaySource;
+		source->iRelayTarget = NULL;
+		iRelaySource = NULL;
+		source->iRelay->Abort(KErrCancel);
+		}
+	CancelRelay();
+	delete iRelay;
+	iRelay = NULL;
 
 	FreeReadParams();
 	FreeWriteParams();
+	FreeDrainParams();
 	FreeAcceptParams();
 	FreeConnectParams();
+	FreeRelayParams();
 
 	if (IS_SUBSESSION_OPEN(iRSocket))
 		{
@@ -924,12 +1983,14 @@ void CAoSocket::ConstructL()
 	// nothing
 	}
 
+#if SUPPORT_BT
 /** Always takes ownership of the parameters
 	(i.e. will take care of the refcounts).
 */
 void CAoSocket::ConfigBtL(PyObject* aCallback, PyObject* aParam)
 
 	{
+	CheckAttached();
 	if (!iBtAccepter)
 		{
 		AoSocketPanic(EPanicConfigBeforeListen);
@@ -943,6 +2004,7 @@ void CAoSocket::ConfigBtL(PyObject* aCallback, PyObject* aParam)
 
 	iThreadState = PyThreadState_Get();
 
+	ApplyPriority(iBtAccepter);
 	iBtAccepter->ConfigureL();
 	}
 
@@ -968,6 +2030,7 @@ void CAoSocket::GetAvailableBtPortL(TInt& aPort)
 void CAoSocket::ListenBtL(TInt aPort, TInt aQueueSize,
 						  TUint aServiceId, const TDesC& aServiceName)
 	{
+	CheckAttached();
 	if (!IsSocketOpen())
 		{
 		AoSocketPanic(EPanicSocketNotOpen);
@@ -985,11 +2048,13 @@ void CAoSocket::ListenBtL(TInt aPort, TInt aQueueSize,
 
 	iBtAccepter->ListenL(aPort, aQueueSize, aServiceId, aServiceName);
 	}
+#endif
 
 TInt CAoSocket::ListenTcp(const TDesC& aHostName,
 						  TInt aPort,
 						  TInt aQueueSize)
 	{
+	CheckAttached();
 	if (!IsSocketOpen())
 		{
 		AoSocketPanic(EPanicSocketNotOpen);
@@ -1045,6 +2110,35 @@ static PyObject* apn_socket_close(apn_socket_object* self,
 	RETURN_NO_VALUE;
 	}
 
+/** Readies an idle socket to be handed over to another thread,
+	which must then call ``attach`` before using the socket.
+	Raises an exception if there are requests pending.
+*/
+static PyObject* apn_socket_detach(apn_socket_object* self,
+								   PyObject* /*args*/)
+	{
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TInt error = self->iAoSocket->Detach();
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+	RETURN_NO_VALUE;
+	}
+
+/** Makes a detached socket belong to the calling thread, and to
+	whichever loop is run in it.
+*/
+static PyObject* apn_socket_attach(apn_socket_object* self,
+								   PyObject* /*args*/)
+	{
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->Attach();
+	RETURN_NO_VALUE;
+	}
+
 static PyObject* apn_socket_setss(apn_socket_object* self,
 								 PyObject* args)
 	{
@@ -1073,6 +2167,7 @@ static PyObject* apn_socket_setconn(apn_socket_object* self,
 	RETURN_NO_VALUE;
 	}
 
+#if SUPPORT_BT
 static PyObject* apn_socket_openbt(apn_socket_object* self,
 								   PyObject* /*args*/)
 	{
@@ -1081,6 +2176,7 @@ static PyObject* apn_socket_openbt(apn_socket_object* self,
 	TInt error = self->iAoSocket->OpenBt();
 	RETURN_ERROR_OR_PYNONE(error);
 	}
+#endif
 
 static PyObject* apn_socket_opentcp(apn_socket_object* self,
 								   PyObject* /*args*/)
@@ -1100,6 +2196,7 @@ static PyObject* apn_socket_blank(apn_socket_object* self,
 	RETURN_ERROR_OR_PYNONE(error);
 	}
 
+#if SUPPORT_BT
 static PyObject* apn_socket_getbtport(apn_socket_object* self,
 									  PyObject* /*args*/)
 	{
@@ -1126,13 +2223,14 @@ static PyObject* apn_socket_listenbt(apn_socket_object* self,
 		{
 		return NULL;
 		}
-	TPtrC serviceName((TUint16*)b, l);
+	TPtrC serviceName((TText*)b, l);
 
 	AssertNonNull(self);
 	AssertNonNull(self->iAoSocket);
 	TRAPD(error, self->iAoSocket->ListenBtL(port, qSize, sid, serviceName));
 	RETURN_ERROR_OR_PYNONE(error);
 	}
+#endif
 
 static PyObject* apn_socket_listentcp(apn_socket_object* self,
 									  PyObject* args)
@@ -1145,7 +2243,7 @@ static PyObject* apn_socket_listentcp(apn_socket_object* self,
 		{
 		return NULL;
 		}
-	TPtrC hostName((TUint16*)b, l);
+	TPtrC hostName((TText*)b, l);
 
 	AssertNonNull(self);
 	AssertNonNull(self->iAoSocket);
@@ -1163,8 +2261,153 @@ static PyObject* apn_socket_sendeof(apn_socket_object* self,
 	RETURN_ERROR_OR_PYNONE(error);
 	}
 
-static PyObject* apn_socket_configbt(apn_socket_object* self,
-									 PyObject* args)
+/** Sets the active object priority to use for the requests
+	of this socket. Any request already pending is not affected.
+*/
+static PyObject* apn_socket_setpriority(apn_socket_object* self,
+										PyObject* args)
+	{
+	TInt priority;
+	if (!PyArg_ParseTuple(args, "i", &priority))
+		{
+		return NULL;
+		}
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->SetPriority(priority);
+	RETURN_NO_VALUE;
+	}
+
+/** Makes read callbacks get a read-only AoBuffer object wrapping
+	the receive buffer, instead of a string with a copy of the data.
+	The buffer is recycled once the object is released, so hold on
+	to it no longer than required.
+*/
+static PyObject* apn_socket_setzerocopy(apn_socket_object* self,
+										PyObject* args)
+	{
+	TInt zeroCopy;
+	if (!PyArg_ParseTuple(args, "i", &zeroCopy))
+		{
+		return NULL;
+		}
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->SetZeroCopy(zeroCopy != 0);
+	RETURN_NO_VALUE;
+	}
+
+/** Once ``high`` bytes or more are queued, ``write_data`` and
+	``write_batch`` return true, until the queue drains to ``low``
+	bytes, at which point the optional callback gets called with the
+	code of the write that drained it. A ``high`` of zero turns this
+	off.
+*/
+static PyObject* apn_socket_setwritewatermarks(apn_socket_object* self,
+											   PyObject* args)
+	{
+	TInt high;
+	TInt low;
+	PyObject* cb = Py_None;
+	PyObject* param = Py_None;
+	if (!PyArg_ParseTuple(args, "ii|OO", &high, &low, &cb, &param))
+		{
+		return NULL;
+		}
+	if (high < 0 || low < 0 || (high > 0 && low >= high))
+		{
+		PyErr_SetString(PyExc_ValueError, "invalid watermarks");
+		return NULL;
+		}
+	if (cb != Py_None && !PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->SetWriteWatermarks(high, low,
+										(cb != Py_None) ? cb : NULL,
+										(cb != Py_None) ? param : NULL);
+	RETURN_NO_VALUE;
+	}
+
+/** Makes ``write_data`` send straight from the memory of the object
+	given, which may be anything supporting the buffer interface,
+	instead of from a copy. The object is held on to until the
+	callback, and must not be modified meanwhile.
+*/
+static PyObject* apn_socket_setzerocopywrite(apn_socket_object* self,
+											 PyObject* args)
+	{
+	TInt zeroCopy;
+	if (!PyArg_ParseTuple(args, "i", &zeroCopy))
+		{
+		return NULL;
+		}
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->SetZeroCopyWrite(zeroCopy != 0);
+	RETURN_NO_VALUE;
+	}
+
+/** With positive bounds, ``read_some`` and ``start_reading``
+	receive as much as has recently been arriving at a time, starting
+	from ``min_size`` and never more than ``max_size``, nor more than
+	the size given to them. With zero bounds, they receive as much as
+	they are given, as by default.
+*/
+static PyObject* apn_socket_setadaptiveread(apn_socket_object* self,
+											PyObject* args)
+	{
+	TInt minSize;
+	TInt maxSize;
+	if (!PyArg_ParseTuple(args, "ii", &minSize, &maxSize))
+		{
+		return NULL;
+		}
+	if (minSize < 0 || maxSize < minSize ||
+		(minSize == 0 && maxSize != 0))
+		{
+		PyErr_SetString(PyExc_ValueError, "bad bounds");
+		return NULL;
+		}
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->SetAdaptiveRead(minSize, maxSize);
+	RETURN_NO_VALUE;
+	}
+
+/** Has ``start_reading`` hold back what arrives until at least
+	``watermark`` bytes have accumulated (or the chunk size has been
+	reached), or ``budget`` microseconds have passed since the first
+	of them arrived, and then deliver it all in one callback. The
+	budget gets rounded up to the resolution of the timers. A zero
+	watermark turns coalescing off, as by default.
+*/
+static PyObject* apn_socket_setreadcoalescing(apn_socket_object* self,
+											  PyObject* args)
+	{
+	TInt bytes;
+	TInt micros;
+	if (!PyArg_ParseTuple(args, "ii", &bytes, &micros))
+		{
+		return NULL;
+		}
+	if (bytes < 0 || micros < 0 || (bytes > 0 && micros == 0))
+		{
+		PyErr_SetString(PyExc_ValueError, "bad watermark or budget");
+		return NULL;
+		}
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->SetReadCoalescing(bytes, micros);
+	RETURN_NO_VALUE;
+	}
+
+#if SUPPORT_BT
+static PyObject* apn_socket_configbt(apn_socket_object* self,
+									 PyObject* args)
 	{
 	PyObject* cb;
 	PyObject* param;
@@ -1206,7 +2449,7 @@ static PyObject* apn_socket_connectbt(apn_socket_object* self,
 		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
 		return NULL;
 		}
-	TPtrC host((TUint16*)b, l);
+	TPtrC host((TText*)b, l);
 
 	AssertNonNull(self);
 	AssertNonNull(self->iAoSocket);
@@ -1218,6 +2461,7 @@ static PyObject* apn_socket_connectbt(apn_socket_object* self,
 
 	RETURN_NO_VALUE;
 	}
+#endif
 
 static PyObject* apn_socket_connecttcp(apn_socket_object* self,
 									   PyObject* args)
@@ -1227,7 +2471,9 @@ static PyObject* apn_socket_connecttcp(apn_socket_object* self,
 	TInt port;
 	PyObject* cb;
 	PyObject* param;
-	if (!PyArg_ParseTuple(args, "u#iOO", &b, &l, &port, &cb, &param))
+	TInt timeout = 0;
+	if (!PyArg_ParseTuple(args, "u#iOO|i", &b, &l, &port, &cb, &param,
+						  &timeout))
 		{
 		return NULL;
 		}
@@ -1236,11 +2482,12 @@ static PyObject* apn_socket_connecttcp(apn_socket_object* self,
 		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
 		return NULL;
 		}
-	TPtrC host((TUint16*)b, l);
+	TPtrC host((TText*)b, l);
 
 	AssertNonNull(self);
 	AssertNonNull(self->iAoSocket);
-	TRAPD(error, self->iAoSocket->ConnectTcpL(host, port, cb, param));
+	TRAPD(error, self->iAoSocket->ConnectTcpL(host, port, cb, param,
+											  timeout));
 	if (error)
 		{
 		return SPyErr_SetFromSymbianOSErr(error);
@@ -1254,11 +2501,11 @@ static PyObject* apn_socket_connecttcp(apn_socket_object* self,
 static PyObject* apn_socket_write(apn_socket_object* self,
 								  PyObject* args)
 	{
-	char* b;
-	int l;
+	PyObject* obj;
 	PyObject* cb;
 	PyObject* param;
-	if (!PyArg_ParseTuple(args, "s#OO", &b, &l, &cb, &param))
+	TInt timeout = 0;
+	if (!PyArg_ParseTuple(args, "OOO|i", &obj, &cb, &param, &timeout))
 		{
 		return NULL;
 		}
@@ -1267,17 +2514,42 @@ static PyObject* apn_socket_write(apn_socket_object* self,
 		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
 		return NULL;
 		}
-	TPtrC8 data((TUint8*)b, l);
-
 	AssertNonNull(self);
 	AssertNonNull(self->iAoSocket);
-	TRAPD(error, self->iAoSocket->WriteDataL(data, cb, param));
+
+	// Unicode objects get encoded, which takes a copy anyway.
+	if (self->iAoSocket->IsZeroCopyWrite() && !PyUnicode_Check(obj))
+		{
+		TPinnedBuffer buffer;
+		if (!buffer.Pin(obj, EFalse))
+			{
+			return NULL;
+			}
+		TRAPD(error, self->iAoSocket->WritePinnedL(buffer, cb, param,
+												   timeout));
+		if (error)
+			{
+			buffer.Release();
+			return SPyErr_SetFromSymbianOSErr(error);
+			}
+		return Py_BuildValue("i", self->iAoSocket->IsWriteThrottled());
+		}
+
+	char* b;
+	int l;
+	if (!PyArg_ParseTuple(args, "s#OO|i", &b, &l, &cb, &param, &timeout))
+		{
+		return NULL;
+		}
+	TPtrC8 data((TUint8*)b, l);
+
+	TRAPD(error, self->iAoSocket->WriteDataL(data, cb, param, timeout));
 	if (error)
 		{
 		return SPyErr_SetFromSymbianOSErr(error);
 		}
 
-	RETURN_NO_VALUE;
+	return Py_BuildValue("i", self->iAoSocket->IsWriteThrottled());
 	}
 
 // takes max size and callback function and its parameter
@@ -1287,8 +2559,42 @@ static PyObject* apn_socket_readsome(apn_socket_object* self,
 	int maxSize;
 	PyObject* cb;
 	PyObject* param;
+	TInt timeout = 0;
 	// Note that PyArg_ParseTuple does not increase the refcount
 	// for "O" parameters.
+	if (!PyArg_ParseTuple(args, "iOO|i", &maxSize, &cb, &param, &timeout))
+		{
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TRAPD(error, self->iAoSocket->ReadSomeL(maxSize, cb, param, timeout));
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+
+	RETURN_NO_VALUE;
+	}
+
+/** Starts reading continuously, delivering each chunk of at most
+	the given size to the callback, as for ``read_some``, with the
+	next request already made. Reading goes on until ``stop_reading``
+	is called, or until an error (including end of stream) is
+	delivered. No other read may be made in the meantime.
+*/
+static PyObject* apn_socket_startreading(apn_socket_object* self,
+										 PyObject* args)
+	{
+	int maxSize;
+	PyObject* cb;
+	PyObject* param;
 	if (!PyArg_ParseTuple(args, "iOO", &maxSize, &cb, &param))
 		{
 		return NULL;
@@ -1301,7 +2607,189 @@ static PyObject* apn_socket_readsome(apn_socket_object* self,
 
 	AssertNonNull(self);
 	AssertNonNull(self->iAoSocket);
-	TRAPD(error, self->iAoSocket->ReadSomeL(maxSize, cb, param));
+	TRAPD(error, self->iAoSocket->StartReadingL(maxSize, cb, param));
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+
+	RETURN_NO_VALUE;
+	}
+
+/** Reads up to and including the next occurrence of the given
+	delimiter, delivering the data to the callback as ``read_some``
+	does. If the delimiter does not occur within ``max_len`` bytes,
+	KErrOverflow is delivered instead, with the data left unread.
+	Any data received beyond the delimiter is kept for the next read,
+	of whichever kind.
+*/
+static PyObject* apn_socket_readuntil(apn_socket_object* self,
+									  PyObject* args)
+	{
+	char* delim;
+	int delimLen;
+	int maxLen;
+	PyObject* cb;
+	PyObject* param;
+	TInt timeout = 0;
+	if (!PyArg_ParseTuple(args, "s#iOO|i", &delim, &delimLen,
+						  &maxLen, &cb, &param, &timeout))
+		{
+		return NULL;
+		}
+	if (delimLen < 1 || delimLen > CSocketReader::KMaxDelimiter)
+		{
+		PyErr_SetString(PyExc_ValueError, "bad delimiter length");
+		return NULL;
+		}
+	if (maxLen < delimLen)
+		{
+		PyErr_SetString(PyExc_ValueError, "max_len shorter than delimiter");
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	TPtrC8 delimDes((TUint8*)delim, delimLen);
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TRAPD(error, self->iAoSocket->ReadUntilL(delimDes, maxLen,
+											 cb, param, timeout));
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+
+	RETURN_NO_VALUE;
+	}
+
+/** Reads a frame prefixed with its length, in the given format
+	(one of the EFrame constants), and delivers its payload to the
+	callback as ``read_some`` does. A length beyond ``max_size``
+	results in KErrOverflow, and a malformed varint in KErrCorrupt,
+	with the data left unread. Any frames received along with the
+	requested one are kept, and if read from within the callback, get
+	delivered one after the other without waiting for the scheduler.
+*/
+static PyObject* apn_socket_readframe(apn_socket_object* self,
+									  PyObject* args)
+	{
+	int header;
+	int maxSize;
+	PyObject* cb;
+	PyObject* param;
+	TInt timeout = 0;
+	if (!PyArg_ParseTuple(args, "iiOO|i", &header, &maxSize,
+						  &cb, &param, &timeout))
+		{
+		return NULL;
+		}
+	if (header < 0 || header >= CSocketReader::EFrameHeaderCount)
+		{
+		PyErr_SetString(PyExc_ValueError, "unknown frame header");
+		return NULL;
+		}
+	if (maxSize < 0 || maxSize > KMaxTInt - CSocketReader::KMaxFrameHeader)
+		{
+		PyErr_SetString(PyExc_ValueError, "max_size out of range");
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TRAPD(error, self->iAoSocket->ReadFrameL(
+			  static_cast<CSocketReader::TFrameHeader>(header),
+			  maxSize, cb, param, timeout));
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+
+	RETURN_NO_VALUE;
+	}
+
+static PyObject* apn_socket_stopreading(apn_socket_object* self,
+										PyObject* /*args*/)
+	{
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->StopReading();
+	RETURN_NO_VALUE;
+	}
+
+// Checks that aOffset and aMaxSize are within the buffer, with -1
+// for aMaxSize meaning the rest of it. Returns EFalse with an
+// exception set if they are not.
+static TBool CheckBufferRange(const TPinnedBuffer& aBuffer,
+							  TInt aOffset, TInt& aMaxSize)
+	{
+	if (aOffset < 0 || aOffset > aBuffer.Length())
+		{
+		PyErr_SetString(PyExc_ValueError, "offset out of range");
+		return EFalse;
+		}
+	if (aMaxSize == -1)
+		{
+		aMaxSize = aBuffer.Length() - aOffset;
+		}
+	if (aMaxSize < 0 || aMaxSize > aBuffer.Length() - aOffset)
+		{
+		PyErr_SetString(PyExc_ValueError, "size out of range");
+		return EFalse;
+		}
+	return ETrue;
+	}
+
+/** Receives at most ``max_size`` bytes (by default as many as fit)
+	into a writable buffer object, such as a bytearray, starting at
+	``offset``, and gives the callback the number of bytes received
+	in place of the data. The buffer must not be resized until then;
+	where the new buffer interface is supported, it cannot be.
+*/
+static PyObject* apn_socket_readinto(apn_socket_object* self,
+									 PyObject* args)
+	{
+	PyObject* buffer;
+	int offset;
+	int maxSize;
+	PyObject* cb;
+	PyObject* param;
+	TInt timeout = 0;
+	if (!PyArg_ParseTuple(args, "OiiOO|i", &buffer, &offset, &maxSize,
+						  &cb, &param, &timeout))
+		{
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	TPinnedBuffer pinned;
+	if (!pinned.Pin(buffer, ETrue))
+		{
+		return NULL;
+		}
+	if (!CheckBufferRange(pinned, offset, maxSize))
+		{
+		pinned.Release();
+		return NULL;
+		}
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TRAPD(error, self->iAoSocket->ReadIntoL(pinned, offset, maxSize,
+											cb, param, timeout));
+	// unless taken over
+	pinned.Release();
 	if (error)
 		{
 		return SPyErr_SetFromSymbianOSErr(error);
@@ -1317,7 +2805,8 @@ static PyObject* apn_socket_readexact(apn_socket_object* self,
 	int size;
 	PyObject* cb;
 	PyObject* param;
-	if (!PyArg_ParseTuple(args, "iOO", &size, &cb, &param))
+	TInt timeout = 0;
+	if (!PyArg_ParseTuple(args, "iOO|i", &size, &cb, &param, &timeout))
 		{
 		return NULL;
 		}
@@ -1329,7 +2818,7 @@ static PyObject* apn_socket_readexact(apn_socket_object* self,
 
 	AssertNonNull(self);
 	AssertNonNull(self->iAoSocket);
-	TRAPD(error, self->iAoSocket->ReadExactL(size, cb, param));
+	TRAPD(error, self->iAoSocket->ReadExactL(size, cb, param, timeout));
 	if (error)
 		{
 		return SPyErr_SetFromSymbianOSErr(error);
@@ -1362,6 +2851,227 @@ static PyObject* apn_socket_accept(apn_socket_object* self,
 	RETURN_ERROR_OR_PYNONE(error);
 	}
 
+/** Relays everything received on this socket to the other one,
+	without the data going through Python, until the end of the
+	stream or an error on either side. Only then is the callback
+	called, with the error code and the number of bytes relayed.
+	Neither reading from this socket nor writing to the other one is
+	possible meanwhile. For a two-way relay, relay in both directions.
+	Closing the other socket completes the relay with KErrCancel.
+*/
+static PyObject* apn_socket_relayto(apn_socket_object* self,
+									PyObject* args)
+	{
+	PyObject* other;
+	PyObject* cb;
+	PyObject* param;
+	if (!PyArg_ParseTuple(args, "OOO", &other, &cb, &param))
+		{
+		return NULL;
+		}
+	if (other->ob_type != self->ob_type)
+		{
+		PyErr_SetString(PyExc_TypeError, "can only relay to an AoSocket");
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	apn_socket_object* to = reinterpret_cast<apn_socket_object*>(other);
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	AssertNonNull(to->iAoSocket);
+	TRAPD(error, self->iAoSocket->RelayToL(*to->iAoSocket, cb, param));
+	RETURN_ERROR_OR_PYNONE(error);
+	}
+
+/** Saves what is received into a file, calling back with the byte
+	count, both for progress reports and upon completion.
+*/
+static PyObject* apn_socket_readtofile(apn_socket_object* self,
+									   PyObject* args)
+	{
+	char* b;
+	int l;
+	TInt offset;
+	TInt length;
+	PyObject* cb;
+	PyObject* param;
+	TInt interval = 0;
+	if (!PyArg_ParseTuple(args, "u#iiOO|i", &b, &l, &offset, &length,
+						  &cb, &param, &interval))
+		{
+		return NULL;
+		}
+	if (offset < 0 || interval < 0)
+		{
+		PyErr_SetString(PyExc_ValueError, "negative offset or interval");
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	TPtrC path((TText*)b, l);
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TRAPD(error, self->iAoSocket->ReadToFileL(path, offset, length,
+											  interval, cb, param));
+	RETURN_ERROR_OR_PYNONE(error);
+	}
+
+static void ReleaseBuffers(TPinnedBuffer* aBuffers, TInt aCount)
+	{
+	for (TInt i = 0; i < aCount; i++)
+		{
+		aBuffers[i].Release();
+		}
+	delete[] aBuffers;
+	}
+
+/** Sends every object of a sequence of objects supporting the buffer
+	interface, from their own memory, with a single callback once all
+	have been sent.
+*/
+static PyObject* apn_socket_writebatch(apn_socket_object* self,
+									   PyObject* args)
+	{
+	PyObject* seq;
+	PyObject* cb;
+	PyObject* param;
+	TInt timeout = 0;
+	if (!PyArg_ParseTuple(args, "OOO|i", &seq, &cb, &param, &timeout))
+		{
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	PyObject* fast = PySequence_Fast(seq, "expected a sequence");
+	if (!fast)
+		{
+		return NULL;
+		}
+	TInt count = PySequence_Fast_GET_SIZE(fast);
+	TPinnedBuffer* buffers = NULL;
+	TRAPD(error, buffers = new (ELeave) TPinnedBuffer[count ? count : 1]);
+	if (error)
+		{
+		Py_DECREF(fast);
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+	for (TInt i = 0; i < count; i++)
+		{
+		PyObject* item = PySequence_Fast_GET_ITEM(fast, i);
+		TBool pinned = EFalse;
+		if (PyUnicode_Check(item))
+			{
+			// its buffer would be the internal representation
+			PyErr_SetString(PyExc_TypeError, "cannot send unicode as is");
+			}
+		else
+			{
+			pinned = buffers[i].Pin(item, EFalse);
+			}
+		if (!pinned)
+			{
+			ReleaseBuffers(buffers, i);
+			Py_DECREF(fast);
+			return NULL;
+			}
+		}
+	Py_DECREF(fast);
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TRAP(error, self->iAoSocket->WriteBatchL(buffers, count, cb, param,
+											 timeout));
+	if (error)
+		{
+		ReleaseBuffers(buffers, count);
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+	return Py_BuildValue("i", self->iAoSocket->IsWriteThrottled());
+	}
+
+/** Sends a file, given by its path or by a file descriptor, calling
+	back once with the number of bytes sent.
+*/
+static PyObject* apn_socket_writefile(apn_socket_object* self,
+									  PyObject* args)
+	{
+	PyObject* file;
+	TInt offset;
+	TInt count;
+	PyObject* cb;
+	PyObject* param;
+	if (!PyArg_ParseTuple(args, "OiiOO", &file, &offset, &count,
+						  &cb, &param))
+		{
+		return NULL;
+		}
+	if (offset < 0)
+		{
+		PyErr_SetString(PyExc_ValueError, "negative offset");
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	TPtrC path;
+	TInt fd = -1;
+	if (PyInt_Check(file))
+		{
+		fd = PyInt_AsLong(file);
+		if (fd < 0)
+			{
+			PyErr_SetString(PyExc_ValueError, "negative file descriptor");
+			return NULL;
+			}
+		}
+	else if (PyUnicode_Check(file))
+		{
+		char* b;
+		int l;
+		if (!PyArg_ParseTuple(args, "u#iiOO", &b, &l, &offset, &count,
+							  &cb, &param))
+			{
+			return NULL;
+			}
+		path.Set((TText*)b, l);
+		}
+	else
+		{
+		PyErr_SetString(PyExc_TypeError,
+						"expected a unicode path or a file descriptor");
+		return NULL;
+		}
+
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	TRAPD(error, self->iAoSocket->WriteFileL(path, fd, offset, count,
+											 cb, param));
+	RETURN_ERROR_OR_PYNONE(error);
+	}
+
+static PyObject* apn_socket_cancelrelay(apn_socket_object* self,
+										PyObject* /*args*/)
+	{
+	AssertNonNull(self);
+	AssertNonNull(self->iAoSocket);
+	self->iAoSocket->CancelRelay();
+	RETURN_NO_VALUE;
+	}
+
 static PyObject* apn_socket_cancelwrite(apn_socket_object* self,
 										PyObject* /*args*/)
 	{
@@ -1416,6 +3126,51 @@ static PyObject* apn_socket_syncwrite(apn_socket_object* self,
 	RETURN_ERROR_OR_PYNONE(error);
 	}
 
+/** Like sync_read, but receives into a writable buffer object at
+	the given offset, returning the number of bytes received, or zero
+	at the end of the stream.
+*/
+static PyObject* apn_socket_syncreadinto(apn_socket_object* self,
+										 PyObject* args)
+	{
+	AssertNonNull(self);
+
+	PyObject* buffer;
+	int offset = 0;
+	int maxSize = -1;
+	if (!PyArg_ParseTuple(args, "O|ii", &buffer, &offset, &maxSize))
+		{
+		return NULL;
+		}
+	TPinnedBuffer pinned;
+	if (!pinned.Pin(buffer, ETrue))
+		{
+		return NULL;
+		}
+	if (!CheckBufferRange(pinned, offset, maxSize))
+		{
+		pinned.Release();
+		return NULL;
+		}
+	TPtr8 ptr(pinned.Ptr() + offset, 0, maxSize);
+
+	AssertNonNull(self->iAoSocket);
+	TInt error = self->iAoSocket->ReadSync(ptr);
+	pinned.Release();
+	if (error == KErrNone)
+		{
+		return Py_BuildValue("i", ptr.Length());
+		}
+	else if (error == KErrEof)
+		{
+		return Py_BuildValue("i", 0);
+		}
+	else // some other error
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+	}
+
 static PyObject* apn_socket_syncread(apn_socket_object* self,
 									 PyObject* args)
 	{
@@ -1464,21 +3219,52 @@ const static PyMethodDef apn_socket_methods[] =
 	{"set_connection", (PyCFunction)apn_socket_setconn, METH_VARARGS},
 	{"blank", (PyCFunction)apn_socket_blank, METH_NOARGS},
 	{"open_tcp", (PyCFunction)apn_socket_opentcp, METH_NOARGS},
+#if SUPPORT_BT
 	{"open_bt", (PyCFunction)apn_socket_openbt, METH_NOARGS},
+#endif
 	{"close", (PyCFunction)apn_socket_close, METH_NOARGS},
 	{"listen_tcp", (PyCFunction)apn_socket_listentcp, METH_VARARGS},
+#if SUPPORT_BT
 	{"listen_bt", (PyCFunction)apn_socket_listenbt, METH_VARARGS},
+#endif
 	{"send_eof", (PyCFunction)apn_socket_sendeof, METH_NOARGS},
+	{"set_priority", (PyCFunction)apn_socket_setpriority, METH_VARARGS},
+	{"set_zero_copy", (PyCFunction)apn_socket_setzerocopy, METH_VARARGS},
+	{"set_zero_copy_write", (PyCFunction)apn_socket_setzerocopywrite,
+	 METH_VARARGS},
+	{"set_write_watermarks", (PyCFunction)apn_socket_setwritewatermarks,
+	 METH_VARARGS},
+	{"set_adaptive_read", (PyCFunction)apn_socket_setadaptiveread,
+	 METH_VARARGS},
+	{"set_read_coalescing", (PyCFunction)apn_socket_setreadcoalescing,
+	 METH_VARARGS},
+	{"detach", (PyCFunction)apn_socket_detach, METH_NOARGS},
+	{"attach", (PyCFunction)apn_socket_attach, METH_NOARGS},
+#if SUPPORT_BT
 	{"get_available_bt_port", (PyCFunction)apn_socket_getbtport, METH_NOARGS},
+#endif
 
 	//// asynchronous requests
 	{"write_data", (PyCFunction)apn_socket_write, METH_VARARGS},
+	{"write_batch", (PyCFunction)apn_socket_writebatch, METH_VARARGS},
+	{"write_file", (PyCFunction)apn_socket_writefile, METH_VARARGS},
 	{"read_some", (PyCFunction)apn_socket_readsome, METH_VARARGS},
+	{"read_until", (PyCFunction)apn_socket_readuntil, METH_VARARGS},
+	{"read_frame", (PyCFunction)apn_socket_readframe, METH_VARARGS},
+	{"relay_to", (PyCFunction)apn_socket_relayto, METH_VARARGS},
 	{"read_exact", (PyCFunction)apn_socket_readexact, METH_VARARGS},
+	{"read_into", (PyCFunction)apn_socket_readinto, METH_VARARGS},
+	{"read_to_file", (PyCFunction)apn_socket_readtofile, METH_VARARGS},
+	{"start_reading", (PyCFunction)apn_socket_startreading, METH_VARARGS},
+	{"stop_reading", (PyCFunction)apn_socket_stopreading, METH_NOARGS},
 	{"accept_client", (PyCFunction)apn_socket_accept, METH_VARARGS},
+#if SUPPORT_BT
 	{"connect_bt", (PyCFunction)apn_socket_connectbt, METH_VARARGS},
+#endif
 	{"connect_tcp", (PyCFunction)apn_socket_connecttcp, METH_VARARGS},
+#if SUPPORT_BT
 	{"config_bt", (PyCFunction)apn_socket_configbt, METH_VARARGS},
+#endif
 
 	//// asynchronous cancellation requests
 	{"cancel_write", (PyCFunction)apn_socket_cancelwrite, METH_NOARGS},
@@ -1486,10 +3272,12 @@ const static PyMethodDef apn_socket_methods[] =
 	{"cancel_accept", (PyCFunction)apn_socket_cancelaccept, METH_NOARGS},
 	{"cancel_config", (PyCFunction)apn_socket_cancelaccept, METH_NOARGS},
 	{"cancel_connect", (PyCFunction)apn_socket_cancelconnect, METH_NOARGS},
+	{"cancel_relay", (PyCFunction)apn_socket_cancelrelay, METH_NOARGS},
 
 	//// synchronous reads and writes
 	{"sync_write", (PyCFunction)apn_socket_syncwrite, METH_VARARGS},
 	{"sync_read", (PyCFunction)apn_socket_syncread, METH_VARARGS},
+	{"sync_read_into", (PyCFunction)apn_socket_syncreadinto, METH_VARARGS},
 
 	{NULL, NULL} // sentinel
 	};
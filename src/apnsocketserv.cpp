@@ -36,6 +36,7 @@
 #include "settings.h"
 #include "panic.h"
 #include "apnsocketserv.h"
+#include "bufferpool.h"
 
 // --------------------------------------------------------------------
 // object structure...
@@ -46,6 +47,7 @@ typedef struct
 	RSocketServ iSocketServ;
 	DEF_SESSION_OPEN(iSocketServ);
 	CTC_DEF_HANDLE(ctc);
+	TInt iPoolSize;
 	} apn_socketserv_object;
 
 RSocketServ& ToSocketServ(PyObject* aObject)
@@ -54,6 +56,12 @@ RSocketServ& ToSocketServ(PyObject* aObject)
 	return (reinterpret_cast<apn_socketserv_object*>(aObject))->iSocketServ;
 	}
 
+TInt SocketServPoolSize(PyObject* aObject)
+	{
+	AssertNonNull(aObject);
+	return (reinterpret_cast<apn_socketserv_object*>(aObject))->iPoolSize;
+	}
+
 // --------------------------------------------------------------------
 // instance methods...
 
@@ -74,6 +82,54 @@ static PyObject* apn_socketserv_connect(apn_socketserv_object* self,
 	RETURN_NO_VALUE;
 	}
 
+/** Shares the session with the other threads of the process, which
+	is required for handing sockets over to the loops of other
+	threads, with AoSocket.detach() and attach().
+*/
+static PyObject* apn_socketserv_share(apn_socketserv_object* self,
+									  PyObject* /*args*/)
+	{
+	AssertNonNull(self);
+	if (!IS_SESSION_OPEN(self->iSocketServ))
+		{
+		AoSocketPanic(EPanicSessionDoesNotExist);
+		}
+	CTC_CHECK(self->ctc);
+	TInt err = self->iSocketServ.ShareAuto();
+	if (err != KErrNone)
+		{
+		return SPyErr_SetFromSymbianOSErr(err);
+		}
+	RETURN_NO_VALUE;
+	}
+
+/** Sets how many idle receive buffers of each size class the
+	sockets of this session let the buffer pool of their thread keep
+	for reuse. Zero disables pooling for them. Any excess idle
+	buffers in the pool of the calling thread are freed right away.
+*/
+static PyObject* apn_socketserv_setpoolsize(apn_socketserv_object* self,
+											PyObject* args)
+	{
+	TInt size;
+	if (!PyArg_ParseTuple(args, "i", &size))
+		{
+		return NULL;
+		}
+	if (size < 0)
+		{
+		PyErr_SetString(PyExc_ValueError, "negative pool size");
+		return NULL;
+		}
+	self->iPoolSize = size;
+	CBufferPool* pool = CBufferPool::Current();
+	if (pool)
+		{
+		pool->Trim(size);
+		}
+	RETURN_NO_VALUE;
+	}
+
 /** Closes the socket server session.
 	Does nothing if there is no open session.
 */
@@ -93,6 +149,8 @@ static PyObject* apn_socketserv_close(apn_socketserv_object* self,
 const static PyMethodDef apn_socketserv_methods[] =
 	{
 	{"connect", (PyCFunction)apn_socketserv_connect, METH_NOARGS},
+	{"share", (PyCFunction)apn_socketserv_share, METH_NOARGS},
+	{"set_pool_size", (PyCFunction)apn_socketserv_setpoolsize, METH_VARARGS},
 	{"close", (PyCFunction)apn_socketserv_close, METH_NOARGS},
 	{NULL, NULL} // sentinel
 	};
@@ -170,6 +228,7 @@ static apn_socketserv_object* NewSocketServObject()
 		return NULL;
 		}
 	SET_SESSION_CLOSED(newSocketServ->iSocketServ);
+	newSocketServ->iPoolSize = CBufferPool::KDefaultKeep;
 	return newSocketServ;
 	}
 
@@ -38,6 +38,10 @@ SOFTWARE.
 
 RSocketServ& ToSocketServ(PyObject* aObject);
 
+// the number of idle receive buffers per size class that sockets
+// using the session let the buffer pool of their thread keep
+TInt SocketServPoolSize(PyObject* aObject);
+
 TInt apn_socketserv_ConstructType();
 
 PyObject* apn_socketserv_new(PyObject* /*self*/, PyObject* /*args*/);
@@ -0,0 +1,381 @@
+// -*- symbian-c++ -*-
+
+//
+// apntimer.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// Implements one-shot timers, all of which share the timing
+// wheel of the thread.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "local_epoc_py_utils.h"
+#include "settings.h"
+#include "panic.h"
+#include "pydispatch.h"
+#include "timerwheel.h"
+#include <e32base.h>
+
+// --------------------------------------------------------------------
+// CAoTimer...
+
+/** A one-shot timer, of which there may be tens of thousands.
+	Rather than being active objects of their own, all the timers of
+	a thread are queued in the timing wheel of the thread, which
+	calls us back when we expire.
+*/
+NONSHARABLE_CLASS(CAoTimer) : public CBase, public MWheelTimerObserver
+	{
+public:
+	static CAoTimer* NewL();
+	~CAoTimer();
+	void After(TInt aMilliSeconds, PyObject* aCallback, PyObject* aParam);
+	// returns KErrNotReady if there is no callback to call
+	TInt Reschedule(TInt aMilliSeconds);
+	void Cancel();
+private: // MWheelTimerObserver
+	void TimerExpired(TWheelTimer& aTimer);
+private:
+	CAoTimer(CTimerWheel& aWheel);
+	void Free();
+private:
+	CTimerWheel& iWheel;
+	TWheelTimer iTimer;
+	PyObject* iCallback;
+	PyObject* iParam;
+	// for acquiring the interpreter lock, as in CAoImmediate
+	PyThreadState* iThreadState;
+
+	CTC_DEF_HANDLE(ctc);
+	};
+
+void CAoTimer::Free()
+	{
+	if (iCallback)
+		{
+		Py_DECREF(iCallback);
+		iCallback = NULL;
+		}
+	if (iParam)
+		{
+		Py_DECREF(iParam);
+		iParam = NULL;
+		}
+	}
+
+CAoTimer* CAoTimer::NewL()
+	{
+	return new (ELeave) CAoTimer(*CTimerWheel::InstanceL());
+	}
+
+CAoTimer::CAoTimer(CTimerWheel& aWheel) :
+	iWheel(aWheel), iTimer(*this)
+	{
+	CTC_STORE_HANDLE(ctc);
+	}
+
+CAoTimer::~CAoTimer()
+	{
+	CTC_CHECK(ctc);
+	iWheel.Remove(iTimer);
+	Free();
+	}
+
+void CAoTimer::After(TInt aMilliSeconds, PyObject* aCallback,
+					 PyObject* aParam)
+	{
+	CTC_CHECK(ctc);
+	if (iTimer.IsQueued())
+		{
+		AoSocketPanic(EPanicRequestAlreadyPending);
+		}
+
+	Free();
+	AssertNonNull(aCallback);
+	AssertNonNull(aParam);
+	iCallback = aCallback;
+	Py_INCREF(aCallback);
+	iParam = aParam;
+	Py_INCREF(aParam);
+
+	// We have the interpreter lock here, so it is okay to do this.
+	iThreadState = PyThreadState_Get();
+
+	iWheel.Add(iTimer, aMilliSeconds);
+	}
+
+/** Requeues the timer to expire aMilliSeconds from now, with the
+	callback of the last After(), whether or not the timer is still
+	pending.
+*/
+TInt CAoTimer::Reschedule(TInt aMilliSeconds)
+	{
+	CTC_CHECK(ctc);
+	if (!iCallback)
+		{
+		return KErrNotReady;
+		}
+	iThreadState = PyThreadState_Get();
+	iWheel.Add(iTimer, aMilliSeconds);
+	return KErrNone;
+	}
+
+void CAoTimer::Cancel()
+	{
+	CTC_CHECK(ctc);
+	iWheel.Remove(iTimer);
+	}
+
+/** Called from the RunL() of the wheel, so we do not have the
+	interpreter lock, and must acquire it before accessing Python.
+*/
+void CAoTimer::TimerExpired(TWheelTimer& /*aTimer*/)
+	{
+	AssertNonNull(iCallback);
+	AssertNonNull(iParam);
+
+	PyDispatchEnter(iThreadState);
+
+	// the callback may delete this object, or reschedule it
+	// with a different callback, so hold on to what we call
+	PyObject* callback = iCallback;
+	PyObject* param = iParam;
+	Py_INCREF(callback);
+	Py_INCREF(param);
+
+	PyObject* arg = Py_BuildValue("(iO)", KErrNone, param);
+	if (arg)
+		{
+		PyObject* result = PyObject_CallObject(callback, arg);
+		Py_DECREF(arg);
+		Py_XDECREF(result);
+		if (!result)
+			{
+			// Callbacks are not supposed to throw exceptions.
+			// Make sure that the error get noticed.
+			PyErr_Clear();
+			AoSocketPanic(EPanicExceptionInCallback);
+			}
+		}
+	else
+		{
+		PyErr_Clear();
+		AoSocketPanic(EPanicOutOfMemory);
+		}
+
+	Py_DECREF(callback);
+	Py_DECREF(param);
+
+	PyDispatchLeave();
+	}
+
+// --------------------------------------------------------------------
+// object structure...
+
+// we store the state we require in a Python object
+typedef struct
+	{
+	PyObject_VAR_HEAD;
+	CAoTimer* iTimer;
+	} apn_timer_object;
+
+// --------------------------------------------------------------------
+// instance methods...
+
+static PyObject* apn_timer_after(apn_timer_object* self,
+								 PyObject* args)
+	{
+	TInt ms;
+	PyObject* cb;
+	PyObject* param;
+	if (!PyArg_ParseTuple(args, "iOO", &ms, &cb, &param))
+		{
+		return NULL;
+		}
+	if (!PyCallable_Check(cb))
+		{
+		PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+		return NULL;
+		}
+	if (ms < 0)
+		{
+		PyErr_SetString(PyExc_ValueError, "negative interval");
+		return NULL;
+		}
+
+	if (!self->iTimer)
+		{
+		AoSocketPanic(EPanicUseBeforeInit);
+		}
+	self->iTimer->After(ms, cb, param);
+
+	RETURN_NO_VALUE;
+	}
+
+static PyObject* apn_timer_reschedule(apn_timer_object* self,
+									  PyObject* args)
+	{
+	TInt ms;
+	if (!PyArg_ParseTuple(args, "i", &ms))
+		{
+		return NULL;
+		}
+	if (ms < 0)
+		{
+		PyErr_SetString(PyExc_ValueError, "negative interval");
+		return NULL;
+		}
+
+	if (!self->iTimer)
+		{
+		AoSocketPanic(EPanicUseBeforeInit);
+		}
+	TInt error = self->iTimer->Reschedule(ms);
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+
+	RETURN_NO_VALUE;
+	}
+
+static PyObject* apn_timer_cancel(apn_timer_object* self,
+								  PyObject* /*args*/)
+	{
+	AssertNonNull(self->iTimer);
+	self->iTimer->Cancel();
+	RETURN_NO_VALUE;
+	}
+
+/** Creates the Symbian object (the Python object has already
+	been created). This must be done in the thread that will
+	be using the object, as the timer goes to the timing wheel
+	of that thread.
+*/
+static PyObject* apn_timer_open(apn_timer_object* self,
+								PyObject* /*args*/)
+	{
+	AssertNull(self->iTimer);
+	TRAPD(error, self->iTimer = CAoTimer::NewL());
+	if (error)
+		{
+		return SPyErr_SetFromSymbianOSErr(error);
+		}
+	RETURN_NO_VALUE;
+	}
+
+/** Destroys the Symbian object, but not the Python object.
+	This must be done in the thread that used the object.
+*/
+static PyObject* apn_timer_close(apn_timer_object* self,
+								 PyObject* /*args*/)
+	{
+	delete self->iTimer;
+	self->iTimer = NULL;
+	RETURN_NO_VALUE;
+	}
+
+const static PyMethodDef apn_timer_methods[] =
+	{
+	{"open", (PyCFunction)apn_timer_open, METH_NOARGS},
+	{"after", (PyCFunction)apn_timer_after, METH_VARARGS},
+	{"reschedule", (PyCFunction)apn_timer_reschedule, METH_VARARGS},
+	{"cancel", (PyCFunction)apn_timer_cancel, METH_NOARGS},
+	{"close", (PyCFunction)apn_timer_close, METH_NOARGS},
+	{NULL, NULL} // sentinel
+	};
+
+static void apn_dealloc_timer(apn_timer_object *self)
+	{
+	delete self->iTimer;
+	self->iTimer = NULL;
+	PyObject_Del(self);
+	}
+
+static PyObject *apn_timer_getattr(apn_timer_object *self,
+								   char *name)
+	{
+	return Py_FindMethod((PyMethodDef*)apn_timer_methods,
+						 (PyObject*)self, name);
+	}
+
+// --------------------------------------------------------------------
+// type...
+
+const PyTypeObject apn_timer_typetmpl =
+	{
+	PyObject_HEAD_INIT(NULL)
+	0,										   /*ob_size*/
+	"pyaosocket.AoTimer",					   /*tp_name*/
+	sizeof(apn_timer_object),				   /*tp_basicsize*/
+	0,										   /*tp_itemsize*/
+	/* methods */
+	(destructor)apn_dealloc_timer,			   /*tp_dealloc*/
+	0,										   /*tp_print*/
+	(getattrfunc)apn_timer_getattr,			   /*tp_getattr*/
+	0,										   /*tp_setattr*/
+	0,										   /*tp_compare*/
+	0,										   /*tp_repr*/
+	0,										   /*tp_as_number*/
+	0,										   /*tp_as_sequence*/
+	0,										   /*tp_as_mapping*/
+	0										  /*tp_hash*/
+	};
+
+TInt apn_timer_ConstructType()
+	{
+	return ConstructType(&apn_timer_typetmpl, "AoTimer");
+	}
+
+// --------------------------------------------------------------------
+// module methods...
+
+#define AoTimerType \
+	((PyTypeObject*)SPyGetGlobalString("AoTimer"))
+
+// Returns NULL if cannot allocate.
+// The reference count of any returned object will be 1.
+// The timer will not be open.
+static apn_timer_object* NewTimerObject()
+	{
+	apn_timer_object* newTimer =
+		PyObject_New(apn_timer_object, AoTimerType);
+	if (newTimer == NULL)
+		{
+		return NULL;
+		}
+
+	newTimer->iTimer = NULL;
+
+	return newTimer;
+	}
+
+// allocates a new AoTimer object, or raises and exception
+PyObject* apn_timer_new(PyObject* /*self*/,
+						PyObject* /*args*/)
+	{
+	return reinterpret_cast<PyObject*>(NewTimerObject());
+	}
@@ -0,0 +1,131 @@
+// -*- symbian-c++ -*-
+
+//
+// bufferpool.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "bufferpool.h"
+#include "threadlocal.h"
+
+CBufferPool* CBufferPool::Current()
+	{
+	TAoThreadLocals* locals = AoThreadLocals();
+	return locals ? locals->iBufferPool : NULL;
+	}
+
+CBufferPool* CBufferPool::InstanceL()
+	{
+	TAoThreadLocals& locals = AoThreadLocalsL();
+	if (!locals.iBufferPool)
+		{
+		locals.iBufferPool = new (ELeave) CBufferPool;
+		}
+	return locals.iBufferPool;
+	}
+
+CBufferPool::~CBufferPool()
+	{
+	Trim(0);
+	}
+
+// Returns the smallest class that fits aSize bytes, or KErrNotFound
+// if there is none.
+TInt CBufferPool::ClassOf(TInt aSize)
+	{
+	for (TInt i = 0; i < KClasses; i++)
+		{
+		if (aSize <= (1 << (KMinShift + i)))
+			{
+			return i;
+			}
+		}
+	return KErrNotFound;
+	}
+
+TUint8* CBufferPool::AllocL(TInt aSize, TInt& aCapacity)
+	{
+	TInt cls = ClassOf(aSize);
+	if (cls == KErrNotFound)
+		{
+		iStats.iMisses++;
+		aCapacity = aSize;
+		return static_cast<TUint8*>(User::AllocL(aSize));
+		}
+	aCapacity = 1 << (KMinShift + cls);
+	TFreeCell* cell = iFree[cls];
+	if (!cell)
+		{
+		iStats.iMisses++;
+		return static_cast<TUint8*>(User::AllocL(aCapacity));
+		}
+	iFree[cls] = cell->iNext;
+	iIdle[cls]--;
+	iStats.iHits++;
+	iStats.iIdleCount--;
+	iStats.iIdleBytes -= aCapacity;
+	return reinterpret_cast<TUint8*>(cell);
+	}
+
+void CBufferPool::Free(TUint8* aBuf, TInt aCapacity, TInt aKeep)
+	{
+	if (!aBuf)
+		{
+		return;
+		}
+	TInt cls = ClassOf(aCapacity);
+	if (cls == KErrNotFound || aCapacity != (1 << (KMinShift + cls)) ||
+		iIdle[cls] >= aKeep)
+		{
+		iStats.iDiscarded++;
+		User::Free(aBuf);
+		return;
+		}
+	TFreeCell* cell = reinterpret_cast<TFreeCell*>(aBuf);
+	cell->iNext = iFree[cls];
+	iFree[cls] = cell;
+	iIdle[cls]++;
+	iStats.iRecycled++;
+	iStats.iIdleCount++;
+	iStats.iIdleBytes += aCapacity;
+	}
+
+void CBufferPool::Trim(TInt aKeep)
+	{
+	for (TInt i = 0; i < KClasses; i++)
+		{
+		while (iIdle[i] > aKeep)
+			{
+			TFreeCell* cell = iFree[i];
+			iFree[i] = cell->iNext;
+			iIdle[i]--;
+			iStats.iIdleCount--;
+			iStats.iIdleBytes -= 1 << (KMinShift + i);
+			User::Free(cell);
+			}
+		}
+	}
@@ -0,0 +1,100 @@
+// -*- symbian-c++ -*-
+
+//
+// bufferpool.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// A pool of size-classed receive buffers, per thread.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __BUFFERPOOL_H__
+#define __BUFFERPOOL_H__
+
+#include <e32base.h>
+
+// --------------------------------------------------------------------
+// CBufferPool...
+
+/** A per-thread pool of receive buffers, in size classes of powers
+	of two. Buffers are taken from the class that the requested size
+	rounds up to, and given back once no longer needed, to be kept
+	for reuse if the class has fewer idle buffers than the limit
+	given. Requests larger than the largest class are not pooled.
+
+	The idle buffers of a class are linked through their first
+	bytes, so there is no bookkeeping to allocate. As each thread
+	has a pool of its own, there is no locking either; a buffer
+	must be given back in the thread that it was taken in.
+*/
+NONSHARABLE_CLASS(CBufferPool) : public CBase
+	{
+public:
+	enum { KMinShift = 8, KMaxShift = 16 };
+	enum { KClasses = KMaxShift - KMinShift + 1 };
+	// the default number of idle buffers kept per class
+	enum { KDefaultKeep = 4 };
+
+	struct TStats
+		{
+		// requests served from the pool, and otherwise
+		TUint iHits;
+		TUint iMisses;
+		// buffers given back and kept, and given back and freed
+		TUint iRecycled;
+		TUint iDiscarded;
+		TInt iIdleCount;
+		TInt iIdleBytes;
+		};
+public:
+	// returns the instance for this thread, if there is one
+	static CBufferPool* Current();
+	// returns the instance for this thread, creating it if required
+	static CBufferPool* InstanceL();
+	~CBufferPool();
+
+	// aCapacity is set to the actual size of the returned buffer
+	TUint8* AllocL(TInt aSize, TInt& aCapacity);
+	// keeps the buffer if its class has fewer than aKeep idle
+	void Free(TUint8* aBuf, TInt aCapacity, TInt aKeep);
+	// frees idle buffers until no class has more than aKeep
+	void Trim(TInt aKeep);
+
+	const TStats& Stats() const { return iStats; }
+private:
+	CBufferPool() {}
+	static TInt ClassOf(TInt aSize);
+private:
+	struct TFreeCell
+		{
+		TFreeCell* iNext;
+		};
+	TFreeCell* iFree[KClasses];
+	TInt iIdle[KClasses];
+	TStats iStats;
+	};
+
+#endif // __BUFFERPOOL_H__
@@ -0,0 +1,69 @@
+// -*- symbian-c++ -*-
+
+//
+// commdbconnpref.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __COMMDBCONNPREF_H__
+#define __COMMDBCONNPREF_H__
+
+#include <e32std.h>
+
+enum TCommDbDialogPref
+	{
+	ECommDbDialogPrefUnknown,
+	ECommDbDialogPrefPrompt,
+	ECommDbDialogPrefWarn,
+	ECommDbDialogPrefDoNotPrompt,
+	ECommDbDialogPrefPromptIfWrongMode
+	};
+
+enum TCommDbConnectionDirection
+	{
+	ECommDbConnectionDirectionUnknown,
+	ECommDbConnectionDirectionOutgoing,
+	ECommDbConnectionDirectionIncoming
+	};
+
+/** Recorded, but otherwise ignored on the host.
+*/
+class TCommDbConnPref
+	{
+public:
+	TCommDbConnPref() : iDialogPref(0), iDirection(0), iIapId(0) {}
+	void SetDialogPreference(TCommDbDialogPref aPref) { iDialogPref = aPref; }
+	void SetDirection(TCommDbConnectionDirection aDir) { iDirection = aDir; }
+	void SetIapId(TUint32 aIapId) { iIapId = aIapId; }
+	TUint32 IapId() const { return iIapId; }
+private:
+	TInt iDialogPref;
+	TInt iDirection;
+	TUint32 iIapId;
+	};
+
+#endif // __COMMDBCONNPREF_H__
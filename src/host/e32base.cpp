@@ -0,0 +1,643 @@
+// -*- symbian-c++ -*-
+
+//
+// e32base.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <e32base.h>
+#include <pthread.h>
+#include <time.h>
+#include <typeinfo>
+#include <vector>
+#include "hostreactor.h"
+#include "hostring.h"
+
+extern void HostRegisterScheduler(TThreadId aId,
+								  CActiveScheduler* aScheduler);
+
+_LIT(KCBasePanic, "E32USER-CBase");
+
+// --------------------------------------------------------------------
+// CBase...
+
+TAny* CBase::operator new(size_t aSize) throw()
+	{
+	TAny* cell = ::operator new(aSize, std::nothrow);
+	if (cell)
+		{
+		memset(cell, 0, aSize);
+		}
+	return cell;
+	}
+
+TAny* CBase::operator new(size_t aSize, TLeave)
+	{
+	TAny* cell = ::operator new(aSize, ELeave);
+	memset(cell, 0, aSize);
+	return cell;
+	}
+
+void CBase::operator delete(TAny* aPtr)
+	{
+	::operator delete(aPtr);
+	}
+
+// --------------------------------------------------------------------
+// CActive...
+
+CActive::CActive(TInt aPriority) :
+	iPriority(aPriority)
+	{
+	iStatus.iOwner = this;
+	}
+
+CActive::~CActive()
+	{
+	if (iActive)
+		{
+		User::Panic(KCBasePanic, 40);
+		}
+	Deque();
+	}
+
+void CActive::SetActive()
+	{
+	if (iActive)
+		{
+		User::Panic(KCBasePanic, 42);
+		}
+	iActive = ETrue;
+	}
+
+void CActive::Cancel()
+	{
+	if (!iActive)
+		{
+		return;
+		}
+	DoCancel();
+	User::WaitForRequest(iStatus);
+	iActive = EFalse;
+	if (iReady)
+		{
+		iScheduler->Dequeue(*this);
+		}
+	}
+
+void CActive::Deque()
+	{
+	if (!iScheduler)
+		{
+		return;
+		}
+	Cancel();
+	if (iReady)
+		{
+		iScheduler->Dequeue(*this);
+		}
+	iScheduler = NULL;
+	}
+
+void CActive::SetPriority(TInt aPriority)
+	{
+	iPriority = aPriority;
+	if (iReady)
+		{
+		// requeue in the right place
+		iScheduler->Dequeue(*this);
+		iScheduler->Enqueue(*this);
+		}
+	}
+
+TInt CActive::RunError(TInt aError)
+	{
+	return aError;
+	}
+
+// --------------------------------------------------------------------
+// CActiveScheduler...
+//
+// Completed requests are run strictly by priority, except that a
+// request that has waited for KMaxAge sweeps goes first, so that a
+// busy high priority object cannot starve others indefinitely. To
+// find the oldest request without a search, the queue is also
+// linked in completion order.
+
+const TUint KMaxAge = 4;
+
+struct CActiveScheduler::TRemoteQueue
+	{
+	pthread_mutex_t iLock;
+	std::vector<TRequestStatus*> iItems;
+	// nonzero iff iItems may be non-empty; read without the lock
+	TInt iCount;
+	};
+
+static __thread CActiveScheduler* gCurrentScheduler = NULL;
+
+// Deletes any scheduler created by HostCurrent() when the
+// thread exits.
+NONSHARABLE_CLASS(TSchedulerOwner)
+	{
+public:
+	TSchedulerOwner() : iScheduler(NULL) {}
+	~TSchedulerOwner()
+		{
+		if (iScheduler)
+			{
+			CActiveScheduler::Install(NULL);
+			delete iScheduler;
+			}
+		}
+	CActiveScheduler* iScheduler;
+	};
+
+static thread_local TSchedulerOwner gSchedulerOwner;
+
+CActiveScheduler::CActiveScheduler()
+	{
+	TRAPD(error, iReactor = CHostReactor::NewL());
+	if (error)
+		{
+		User::Panic(KCBasePanic, 43);
+		}
+#ifdef HOST_ENGINE_URING
+	// falls back to the reactor alone if io_uring is not available
+	iRing = CHostRing::New(*iReactor);
+#endif
+	iRemote = new TRemoteQueue;
+	pthread_mutex_init(&iRemote->iLock, NULL);
+	iRemote->iCount = 0;
+	}
+
+CActiveScheduler::~CActiveScheduler()
+	{
+	if (iThreadId != TThreadId())
+		{
+		HostRegisterScheduler(iThreadId, NULL);
+		}
+	pthread_mutex_destroy(&iRemote->iLock);
+	delete iRemote;
+	delete iRing;
+	delete iReactor;
+	}
+
+void CActiveScheduler::Install(CActiveScheduler* aScheduler)
+	{
+	if (gCurrentScheduler)
+		{
+		HostRegisterScheduler(gCurrentScheduler->iThreadId, NULL);
+		}
+	gCurrentScheduler = aScheduler;
+	if (aScheduler)
+		{
+		aScheduler->iThreadId = RThread().Id();
+		HostRegisterScheduler(aScheduler->iThreadId, aScheduler);
+		}
+	}
+
+CActiveScheduler* CActiveScheduler::Current()
+	{
+	return gCurrentScheduler;
+	}
+
+CActiveScheduler& CActiveScheduler::HostCurrent()
+	{
+	if (!gCurrentScheduler)
+		{
+		CActiveScheduler* scheduler = new CActiveScheduler;
+		if (!scheduler)
+			{
+			User::Panic(KCBasePanic, 43);
+			}
+		gSchedulerOwner.iScheduler = scheduler;
+		Install(scheduler);
+		}
+	return *gCurrentScheduler;
+	}
+
+void CActiveScheduler::Add(CActive* aActive)
+	{
+	if (aActive->iScheduler)
+		{
+		User::Panic(KCBasePanic, 41);
+		}
+	aActive->iScheduler = &HostCurrent();
+	}
+
+void CActiveScheduler::Start()
+	{
+	CActiveScheduler& self = HostCurrent();
+	TBool stop = EFalse;
+	TBool* outer = self.iStopFlag;
+	self.iStopFlag = &stop;
+	self.RunUntil(stop);
+	self.iStopFlag = outer;
+	}
+
+TBool CActiveScheduler::RunIfReady(TInt& aError, TInt aMinimumPriority)
+	{
+	return HostCurrent().RunNext(aMinimumPriority, aError);
+	}
+
+void CActiveScheduler::Stop()
+	{
+	CActiveScheduler& self = HostCurrent();
+	if (self.iStopFlag)
+		{
+		*self.iStopFlag = ETrue;
+		}
+	}
+
+void CActiveScheduler::Error(TInt /*aError*/) const
+	{
+	User::Panic(KCBasePanic, 47);
+	}
+
+void CActiveScheduler::Enqueue(CActive& aActive)
+	{
+	aActive.iReadySince = iSweep;
+	if (iMonitor)
+		{
+		aActive.iReadyAt = HostNanoTime();
+		}
+	aActive.iAgeNext = NULL;
+	aActive.iAgePrev = iAgeLast;
+	if (iAgeLast)
+		{
+		iAgeLast->iAgeNext = &aActive;
+		}
+	else
+		{
+		iAgeFirst = &aActive;
+		}
+	iAgeLast = &aActive;
+
+	// keep the queue ordered by priority, FIFO within a priority
+	CActive* after = iReadyLast;
+	while (after && after->iPriority < aActive.iPriority)
+		{
+		after = after->iReadyPrev;
+		}
+	aActive.iReadyPrev = after;
+	aActive.iReadyNext = after ? after->iReadyNext : iReadyFirst;
+	if (aActive.iReadyNext)
+		{
+		aActive.iReadyNext->iReadyPrev = &aActive;
+		}
+	else
+		{
+		iReadyLast = &aActive;
+		}
+	if (after)
+		{
+		after->iReadyNext = &aActive;
+		}
+	else
+		{
+		iReadyFirst = &aActive;
+		}
+	aActive.iReady = ETrue;
+	iReadyCount++;
+	}
+
+void CActiveScheduler::Dequeue(CActive& aActive)
+	{
+	if (aActive.iReadyPrev)
+		{
+		aActive.iReadyPrev->iReadyNext = aActive.iReadyNext;
+		}
+	else
+		{
+		iReadyFirst = aActive.iReadyNext;
+		}
+	if (aActive.iReadyNext)
+		{
+		aActive.iReadyNext->iReadyPrev = aActive.iReadyPrev;
+		}
+	else
+		{
+		iReadyLast = aActive.iReadyPrev;
+		}
+	aActive.iReadyPrev = aActive.iReadyNext = NULL;
+
+	if (aActive.iAgePrev)
+		{
+		aActive.iAgePrev->iAgeNext = aActive.iAgeNext;
+		}
+	else
+		{
+		iAgeFirst = aActive.iAgeNext;
+		}
+	if (aActive.iAgeNext)
+		{
+		aActive.iAgeNext->iAgePrev = aActive.iAgePrev;
+		}
+	else
+		{
+		iAgeLast = aActive.iAgePrev;
+		}
+	aActive.iAgePrev = aActive.iAgeNext = NULL;
+
+	aActive.iReady = EFalse;
+	iReadyCount--;
+	}
+
+void CActiveScheduler::RequestComplete(TRequestStatus& aStatus,
+									   TInt aReason)
+	{
+	aStatus = aReason;
+	CActive* owner = aStatus.Owner();
+	if (owner && owner->iScheduler == this && !owner->iReady)
+		{
+		if (iPollable && !iDepth && !iReadyFirst)
+			{
+			iReactor->Wake();
+			}
+		Enqueue(*owner);
+		}
+	}
+
+void CActiveScheduler::RemoteRequestComplete(TRequestStatus& aStatus,
+											 TInt aReason)
+	{
+	pthread_mutex_lock(&iRemote->iLock);
+	aStatus = aReason;
+	iRemote->iItems.push_back(&aStatus);
+	__atomic_store_n(&iRemote->iCount, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&iRemote->iLock);
+	iReactor->Wake();
+	}
+
+void CActiveScheduler::TakeRemote()
+	{
+	if (!__atomic_load_n(&iRemote->iCount, __ATOMIC_ACQUIRE))
+		{
+		return;
+		}
+	std::vector<TRequestStatus*> items;
+	pthread_mutex_lock(&iRemote->iLock);
+	items.swap(iRemote->iItems);
+	iRemote->iCount = 0;
+	pthread_mutex_unlock(&iRemote->iLock);
+	for (size_t i = 0; i < items.size(); i++)
+		{
+		CActive* owner = items[i]->Owner();
+		if (owner && owner->iScheduler == this && !owner->iReady)
+			{
+			Enqueue(*owner);
+			}
+		}
+	}
+
+/** Runs the RunL() of the first active object in the queue whose
+	request has completed, provided that its priority is at least
+	aMinimumPriority. Returns EFalse if there was none. Should the
+	RunL() leave, aError is set to what RunError() returns.
+*/
+TBool CActiveScheduler::RunNext(TInt aMinimumPriority, TInt& aError)
+	{
+	aError = KErrNone;
+	while (iReadyFirst)
+		{
+		// an aged object goes first, unless it is below the minimum,
+		// in which case the others go by priority as usual
+		CActive* active = iReadyFirst;
+		if (iSweep - iAgeFirst->iReadySince >= KMaxAge &&
+			iAgeFirst->iPriority >= aMinimumPriority)
+			{
+			active = iAgeFirst;
+			}
+		else if (active->iPriority < aMinimumPriority)
+			{
+			return EFalse;
+			}
+		Dequeue(*active);
+		if (!active->iActive || active->iStatus == KRequestPending)
+			{
+			// cancelled, or completed before being made active
+			// and then reused; either way nothing to run
+			continue;
+			}
+		active->iActive = EFalse;
+		MHostRunMonitor* monitor = iMonitor;
+		const char* name = NULL;
+		TInt64 start = 0;
+		if (monitor)
+			{
+			name = typeid(*active).name();
+			start = HostNanoTime();
+			}
+		TInt64 readyAt = active->iReadyAt;
+		iDepth++;
+		TRAPD(error, active->RunL());
+		iDepth--;
+		// the monitor may have been removed by the RunL()
+		if (monitor && monitor == iMonitor)
+			{
+			monitor->ActiveRun(name, readyAt, start, HostNanoTime());
+			}
+		if (error)
+			{
+			// note that RunL() may have deleted the object,
+			// but then it should not have left either
+			aError = active->RunError(error);
+			}
+		return ETrue;
+		}
+	return EFalse;
+	}
+
+void CActiveScheduler::Wait(TInt aTimeout)
+	{
+	if (iRing)
+		{
+		iRing->Poll(aTimeout);
+		}
+	else
+		{
+		iReactor->Poll(aTimeout);
+		}
+	}
+
+void CActiveScheduler::Poll(TInt aTimeout)
+	{
+	TakeRemote();
+	Wait(iReadyFirst ? 0 : aTimeout);
+	TakeRemote();
+	}
+
+void CActiveScheduler::RunUntil(const TBool& aStop)
+	{
+	iDepth++;
+	while (!aStop)
+		{
+		// Pick up I/O readiness without blocking if there is already
+		// work to do, so that a busy queue cannot starve the file
+		// descriptors. Each sweep then runs the requests that had
+		// completed by the time the sweep began.
+		Poll(-1);
+		iSweep++;
+		TInt sweep = iReadyCount;
+		TInt error;
+		while (sweep-- > 0 && !aStop && RunNext(KMinTInt, error))
+			{
+			if (error)
+				{
+				Error(error);
+				}
+			}
+		}
+	iDepth--;
+	}
+
+void CActiveScheduler::WaitForRequest(TRequestStatus& aStatus)
+	{
+	while (aStatus == KRequestPending)
+		{
+		TakeRemote();
+		Wait(-1);
+		}
+	TakeRemote();
+	}
+
+void CActiveScheduler::WaitForAnyRequest()
+	{
+	iDepth++;
+	do
+		{
+		Poll(-1);
+		}
+	while (!iReadyFirst);
+	iDepth--;
+	// each wait counts as a sweep, for aging purposes
+	iSweep++;
+	}
+
+TInt CActiveScheduler::HostPollFd()
+	{
+	iPollable = ETrue;
+	if (iRing)
+		{
+		iRing->SetSubmitWhenIdle(&iDepth);
+		return iRing->Fd();
+		}
+	return iReactor->Fd();
+	}
+
+TInt CActiveScheduler::HostProcessReady()
+	{
+	iDepth++;
+	Poll(0);
+	iSweep++;
+	TInt count = 0;
+	TInt sweep = iReadyCount;
+	TInt error;
+	while (sweep-- > 0 && RunNext(KMinTInt, error))
+		{
+		count++;
+		if (error)
+			{
+			Error(error);
+			}
+		}
+	// hand whatever the RunLs requested over to the kernel, as
+	// the caller is about to wait on the descriptor, not on us
+	Poll(0);
+	iDepth--;
+	if (iReadyFirst || (iRing && iRing->HasPending()))
+		{
+		// leave the descriptor readable for the rest
+		iReactor->Wake();
+		}
+	return count;
+	}
+
+void CActiveScheduler::HostSetMonitor(MHostRunMonitor* aMonitor)
+	{
+	if (aMonitor && !iMonitor)
+		{
+		// those already queued have no time recorded
+		TInt64 now = HostNanoTime();
+		for (CActive* active = iReadyFirst; active;
+			 active = active->iReadyNext)
+			{
+			active->iReadyAt = now;
+			}
+		}
+	iMonitor = aMonitor;
+	}
+
+TInt64 CActiveScheduler::HostNanoTime()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (TInt64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+
+// --------------------------------------------------------------------
+// CActiveSchedulerWait...
+
+CActiveSchedulerWait::CActiveSchedulerWait()
+	{
+	}
+
+CActiveSchedulerWait::~CActiveSchedulerWait()
+	{
+	if (iFrame)
+		{
+		// tell the loop to stop, and not to touch us afterwards
+		iFrame->iStop = ETrue;
+		iFrame->iDeleted = ETrue;
+		}
+	}
+
+void CActiveSchedulerWait::Start()
+	{
+	if (iFrame)
+		{
+		User::Panic(KCBasePanic, 44);
+		}
+	TFrame frame;
+	frame.iStop = EFalse;
+	frame.iDeleted = EFalse;
+	iFrame = &frame;
+	CActiveScheduler::HostCurrent().RunUntil(frame.iStop);
+	if (!frame.iDeleted)
+		{
+		iFrame = NULL;
+		}
+	}
+
+void CActiveSchedulerWait::AsyncStop()
+	{
+	if (iFrame)
+		{
+		iFrame->iStop = ETrue;
+		}
+	}
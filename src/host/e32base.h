@@ -0,0 +1,279 @@
+// -*- symbian-c++ -*-
+
+//
+// e32base.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __E32BASE_H__
+#define __E32BASE_H__
+
+#include <e32std.h>
+
+// --------------------------------------------------------------------
+// leaving...
+//
+// Leaves are implemented as C++ exceptions, much like on EKA2.
+
+class XLeaveException
+	{
+public:
+	XLeaveException(TInt aReason) : iReason(aReason) {}
+	TInt Reason() const { return iReason; }
+private:
+	TInt iReason;
+	};
+
+enum TLeave { ELeave };
+
+TAny* operator new(size_t aSize, TLeave);
+TAny* operator new[](size_t aSize, TLeave);
+
+class CleanupStack
+	{
+public:
+	static void PushL(TAny* aPtr);
+	static void PushL(class CBase* aPtr);
+	static void Pop();
+	static void Pop(TInt aCount);
+	static void PopAndDestroy();
+	static void PopAndDestroy(TInt aCount);
+
+	// host only; used by the TRAP macros
+	static TInt HostLevel();
+	static void HostUnwind(TInt aLevel);
+	};
+
+#define TRAP(_r, _s) \
+	{ \
+	TInt _trapLevel = CleanupStack::HostLevel(); \
+	try { _r = KErrNone; { _s; } } \
+	catch (const XLeaveException& _leave) \
+		{ CleanupStack::HostUnwind(_trapLevel); _r = _leave.Reason(); } \
+	}
+#define TRAPD(_r, _s) TInt _r; TRAP(_r, _s)
+#define TRAP_IGNORE(_s) { TInt _ignore; TRAP(_ignore, _s); (void)_ignore; }
+
+// --------------------------------------------------------------------
+// CBase...
+
+class CBase
+	{
+public:
+	virtual ~CBase() {}
+	// like on Symbian, instances are zero filled on allocation
+	static TAny* operator new(size_t aSize) throw();
+	static TAny* operator new(size_t aSize, TLeave);
+	static TAny* operator new(size_t aSize, TAny* aCell) throw()
+		{ return aCell; }
+	static void operator delete(TAny* aPtr);
+protected:
+	CBase() {}
+private:
+	CBase(const CBase&);
+	CBase& operator=(const CBase&);
+	};
+
+// --------------------------------------------------------------------
+// active objects...
+
+class CActiveScheduler;
+
+class CActive : public CBase
+	{
+public:
+	enum TPriority
+		{
+		EPriorityIdle = -100,
+		EPriorityLow = -20,
+		EPriorityStandard = 0,
+		EPriorityUserInput = 10,
+		EPriorityHigh = 20
+		};
+public:
+	~CActive();
+	void Cancel();
+	void Deque();
+	void SetPriority(TInt aPriority);
+	TBool IsActive() const { return iActive; }
+	TBool IsAdded() const { return iScheduler != NULL; }
+	TInt Priority() const { return iPriority; }
+protected:
+	CActive(TInt aPriority);
+	void SetActive();
+	virtual void DoCancel() = 0;
+	virtual void RunL() = 0;
+	virtual TInt RunError(TInt aError);
+public:
+	TRequestStatus iStatus;
+private:
+	TBool iActive;
+	TInt iPriority;
+
+	// The scheduler we were added to, and our links in its queue of
+	// completed requests. We are in that queue iff iReady is set.
+	CActiveScheduler* iScheduler;
+	CActive* iReadyPrev;
+	CActive* iReadyNext;
+	TBool iReady;
+	// our links in the same queue in completion order, and the
+	// sweep during which we were queued, for aging
+	CActive* iAgePrev;
+	CActive* iAgeNext;
+	TUint iReadySince;
+	// when we were queued, in nanoseconds; only kept up to date
+	// while the scheduler has a run monitor
+	TInt64 iReadyAt;
+
+	friend class CActiveScheduler;
+	};
+
+class CHostReactor;
+class CHostRing;
+
+/** Gets told of every RunL() that a scheduler runs, if installed
+	with CActiveScheduler::HostSetMonitor(). aClass is the mangled
+	name of the class of the active object, and is the same pointer
+	for every object of a class. Times are in nanoseconds, from an
+	arbitrary origin. The active object itself may be gone by the
+	time this is called.
+*/
+class MHostRunMonitor
+	{
+public:
+	virtual void ActiveRun(const char* aClass, TInt64 aReadyAt,
+						   TInt64 aStartAt, TInt64 aEndAt) = 0;
+	};
+
+/** On the host, each thread lazily gets a scheduler of its own,
+	which waits for requests to complete using a CHostReactor.
+	Requests completed from within the thread are queued directly;
+	requests completed by other threads are handed over under a lock
+	and the reactor is woken up.
+*/
+class CActiveScheduler : public CBase
+	{
+public:
+	CActiveScheduler();
+	~CActiveScheduler();
+	static void Install(CActiveScheduler* aScheduler);
+	static CActiveScheduler* Current();
+	static void Add(CActive* aActive);
+	static void Start();
+	static void Stop();
+	// runs the highest priority ready active object, if any, and if
+	// it has at least the given priority; meant to be called after
+	// User::WaitForAnyRequest()
+	static TBool RunIfReady(TInt& aError, TInt aMinimumPriority);
+	virtual void Error(TInt aError) const;
+
+public: // host only
+	// returns the current scheduler, creating one if required
+	static CActiveScheduler& HostCurrent();
+	CHostReactor& Reactor() { return *iReactor; }
+	// NULL unless the io_uring engine is in use
+	CHostRing* Ring() { return iRing; }
+	TThreadId ThreadId() const { return iThreadId; }
+	// completes a request made from this thread
+	void RequestComplete(TRequestStatus& aStatus, TInt aReason);
+	// completes a request from a different thread
+	void RemoteRequestComplete(TRequestStatus& aStatus, TInt aReason);
+	// runs until the flag gets set by a RunL
+	void RunUntil(const TBool& aStop);
+	// waits for the request without running any RunLs
+	void WaitForRequest(TRequestStatus& aStatus);
+	// waits until there is at least one completed request,
+	// without running any RunLs
+	void WaitForAnyRequest();
+	// waits for completions for at most aTimeout milliseconds
+	// (-1 for no limit), without running any RunLs
+	void Poll(TInt aTimeout);
+	// returns a descriptor that becomes readable whenever there
+	// are completions to process, for use with select() and the like
+	TInt HostPollFd();
+	// runs the RunLs of the requests that have completed by now,
+	// without waiting; returns the number run
+	TInt HostProcessReady();
+	// aMonitor may be NULL, to stop monitoring
+	void HostSetMonitor(MHostRunMonitor* aMonitor);
+	// monotonic, in nanoseconds
+	static TInt64 HostNanoTime();
+private:
+	void Enqueue(CActive& aActive);
+	void Dequeue(CActive& aActive);
+	TBool RunNext(TInt aMinimumPriority, TInt& aError);
+	void TakeRemote();
+	void Wait(TInt aTimeout);
+private:
+	CHostReactor* iReactor;
+	CHostRing* iRing;
+	TThreadId iThreadId;
+	CActive* iReadyFirst;
+	CActive* iReadyLast;
+	TInt iReadyCount;
+	CActive* iAgeFirst;
+	CActive* iAgeLast;
+	// the number of sweeps so far
+	TUint iSweep;
+	// set by Stop(); belongs to the innermost Start()
+	TBool* iStopFlag;
+	// whether HostPollFd() has been called
+	TBool iPollable;
+	// nonzero while we are running, or waiting for, RunLs; outside
+	// of that, requests completed in the thread must wake the
+	// reactor, for the poll descriptor to be readable
+	TInt iDepth;
+	MHostRunMonitor* iMonitor;
+
+	// Statuses completed by other threads; guarded by the lock.
+	// Allocated separately so that the header does not need to
+	// know about pthreads.
+	struct TRemoteQueue;
+	TRemoteQueue* iRemote;
+
+	friend class CActive;
+	};
+
+class CActiveSchedulerWait : public CBase
+	{
+public:
+	CActiveSchedulerWait();
+	~CActiveSchedulerWait();
+	void Start();
+	void AsyncStop();
+	TBool IsStarted() const { return iFrame != NULL; }
+private:
+	// lives on the stack of Start()
+	struct TFrame
+		{
+		TBool iStop;
+		TBool iDeleted;
+		};
+	TFrame* iFrame;
+	};
+
+#endif // __E32BASE_H__
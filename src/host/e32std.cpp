@@ -0,0 +1,319 @@
+// -*- symbian-c++ -*-
+
+//
+// e32std.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <e32base.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+
+// --------------------------------------------------------------------
+// leaving...
+
+TAny* operator new(size_t aSize, TLeave)
+	{
+	TAny* cell = ::operator new(aSize, std::nothrow);
+	if (!cell)
+		{
+		User::LeaveNoMemory();
+		}
+	return cell;
+	}
+
+TAny* operator new[](size_t aSize, TLeave)
+	{
+	TAny* cell = ::operator new[](aSize, std::nothrow);
+	if (!cell)
+		{
+		User::LeaveNoMemory();
+		}
+	return cell;
+	}
+
+TAny* User::Alloc(TInt aSize)
+	{
+	return malloc(aSize);
+	}
+
+TAny* User::AllocL(TInt aSize)
+	{
+	TAny* cell = malloc(aSize);
+	if (!cell)
+		{
+		User::LeaveNoMemory();
+		}
+	return cell;
+	}
+
+void User::Free(TAny* aCell)
+	{
+	free(aCell);
+	}
+
+void User::Leave(TInt aReason)
+	{
+	throw XLeaveException(aReason);
+	}
+
+void User::LeaveNoMemory()
+	{
+	Leave(KErrNoMemory);
+	}
+
+TInt User::LeaveIfError(TInt aReason)
+	{
+	if (aReason < 0)
+		{
+		Leave(aReason);
+		}
+	return aReason;
+	}
+
+TAny* User::LeaveIfNull(TAny* aPtr)
+	{
+	if (!aPtr)
+		{
+		LeaveNoMemory();
+		}
+	return aPtr;
+	}
+
+// --------------------------------------------------------------------
+// the cleanup stack...
+
+struct TCleanupItem
+	{
+	TAny* iPtr;
+	TBool iIsCBase;
+	};
+
+static __thread std::vector<TCleanupItem>* gCleanupStack = NULL;
+
+static std::vector<TCleanupItem>& CleanupItems()
+	{
+	if (!gCleanupStack)
+		{
+		gCleanupStack = new std::vector<TCleanupItem>;
+		}
+	return *gCleanupStack;
+	}
+
+static void Destroy(const TCleanupItem& aItem)
+	{
+	if (aItem.iIsCBase)
+		{
+		delete static_cast<CBase*>(aItem.iPtr);
+		}
+	else
+		{
+		::operator delete(aItem.iPtr);
+		}
+	}
+
+void CleanupStack::PushL(TAny* aPtr)
+	{
+	TCleanupItem item = { aPtr, EFalse };
+	CleanupItems().push_back(item);
+	}
+
+void CleanupStack::PushL(CBase* aPtr)
+	{
+	TCleanupItem item = { aPtr, ETrue };
+	CleanupItems().push_back(item);
+	}
+
+void CleanupStack::Pop()
+	{
+	Pop(1);
+	}
+
+void CleanupStack::Pop(TInt aCount)
+	{
+	std::vector<TCleanupItem>& items = CleanupItems();
+	items.resize(items.size() - aCount);
+	}
+
+void CleanupStack::PopAndDestroy()
+	{
+	PopAndDestroy(1);
+	}
+
+void CleanupStack::PopAndDestroy(TInt aCount)
+	{
+	std::vector<TCleanupItem>& items = CleanupItems();
+	while (aCount-- > 0)
+		{
+		TCleanupItem item = items.back();
+		items.pop_back();
+		Destroy(item);
+		}
+	}
+
+TInt CleanupStack::HostLevel()
+	{
+	return CleanupItems().size();
+	}
+
+void CleanupStack::HostUnwind(TInt aLevel)
+	{
+	PopAndDestroy(HostLevel() - aLevel);
+	}
+
+// --------------------------------------------------------------------
+// User...
+
+void User::Panic(const TDesC& aCategory, TInt aReason)
+	{
+	fprintf(stderr, "panic: %.*ls %d\n",
+			aCategory.Length(), aCategory.Ptr(), aReason);
+	abort();
+	}
+
+void User::RequestComplete(TRequestStatus*& aStatus, TInt aReason)
+	{
+	CActiveScheduler::HostCurrent().RequestComplete(*aStatus, aReason);
+	aStatus = NULL;
+	}
+
+void User::WaitForRequest(TRequestStatus& aStatus)
+	{
+	CActiveScheduler::HostCurrent().WaitForRequest(aStatus);
+	}
+
+void User::WaitForAnyRequest()
+	{
+	CActiveScheduler::HostCurrent().WaitForAnyRequest();
+	}
+
+void User::After(TInt aMicroSeconds)
+	{
+	struct timespec ts;
+	ts.tv_sec = aMicroSeconds / 1000000;
+	ts.tv_nsec = (aMicroSeconds % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		{
+		}
+	}
+
+TInt64 User::HostTimeNow()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (TInt64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
+TUint User::TickCount()
+	{
+	return (TUint)(HostTimeNow() / 1000);
+	}
+
+// --------------------------------------------------------------------
+// Dll...
+
+static __thread TAny* gTls = NULL;
+
+TInt Dll::SetTls(TAny* aPtr)
+	{
+	gTls = aPtr;
+	return KErrNone;
+	}
+
+TAny* Dll::Tls()
+	{
+	return gTls;
+	}
+
+// --------------------------------------------------------------------
+// RThread...
+
+RThread::RThread() :
+	iId(syscall(SYS_gettid))
+	{
+	}
+
+// Which threads have a scheduler that requests can be completed to.
+// Guarded by gThreadLock.
+static pthread_mutex_t gThreadLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<TUint64, CActiveScheduler*>* gThreadSchedulers = NULL;
+
+void HostRegisterScheduler(TThreadId aId, CActiveScheduler* aScheduler)
+	{
+	pthread_mutex_lock(&gThreadLock);
+	if (!gThreadSchedulers)
+		{
+		gThreadSchedulers = new std::map<TUint64, CActiveScheduler*>;
+		}
+	if (aScheduler)
+		{
+		(*gThreadSchedulers)[aId.Id()] = aScheduler;
+		}
+	else
+		{
+		gThreadSchedulers->erase(aId.Id());
+		}
+	pthread_mutex_unlock(&gThreadLock);
+	}
+
+TInt RThread::Open(TThreadId aId, TOwnerType /*aType*/)
+	{
+	TInt error = KErrNotFound;
+	pthread_mutex_lock(&gThreadLock);
+	if (gThreadSchedulers &&
+		gThreadSchedulers->find(aId.Id()) != gThreadSchedulers->end())
+		{
+		iId = aId;
+		error = KErrNone;
+		}
+	pthread_mutex_unlock(&gThreadLock);
+	return error;
+	}
+
+void RThread::RequestComplete(TRequestStatus*& aStatus, TInt aReason) const
+	{
+	// the lock also keeps the target scheduler from going away
+	pthread_mutex_lock(&gThreadLock);
+	if (gThreadSchedulers)
+		{
+		std::map<TUint64, CActiveScheduler*>::iterator i =
+			gThreadSchedulers->find(iId.Id());
+		if (i != gThreadSchedulers->end())
+			{
+			i->second->RemoteRequestComplete(*aStatus, aReason);
+			}
+		}
+	pthread_mutex_unlock(&gThreadLock);
+	aStatus = NULL;
+	}
@@ -0,0 +1,580 @@
+// -*- symbian-c++ -*-
+
+//
+// e32std.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __E32STD_H__
+#define __E32STD_H__
+
+// Python wants its feature macros defined before any system header
+#include <pyconfig.h>
+#include <stddef.h>
+#include <string.h>
+#include <wchar.h>
+#include <new>
+
+// --------------------------------------------------------------------
+// basic types...
+
+typedef signed char TInt8;
+typedef unsigned char TUint8;
+typedef short TInt16;
+typedef unsigned short TUint16;
+typedef int TInt32;
+typedef unsigned int TUint32;
+typedef long long TInt64;
+typedef unsigned long long TUint64;
+typedef int TInt;
+typedef unsigned int TUint;
+typedef int TBool;
+typedef void TAny;
+typedef double TReal;
+
+// Py_UNICODE is four bytes wide on typical Linux builds of Python,
+// so on the host we make TText match wchar_t rather than TUint16.
+// symbian_python_ext_util.h checks that the two agree.
+typedef wchar_t TText;
+
+const TBool EFalse = 0;
+const TBool ETrue = 1;
+
+const TInt KMaxTInt = 0x7fffffff;
+const TInt KMinTInt = (TInt)0x80000000;
+
+#define IMPORT_C
+#define EXPORT_C
+#define GLDEF_C
+#define LOCAL_C static
+#define NONSHARABLE_CLASS(x) class x
+#define NONSHARABLE_STRUCT(x) struct x
+#define FOREVER for (;;)
+
+#define __ASSERT_ALWAYS(c, p) (void)((c) || (p, 0))
+#define __ASSERT_DEBUG(c, p) __ASSERT_ALWAYS(c, p)
+
+// --------------------------------------------------------------------
+// error codes...
+
+const TInt KErrNone = 0;
+const TInt KErrNotFound = -1;
+const TInt KErrGeneral = -2;
+const TInt KErrCancel = -3;
+const TInt KErrNoMemory = -4;
+const TInt KErrNotSupported = -5;
+const TInt KErrArgument = -6;
+const TInt KErrBadHandle = -8;
+const TInt KErrOverflow = -9;
+const TInt KErrUnderflow = -10;
+const TInt KErrAlreadyExists = -11;
+const TInt KErrPathNotFound = -12;
+const TInt KErrDied = -13;
+const TInt KErrInUse = -14;
+const TInt KErrServerTerminated = -15;
+const TInt KErrServerBusy = -16;
+const TInt KErrNotReady = -18;
+const TInt KErrUnknown = -19;
+const TInt KErrCorrupt = -20;
+const TInt KErrAccessDenied = -21;
+const TInt KErrLocked = -22;
+const TInt KErrWrite = -23;
+const TInt KErrEof = -25;
+const TInt KErrDiskFull = -26;
+const TInt KErrBadName = -28;
+const TInt KErrCommsLineFail = -29;
+const TInt KErrTimedOut = -33;
+const TInt KErrCouldNotConnect = -34;
+const TInt KErrDisconnected = -36;
+const TInt KErrBadDescriptor = -38;
+const TInt KErrAbort = -39;
+const TInt KErrTooBig = -40;
+
+const TInt KRequestPending = (TInt)0x80000001;
+
+// --------------------------------------------------------------------
+// TRequestStatus...
+
+class CActive;
+
+class TRequestStatus
+	{
+public:
+	TRequestStatus() : iStatus(0), iOwner(NULL) {}
+	TRequestStatus(TInt aVal) : iStatus(aVal), iOwner(NULL) {}
+	// copying only ever copies the value, never the ownership
+	TRequestStatus(const TRequestStatus& aOther) :
+		iStatus(aOther.Int()), iOwner(NULL) {}
+	TRequestStatus& operator=(const TRequestStatus& aOther)
+		{ Set(aOther.Int()); return *this; }
+	TInt operator=(TInt aVal) { Set(aVal); return aVal; }
+	TBool operator==(TInt aVal) const { return Int() == aVal; }
+	TBool operator!=(TInt aVal) const { return Int() != aVal; }
+	TBool operator>=(TInt aVal) const { return Int() >= aVal; }
+	TBool operator<=(TInt aVal) const { return Int() <= aVal; }
+	TBool operator>(TInt aVal) const { return Int() > aVal; }
+	TBool operator<(TInt aVal) const { return Int() < aVal; }
+	TInt Int() const { return __atomic_load_n(&iStatus, __ATOMIC_ACQUIRE); }
+
+	// host only: the active object whose iStatus this is, if any
+	CActive* Owner() const { return iOwner; }
+private:
+	void Set(TInt aVal) { __atomic_store_n(&iStatus, aVal, __ATOMIC_RELEASE); }
+	TInt iStatus;
+	CActive* iOwner;
+	friend class CActive;
+	};
+
+// --------------------------------------------------------------------
+// descriptors...
+//
+// Symbian descriptors encode their type in the length word and
+// avoid virtual functions. Here we simply keep a data pointer in the
+// base class, which is good enough for the way this library uses
+// them.
+
+template <class T> class THostPtrC;
+template <class T> class THostPtr;
+
+template <class T>
+class THostDesC
+	{
+public:
+	TInt Length() const { return iLength; }
+	TInt Size() const { return iLength * (TInt)sizeof(T); }
+	const T* Ptr() const { return iPtr; }
+	const T& operator[](TInt aIndex) const { return iPtr[aIndex]; }
+	TInt Compare(const THostDesC<T>& aDes) const;
+	TBool operator==(const THostDesC<T>& aDes) const
+		{ return Compare(aDes) == 0; }
+	TBool operator!=(const THostDesC<T>& aDes) const
+		{ return Compare(aDes) != 0; }
+	TInt Locate(T aChar) const;
+	TInt Find(const THostDesC<T>& aDes) const;
+	THostPtrC<T> Left(TInt aLength) const;
+	THostPtrC<T> Right(TInt aLength) const;
+	THostPtrC<T> Mid(TInt aPos) const;
+	THostPtrC<T> Mid(TInt aPos, TInt aLength) const;
+protected:
+	THostDesC() : iLength(0), iPtr(NULL) {}
+	THostDesC(const T* aPtr, TInt aLength) :
+		iLength(aLength), iPtr(const_cast<T*>(aPtr)) {}
+	TInt iLength;
+	T* iPtr;
+	};
+
+template <class T>
+class THostDes : public THostDesC<T>
+	{
+public:
+	TInt MaxLength() const { return iMaxLength; }
+	void SetLength(TInt aLength) { SetLen(aLength); }
+	void Zero() { SetLen(0); }
+	void SetMax() { SetLen(iMaxLength); }
+	void FillZ() { memset(this->iPtr, 0, this->iLength * sizeof(T)); }
+	void FillZ(TInt aLength)
+		{ SetLen(aLength); FillZ(); }
+	void Copy(const T* aPtr, TInt aLength)
+		{ memmove(this->iPtr, aPtr, aLength * sizeof(T)); SetLen(aLength); }
+	void Copy(const THostDesC<T>& aDes)
+		{ Copy(aDes.Ptr(), aDes.Length()); }
+	void Append(const T* aPtr, TInt aLength)
+		{
+		memmove(this->iPtr + this->iLength, aPtr, aLength * sizeof(T));
+		SetLen(this->iLength + aLength);
+		}
+	void Append(const THostDesC<T>& aDes)
+		{ Append(aDes.Ptr(), aDes.Length()); }
+	void Append(T aChar) { Append(&aChar, 1); }
+	void Delete(TInt aPos, TInt aLength)
+		{
+		memmove(this->iPtr + aPos, this->iPtr + aPos + aLength,
+				(this->iLength - aPos - aLength) * sizeof(T));
+		SetLen(this->iLength - aLength);
+		}
+	T& operator[](TInt aIndex) { return this->iPtr[aIndex]; }
+	const T& operator[](TInt aIndex) const { return this->iPtr[aIndex]; }
+	THostDes<T>& operator=(const THostDesC<T>& aDes)
+		{ Copy(aDes); return *this; }
+	THostPtr<T> MidTPtr(TInt aPos) const;
+protected:
+	THostDes() : iMaxLength(0), iLengthRef(NULL) {}
+	THostDes(T* aPtr, TInt aLength, TInt aMaxLength) :
+		THostDesC<T>(aPtr, aLength), iMaxLength(aMaxLength),
+		iLengthRef(NULL) {}
+	void SetLen(TInt aLength)
+		{
+		this->iLength = aLength;
+		if (iLengthRef) *iLengthRef = aLength;
+		}
+	TInt iMaxLength;
+	// non-NULL for pointers obtained with HBufC::Des(), so that
+	// length changes are reflected in the heap descriptor
+	TInt* iLengthRef;
+	};
+
+template <class T>
+class THostPtrC : public THostDesC<T>
+	{
+public:
+	THostPtrC() {}
+	THostPtrC(const THostDesC<T>& aDes) :
+		THostDesC<T>(aDes.Ptr(), aDes.Length()) {}
+	THostPtrC(const T* aPtr, TInt aLength) :
+		THostDesC<T>(aPtr, aLength) {}
+	void Set(const T* aPtr, TInt aLength)
+		{ this->iPtr = const_cast<T*>(aPtr); this->iLength = aLength; }
+	void Set(const THostDesC<T>& aDes) { Set(aDes.Ptr(), aDes.Length()); }
+	};
+
+template <class T>
+class THostPtr : public THostDes<T>
+	{
+public:
+	THostPtr(T* aPtr, TInt aMaxLength) :
+		THostDes<T>(aPtr, 0, aMaxLength) {}
+	THostPtr(T* aPtr, TInt aLength, TInt aMaxLength) :
+		THostDes<T>(aPtr, aLength, aMaxLength) {}
+	THostPtr(const THostPtr<T>& aPtr) :
+		THostDes<T>(aPtr.iPtr, aPtr.iLength, aPtr.iMaxLength)
+		{ this->iLengthRef = aPtr.iLengthRef; }
+	void Set(T* aPtr, TInt aLength, TInt aMaxLength)
+		{
+		this->iPtr = aPtr;
+		this->iLength = aLength;
+		this->iMaxLength = aMaxLength;
+		this->iLengthRef = NULL;
+		}
+	void Set(const THostPtr<T>& aPtr)
+		{ Set(aPtr.iPtr, aPtr.iLength, aPtr.iMaxLength); }
+	THostPtr<T>& operator=(const THostDesC<T>& aDes)
+		{ this->Copy(aDes); return *this; }
+	THostPtr<T>& operator=(const THostPtr<T>& aDes)
+		{ this->Copy(aDes); return *this; }
+private:
+	friend class THostDes<T>;
+	template <class U> friend class THostHBufC;
+	};
+
+template <class T, TInt S>
+class THostBuf : public THostDes<T>
+	{
+public:
+	THostBuf() : THostDes<T>(iBuf, 0, S) {}
+	THostBuf(const THostDesC<T>& aDes) : THostDes<T>(iBuf, 0, S)
+		{ this->Copy(aDes); }
+	THostBuf(const THostBuf<T, S>& aBuf) : THostDes<T>(iBuf, 0, S)
+		{ this->Copy(aBuf); }
+	THostBuf<T, S>& operator=(const THostDesC<T>& aDes)
+		{ this->Copy(aDes); return *this; }
+	THostBuf<T, S>& operator=(const THostBuf<T, S>& aBuf)
+		{ this->Copy(aBuf); return *this; }
+private:
+	T iBuf[S];
+	};
+
+// Allocated in a single cell, with the data immediately following
+// the header, as on Symbian.
+template <class T>
+class THostHBufC : public THostDesC<T>
+	{
+public:
+	static THostHBufC<T>* New(TInt aMaxLength);
+	static THostHBufC<T>* NewL(TInt aMaxLength);
+	THostPtr<T> Des()
+		{
+		THostPtr<T> ptr(this->iPtr, this->iLength, iMaxLength);
+		ptr.iLengthRef = &this->iLength;
+		return ptr;
+		}
+	static void operator delete(TAny* aPtr) { ::operator delete(aPtr); }
+private:
+	THostHBufC(TInt aMaxLength) :
+		THostDesC<T>(reinterpret_cast<T*>(this + 1), 0),
+		iMaxLength(aMaxLength) {}
+	TInt iMaxLength;
+	};
+
+typedef THostDesC<TUint8> TDesC8;
+typedef THostDes<TUint8> TDes8;
+typedef THostPtrC<TUint8> TPtrC8;
+typedef THostPtr<TUint8> TPtr8;
+typedef THostHBufC<TUint8> HBufC8;
+template <TInt S> class TBuf8 : public THostBuf<TUint8, S>
+	{
+public:
+	TBuf8() {}
+	TBuf8(const TDesC8& aDes) : THostBuf<TUint8, S>(aDes) {}
+	};
+
+typedef THostDesC<TText> TDesC16;
+typedef THostDes<TText> TDes16;
+typedef THostPtrC<TText> TPtrC16;
+typedef THostPtr<TText> TPtr16;
+typedef THostHBufC<TText> HBufC16;
+template <TInt S> class TBuf16 : public THostBuf<TText, S>
+	{
+public:
+	TBuf16() {}
+	TBuf16(const TDesC16& aDes) : THostBuf<TText, S>(aDes) {}
+	};
+
+typedef TDesC16 TDesC;
+typedef TDes16 TDes;
+typedef TPtrC16 TPtrC;
+typedef TPtr16 TPtr;
+typedef HBufC16 HBufC;
+template <TInt S> class TBuf : public TBuf16<S>
+	{
+public:
+	TBuf() {}
+	TBuf(const TDesC& aDes) : TBuf16<S>(aDes) {}
+	};
+
+template <class T>
+class THostLitC : public THostPtrC<T>
+	{
+public:
+	THostLitC(const T* aPtr, TInt aLength) : THostPtrC<T>(aPtr, aLength) {}
+	const THostDesC<T>& operator()() const { return *this; }
+	};
+
+#define _LIT8(name, s) \
+	static const THostLitC<TUint8> name((const TUint8*)s, sizeof(s) - 1)
+#define _LIT16(name, s) \
+	static const THostLitC<TText> name(L##s, sizeof(L##s) / sizeof(TText) - 1)
+#define _LIT(name, s) _LIT16(name, s)
+#define _L8(s) TPtrC8((const TUint8*)s, sizeof(s) - 1)
+#define _L(s) TPtrC16(L##s, sizeof(L##s) / sizeof(TText) - 1)
+
+_LIT8(KNullDesC8, "");
+_LIT(KNullDesC, "");
+
+template <class T>
+TInt THostDesC<T>::Compare(const THostDesC<T>& aDes) const
+	{
+	TInt len = (iLength < aDes.iLength) ? iLength : aDes.iLength;
+	for (TInt i = 0; i < len; i++)
+		{
+		if (iPtr[i] != aDes.iPtr[i])
+			return (iPtr[i] < aDes.iPtr[i]) ? -1 : 1;
+		}
+	return iLength - aDes.iLength;
+	}
+
+template <class T>
+TInt THostDesC<T>::Locate(T aChar) const
+	{
+	for (TInt i = 0; i < iLength; i++)
+		{
+		if (iPtr[i] == aChar)
+			return i;
+		}
+	return KErrNotFound;
+	}
+
+template <class T>
+TInt THostDesC<T>::Find(const THostDesC<T>& aDes) const
+	{
+	TInt len = aDes.Length();
+	for (TInt i = 0; i + len <= iLength; i++)
+		{
+		if (memcmp(iPtr + i, aDes.Ptr(), len * sizeof(T)) == 0)
+			return i;
+		}
+	return KErrNotFound;
+	}
+
+template <class T>
+THostPtrC<T> THostDesC<T>::Left(TInt aLength) const
+	{ return THostPtrC<T>(iPtr, aLength); }
+
+template <class T>
+THostPtrC<T> THostDesC<T>::Right(TInt aLength) const
+	{ return THostPtrC<T>(iPtr + iLength - aLength, aLength); }
+
+template <class T>
+THostPtrC<T> THostDesC<T>::Mid(TInt aPos) const
+	{ return THostPtrC<T>(iPtr + aPos, iLength - aPos); }
+
+template <class T>
+THostPtrC<T> THostDesC<T>::Mid(TInt aPos, TInt aLength) const
+	{ return THostPtrC<T>(iPtr + aPos, aLength); }
+
+template <class T>
+THostPtr<T> THostDes<T>::MidTPtr(TInt aPos) const
+	{
+	return THostPtr<T>(this->iPtr + aPos, this->iLength - aPos,
+					   iMaxLength - aPos);
+	}
+
+// --------------------------------------------------------------------
+// time...
+
+class TTimeIntervalMicroSeconds32
+	{
+public:
+	TTimeIntervalMicroSeconds32() : iInterval(0) {}
+	TTimeIntervalMicroSeconds32(TInt aInterval) : iInterval(aInterval) {}
+	TInt Int() const { return iInterval; }
+private:
+	TInt iInterval;
+	};
+
+class CHostTimer;
+
+/** Backed by a timerfd, which is registered with the reactor of
+	the thread that first makes a request with the timer.
+*/
+class RTimer
+	{
+public:
+	RTimer() : iImpl(NULL) {}
+	TInt CreateLocal();
+	void After(TRequestStatus& aStatus, TTimeIntervalMicroSeconds32 aInterval);
+	void Cancel();
+	void Close();
+	TInt Handle() const { return iImpl ? 1 : 0; }
+private:
+	CHostTimer* iImpl;
+	};
+
+// --------------------------------------------------------------------
+// User, Mem...
+
+class User
+	{
+public:
+	static void Leave(TInt aReason);
+	static void LeaveNoMemory();
+	static TInt LeaveIfError(TInt aReason);
+	static TAny* LeaveIfNull(TAny* aPtr);
+	static TAny* Alloc(TInt aSize);
+	static TAny* AllocL(TInt aSize);
+	static void Free(TAny* aCell);
+	static void Panic(const TDesC& aCategory, TInt aReason);
+	static void RequestComplete(TRequestStatus*& aStatus, TInt aReason);
+	static void WaitForRequest(TRequestStatus& aStatus);
+	// waits until some request of this thread has completed
+	static void WaitForAnyRequest();
+	static void After(TInt aMicroSeconds);
+	// one tick per millisecond on the host
+	static TUint TickCount();
+	// monotonic, in microseconds; host only
+	static TInt64 HostTimeNow();
+	};
+
+class UserHal
+	{
+public:
+	static TInt TickPeriod(TTimeIntervalMicroSeconds32& aTime)
+		{ aTime = 1000; return KErrNone; }
+	};
+
+class Mem
+	{
+public:
+	static void FillZ(TAny* aPtr, TInt aLength) { memset(aPtr, 0, aLength); }
+	static void Fill(TAny* aPtr, TInt aLength, TUint8 aChar)
+		{ memset(aPtr, aChar, aLength); }
+	static TUint8* Copy(TAny* aTrg, const TAny* aSrc, TInt aLength)
+		{ memmove(aTrg, aSrc, aLength); return (TUint8*)aTrg + aLength; }
+	static TInt Compare(const TUint8* aLeft, TInt aLeftL,
+						const TUint8* aRight, TInt aRightL)
+		{
+		TInt n = memcmp(aLeft, aRight, (aLeftL < aRightL) ? aLeftL : aRightL);
+		return n ? n : (aLeftL - aRightL);
+		}
+	};
+
+// --------------------------------------------------------------------
+// threads...
+
+enum TOwnerType
+	{
+	EOwnerProcess,
+	EOwnerThread
+	};
+
+class TThreadId
+	{
+public:
+	TThreadId() : iId(0) {}
+	explicit TThreadId(TUint64 aId) : iId(aId) {}
+	TBool operator==(const TThreadId& aId) const { return iId == aId.iId; }
+	TBool operator!=(const TThreadId& aId) const { return iId != aId.iId; }
+	TUint64 Id() const { return iId; }
+private:
+	TUint64 iId;
+	};
+
+/** Only supports referring to the current thread, and to other
+	threads that have an active scheduler (for the purposes of
+	completing requests).
+*/
+class RThread
+	{
+public:
+	RThread();
+	TThreadId Id() const { return iId; }
+	TInt Open(TThreadId aId, TOwnerType aType = EOwnerProcess);
+	void RequestComplete(TRequestStatus*& aStatus, TInt aReason) const;
+	void Close() {}
+private:
+	TThreadId iId;
+	};
+
+/** Thread local storage; on Symbian there is one slot per DLL and
+	thread, here just one per thread.
+*/
+class Dll
+	{
+public:
+	static TInt SetTls(TAny* aPtr);
+	static TAny* Tls();
+	};
+
+template <class T>
+THostHBufC<T>* THostHBufC<T>::New(TInt aMaxLength)
+	{
+	TAny* cell = ::operator new(sizeof(THostHBufC<T>) + aMaxLength * sizeof(T),
+								std::nothrow);
+	if (!cell)
+		return NULL;
+	return new (cell) THostHBufC<T>(aMaxLength);
+	}
+
+template <class T>
+THostHBufC<T>* THostHBufC<T>::NewL(TInt aMaxLength)
+	{
+	THostHBufC<T>* buf = New(aMaxLength);
+	if (!buf)
+		User::LeaveNoMemory();
+	return buf;
+	}
+
+#endif // __E32STD_H__
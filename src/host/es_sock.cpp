@@ -0,0 +1,971 @@
+// -*- symbian-c++ -*-
+
+//
+// es_sock.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <in_sock.h>
+#include <f32file.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "hostsocket.h"
+
+static void ToSockaddr(const TSockAddr& aAddr, struct sockaddr_in& aResult)
+	{
+	TInetAddr addr(aAddr);
+	memset(&aResult, 0, sizeof(aResult));
+	aResult.sin_family = AF_INET;
+	aResult.sin_port = htons(addr.Port());
+	aResult.sin_addr.s_addr = htonl(addr.Address());
+	}
+
+// --------------------------------------------------------------------
+// CHostSocket...
+
+CHostSocket* CHostSocket::New(TInt aFd)
+	{
+	return new CHostSocket(aFd);
+	}
+
+CHostSocket::CHostSocket(TInt aFd) :
+	iFd(aFd)
+	{
+	}
+
+CHostSocket::~CHostSocket()
+	{
+	CancelConnect();
+	CancelAccept();
+	CancelWrite();
+	CancelRecv();
+	if (iAcceptingFor)
+		{
+		iAcceptingFor->AbortAccept();
+		}
+	if (iFd >= 0)
+		{
+		Unregister();
+		close(iFd);
+		}
+	}
+
+TInt CHostSocket::Register()
+	{
+	if (iScheduler)
+		{
+		return KErrNone;
+		}
+	if (iFd < 0)
+		{
+		return KErrNotReady;
+		}
+	CActiveScheduler& scheduler = CActiveScheduler::HostCurrent();
+	TInt error = scheduler.Reactor().Add(
+		iFd, *this, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+	if (!error)
+		{
+		iScheduler = &scheduler;
+		}
+	return error;
+	}
+
+void CHostSocket::Unregister()
+	{
+	if (iScheduler)
+		{
+		iScheduler->Reactor().Remove(iFd);
+		iScheduler = NULL;
+		}
+	}
+
+void CHostSocket::Complete(TRequestStatus*& aStatus, TInt aError)
+	{
+	CActiveScheduler::HostCurrent().RequestComplete(*aStatus, aError);
+	aStatus = NULL;
+	}
+
+void CHostSocket::FdReady(TUint32 aEvents)
+	{
+	// Requests are only ever pending if they could not proceed
+	// right away, so just retry whatever is pending.
+	if (aEvents & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+		{
+		if (iConnectStatus) TryConnect();
+		if (iSendDes) TrySend();
+		if (iSendFileLen) TrySendFile();
+		}
+	if (aEvents & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+		{
+		if (iAcceptStatus && !iAcceptOp.IsPending()) TryAccept();
+		// sending a file registers us with the reactor even with the ring
+		if (iRecvDes && !iRecvOp.IsPending()) TryRecv();
+		}
+	}
+
+void CHostSocket::RingComplete(THostRingOp& aOp, TInt aResult)
+	{
+	if (&aOp == &iRecvOp)
+		{
+		RingRecvComplete(aResult);
+		}
+	else if (&aOp == &iSendOp)
+		{
+		RingSendComplete(aResult);
+		}
+	else
+		{
+		RingAcceptComplete(aResult);
+		}
+	}
+
+TInt CHostSocket::Bind(const TSockAddr& aAddr)
+	{
+	struct sockaddr_in addr;
+	ToSockaddr(aAddr, addr);
+	TInt on = 1;
+	setsockopt(iFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(iFd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	return KErrNone;
+	}
+
+TInt CHostSocket::Listen(TUint aQSize)
+	{
+	if (listen(iFd, aQSize) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	return KErrNone;
+	}
+
+TUint CHostSocket::LocalPort() const
+	{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	if (getsockname(iFd, (struct sockaddr*)&addr, &len) < 0)
+		{
+		return 0;
+		}
+	return ntohs(addr.sin_port);
+	}
+
+// ----------------------------------------
+// connecting...
+
+void CHostSocket::Connect(const TSockAddr& aAddr, TRequestStatus& aStatus)
+	{
+	aStatus = KRequestPending;
+	iConnectStatus = &aStatus;
+	TInt error = Register();
+	if (error)
+		{
+		Complete(iConnectStatus, error);
+		return;
+		}
+	struct sockaddr_in addr;
+	ToSockaddr(aAddr, addr);
+	if (connect(iFd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+		{
+		ConnectDone(KErrNone);
+		}
+	else if (errno != EINPROGRESS && errno != EINTR)
+		{
+		ConnectDone(HostErrorFromErrno(errno));
+		}
+	}
+
+void CHostSocket::ConnectDone(TInt aError)
+	{
+	// the ring does not need readiness events, and we do not want
+	// to be woken up by them either
+	if (CActiveScheduler::HostCurrent().Ring())
+		{
+		Unregister();
+		}
+	Complete(iConnectStatus, aError);
+	}
+
+void CHostSocket::TryConnect()
+	{
+	TInt soError = 0;
+	socklen_t len = sizeof(soError);
+	if (getsockopt(iFd, SOL_SOCKET, SO_ERROR, &soError, &len) < 0)
+		{
+		soError = errno;
+		}
+	if (soError == 0)
+		{
+		// an edge may come before the connect has finished
+		struct sockaddr_in addr;
+		len = sizeof(addr);
+		if (getpeername(iFd, (struct sockaddr*)&addr, &len) < 0)
+			{
+			return;
+			}
+		}
+	ConnectDone(HostErrorFromErrno(soError));
+	}
+
+void CHostSocket::CancelConnect()
+	{
+	if (iConnectStatus)
+		{
+		ConnectDone(KErrCancel);
+		}
+	}
+
+// ----------------------------------------
+// accepting...
+
+void CHostSocket::Accept(CHostSocket& aBlank, TRequestStatus& aStatus)
+	{
+	aStatus = KRequestPending;
+	iAcceptStatus = &aStatus;
+	if (aBlank.iFd >= 0 || aBlank.iAcceptingFor)
+		{
+		Complete(iAcceptStatus, KErrInUse);
+		return;
+		}
+	iAcceptBlank = &aBlank;
+	aBlank.iAcceptingFor = this;
+	iRing = CActiveScheduler::HostCurrent().Ring();
+	if (iRing)
+		{
+		iRing->Accept(iAcceptOp, *this, iFd);
+		return;
+		}
+	TInt error = Register();
+	if (error)
+		{
+		AcceptDone(-1, error);
+		return;
+		}
+	TryAccept();
+	}
+
+void CHostSocket::TryAccept()
+	{
+	TInt fd;
+	do
+		{
+		fd = accept4(iFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		}
+	while (fd < 0 && errno == EINTR);
+	if (fd < 0)
+		{
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+			return;
+			}
+		AcceptDone(-1, HostErrorFromErrno(errno));
+		return;
+		}
+	AcceptDone(fd, KErrNone);
+	}
+
+void CHostSocket::RingAcceptComplete(TInt aResult)
+	{
+	if (aResult >= 0)
+		{
+		AcceptDone(aResult, KErrNone);
+		}
+	else if (aResult == -ECANCELED)
+		{
+		AcceptDone(-1, KErrCancel);
+		}
+	else if ((aResult == -EINTR || aResult == -EAGAIN) &&
+			 !iAcceptOp.IsCancelled())
+		{
+		iRing->Accept(iAcceptOp, *this, iFd);
+		}
+	else
+		{
+		AcceptDone(-1, HostErrorFromErrno(-aResult));
+		}
+	}
+
+/** Hands over the accepted descriptor, if any, to the blank socket,
+	and completes the request.
+*/
+void CHostSocket::AcceptDone(TInt aFd, TInt aError)
+	{
+	if (!iAcceptBlank)
+		{
+		// the blank socket is gone
+		if (aFd >= 0)
+			{
+			close(aFd);
+			}
+		aError = KErrCancel;
+		}
+	else
+		{
+		if (aFd >= 0)
+			{
+			TInt on = 1;
+			setsockopt(aFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			iAcceptBlank->iFd = aFd;
+			}
+		iAcceptBlank->iAcceptingFor = NULL;
+		iAcceptBlank = NULL;
+		}
+	Complete(iAcceptStatus, aError);
+	}
+
+void CHostSocket::AbortAccept()
+	{
+	iAcceptBlank = NULL;
+	CancelAccept();
+	}
+
+void CHostSocket::CancelAccept()
+	{
+	if (iAcceptOp.IsPending())
+		{
+		// completes as usual
+		iRing->Cancel(iAcceptOp);
+		}
+	else if (iAcceptStatus)
+		{
+		AcceptDone(-1, KErrCancel);
+		}
+	}
+
+// ----------------------------------------
+// sending...
+
+void CHostSocket::Write(const TDesC8& aDesc, TRequestStatus& aStatus)
+	{
+	iSendOne.Set(aDesc);
+	Writev(&iSendOne, 1, aStatus);
+	}
+
+void CHostSocket::Writev(const TPtrC8* aDescs, TInt aCount,
+						 TRequestStatus& aStatus)
+	{
+	aStatus = KRequestPending;
+	iSendStatus = &aStatus;
+	iSendDes = aDescs;
+	iSendCount = aCount;
+	iSendIndex = 0;
+	iSendDone = 0;
+	iRing = CActiveScheduler::HostCurrent().Ring();
+	if (iRing)
+		{
+		SubmitSend();
+		return;
+		}
+	TInt error = Register();
+	if (error)
+		{
+		SendDone(error);
+		return;
+		}
+	TrySend();
+	}
+
+// Fills in iSendIov from where we are, skipping empty buffers,
+// and returns the number of entries, zero once all has gone.
+TInt CHostSocket::PrepareIov()
+	{
+	TInt count = 0;
+	TInt done = iSendDone;
+	for (TInt i = iSendIndex; i < iSendCount && count < KMaxSendIov; i++)
+		{
+		const TPtrC8& des = iSendDes[i];
+		if (des.Length() > done)
+			{
+			iSendIov[count].iov_base =
+				const_cast<TUint8*>(des.Ptr()) + done;
+			iSendIov[count].iov_len = des.Length() - done;
+			count++;
+			}
+		done = 0;
+		}
+	memset(&iSendMsg, 0, sizeof(iSendMsg));
+	iSendMsg.msg_iov = iSendIov;
+	iSendMsg.msg_iovlen = count;
+	return count;
+	}
+
+void CHostSocket::AdvanceSend(TInt aCount)
+	{
+	while (iSendIndex < iSendCount)
+		{
+		TInt left = iSendDes[iSendIndex].Length() - iSendDone;
+		if (aCount < left)
+			{
+			iSendDone += aCount;
+			return;
+			}
+		aCount -= left;
+		iSendIndex++;
+		iSendDone = 0;
+		}
+	}
+
+void CHostSocket::TrySend()
+	{
+	TInt count;
+	while ((count = PrepareIov()) > 0)
+		{
+		ssize_t n = (count == 1) ?
+			send(iFd, iSendIov[0].iov_base, iSendIov[0].iov_len,
+				 MSG_NOSIGNAL) :
+			sendmsg(iFd, &iSendMsg, MSG_NOSIGNAL);
+		if (n < 0)
+			{
+			if (errno == EINTR)
+				{
+				continue;
+				}
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+				return;
+				}
+			SendDone(HostErrorFromErrno(errno));
+			return;
+			}
+		AdvanceSend(n);
+		}
+	SendDone(KErrNone);
+	}
+
+void CHostSocket::SubmitSend()
+	{
+	TInt count = PrepareIov();
+	if (count == 0)
+		{
+		SendDone(KErrNone);
+		return;
+		}
+	if (count == 1)
+		{
+		iRing->Send(iSendOp, *this, iFd,
+					static_cast<const TUint8*>(iSendIov[0].iov_base),
+					iSendIov[0].iov_len);
+		return;
+		}
+	iRing->SendMsg(iSendOp, *this, iFd, &iSendMsg);
+	}
+
+void CHostSocket::RingSendComplete(TInt aResult)
+	{
+	if (aResult >= 0)
+		{
+		AdvanceSend(aResult);
+		if (iSendOp.IsCancelled())
+			{
+			SendDone(KErrCancel);
+			}
+		else
+			{
+			// a partial write simply gets continued
+			SubmitSend();
+			}
+		}
+	else if (aResult == -ECANCELED)
+		{
+		SendDone(KErrCancel);
+		}
+	else if ((aResult == -EINTR || aResult == -EAGAIN) &&
+			 !iSendOp.IsCancelled())
+		{
+		SubmitSend();
+		}
+	else
+		{
+		SendDone(HostErrorFromErrno(-aResult));
+		}
+	}
+
+void CHostSocket::SendDone(TInt aError)
+	{
+	iSendDes = NULL;
+	Complete(iSendStatus, aError);
+	}
+
+void CHostSocket::CancelWrite()
+	{
+	if (iSendFileLen)
+		{
+		SendFileDone(KErrCancel);
+		}
+	else if (iSendOp.IsPending())
+		{
+		// completes as usual
+		iRing->Cancel(iSendOp);
+		}
+	else if (iSendStatus)
+		{
+		SendDone(KErrCancel);
+		}
+	}
+
+// ----------------------------------------
+// sending files...
+
+void CHostSocket::SendFile(TInt aFileFd, TInt aOffset, TInt aCount,
+						   TRequestStatus& aStatus, TSockXfrLength& aSent)
+	{
+	aStatus = KRequestPending;
+	iSendStatus = &aStatus;
+	iSendFileLen = &aSent;
+	iSendFileFd = aFileFd;
+	iSendFileOffset = aOffset;
+	iSendFileLeft = aCount;
+	aSent() = 0;
+	TInt error = Register();
+	if (error)
+		{
+		SendFileDone(error);
+		return;
+		}
+	TrySendFile();
+	}
+
+void CHostSocket::TrySendFile()
+	{
+	while (iSendFileLeft > 0)
+		{
+		off_t offset = iSendFileOffset;
+		ssize_t n = sendfile(iFd, iSendFileFd, &offset, iSendFileLeft);
+		if (n < 0)
+			{
+			if (errno == EINTR)
+				{
+				continue;
+				}
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+				return;
+				}
+			SendFileDone(HostErrorFromErrno(errno));
+			return;
+			}
+		if (n == 0)
+			{
+			// the file is shorter than expected
+			SendFileDone(KErrEof);
+			return;
+			}
+		iSendFileOffset += n;
+		iSendFileLeft -= n;
+		(*iSendFileLen)() += n;
+		}
+	SendFileDone(KErrNone);
+	}
+
+void CHostSocket::SendFileDone(TInt aError)
+	{
+	iSendFileLen = NULL;
+	// as after a connect
+	if (CActiveScheduler::HostCurrent().Ring())
+		{
+		Unregister();
+		}
+	Complete(iSendStatus, aError);
+	}
+
+// ----------------------------------------
+// receiving...
+
+void CHostSocket::Recv(TDes8& aDesc, TBool aOneOrMore,
+					   TRequestStatus& aStatus, TSockXfrLength* aLen)
+	{
+	aStatus = KRequestPending;
+	iRecvStatus = &aStatus;
+	iRecvDes = &aDesc;
+	iRecvDone = 0;
+	iRecvOneOrMore = aOneOrMore;
+	iRecvLen = aLen;
+	iRing = CActiveScheduler::HostCurrent().Ring();
+	if (iRing)
+		{
+		SubmitRecv();
+		return;
+		}
+	TInt error = Register();
+	if (error)
+		{
+		RecvDone(error);
+		return;
+		}
+	TryRecv();
+	}
+
+void CHostSocket::TryRecv()
+	{
+	TInt error = KErrNone;
+	TInt maxLength = iRecvDes->MaxLength();
+	while (iRecvDone < maxLength)
+		{
+		ssize_t n = recv(iFd, const_cast<TUint8*>(iRecvDes->Ptr()) + iRecvDone,
+						 maxLength - iRecvDone, 0);
+		if (n > 0)
+			{
+			iRecvDone += n;
+			if (iRecvOneOrMore)
+				{
+				break;
+				}
+			}
+		else if (n == 0)
+			{
+			error = KErrEof;
+			break;
+			}
+		else if (errno == EINTR)
+			{
+			continue;
+			}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+			return;
+			}
+		else
+			{
+			error = HostErrorFromErrno(errno);
+			break;
+			}
+		}
+	RecvDone(error);
+	}
+
+void CHostSocket::SubmitRecv()
+	{
+	TInt maxLength = iRecvDes->MaxLength();
+	if (iRecvDone >= maxLength)
+		{
+		RecvDone(KErrNone);
+		return;
+		}
+	iRing->Recv(iRecvOp, *this, iFd,
+				const_cast<TUint8*>(iRecvDes->Ptr()) + iRecvDone,
+				maxLength - iRecvDone);
+	}
+
+void CHostSocket::RingRecvComplete(TInt aResult)
+	{
+	if (aResult > 0)
+		{
+		iRecvDone += aResult;
+		if (iRecvOneOrMore || iRecvDone >= iRecvDes->MaxLength())
+			{
+			RecvDone(KErrNone);
+			}
+		else if (iRecvOp.IsCancelled())
+			{
+			RecvDone(KErrCancel);
+			}
+		else
+			{
+			SubmitRecv();
+			}
+		}
+	else if (aResult == 0)
+		{
+		RecvDone(KErrEof);
+		}
+	else if (aResult == -ECANCELED)
+		{
+		RecvDone(KErrCancel);
+		}
+	else if ((aResult == -EINTR || aResult == -EAGAIN) &&
+			 !iRecvOp.IsCancelled())
+		{
+		SubmitRecv();
+		}
+	else
+		{
+		RecvDone(HostErrorFromErrno(-aResult));
+		}
+	}
+
+void CHostSocket::RecvDone(TInt aError)
+	{
+	iRecvDes->SetLength(iRecvDone);
+	if (iRecvLen)
+		{
+		(*iRecvLen)() = iRecvDone;
+		}
+	iRecvDes = NULL;
+	Complete(iRecvStatus, aError);
+	}
+
+void CHostSocket::CancelRecv()
+	{
+	if (iRecvOp.IsPending())
+		{
+		// completes as usual
+		iRing->Cancel(iRecvOp);
+		}
+	else if (iRecvStatus)
+		{
+		iRecvDes = NULL;
+		Complete(iRecvStatus, KErrCancel);
+		}
+	}
+
+TInt CHostSocket::Shutdown(RSocket::TShutdown aHow)
+	{
+	TInt how;
+	switch (aHow)
+		{
+		case RSocket::EStopInput:
+			how = SHUT_RD;
+			break;
+		case RSocket::EStopOutput:
+			how = SHUT_WR;
+			break;
+		default:
+			how = SHUT_RDWR;
+			break;
+		}
+	if (shutdown(iFd, how) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	return KErrNone;
+	}
+
+/** The next request registers us with the reactor of whichever
+	thread makes it.
+*/
+void CHostSocket::Detach()
+	{
+	Unregister();
+	iRing = NULL;
+	}
+
+// --------------------------------------------------------------------
+// RSocket...
+
+TInt RSocket::Open(RSocketServ& /*aServer*/, TUint aAddrFamily,
+				   TUint aSockType, TUint /*aProtocol*/)
+	{
+	if (aAddrFamily != KAfInet)
+		{
+		return KErrNotSupported;
+		}
+	TInt type = (aSockType == KSockDatagram) ? SOCK_DGRAM : SOCK_STREAM;
+	TInt fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	if (type == SOCK_STREAM)
+		{
+		TInt on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		}
+	iImpl = CHostSocket::New(fd);
+	if (!iImpl)
+		{
+		close(fd);
+		return KErrNoMemory;
+		}
+	return KErrNone;
+	}
+
+TInt RSocket::Open(RSocketServ& aServer, TUint aAddrFamily,
+				   TUint aSockType, TUint aProtocol,
+				   RConnection& /*aConnection*/)
+	{
+	return Open(aServer, aAddrFamily, aSockType, aProtocol);
+	}
+
+TInt RSocket::Open(RSocketServ& /*aServer*/)
+	{
+	iImpl = CHostSocket::New(-1);
+	return iImpl ? KErrNone : KErrNoMemory;
+	}
+
+void RSocket::Close()
+	{
+	delete iImpl;
+	iImpl = NULL;
+	}
+
+TInt RSocket::Bind(TSockAddr& aAddr)
+	{
+	return iImpl->Bind(aAddr);
+	}
+
+TInt RSocket::Listen(TUint aQSize)
+	{
+	return iImpl->Listen(aQSize);
+	}
+
+TUint RSocket::LocalPort()
+	{
+	return iImpl->LocalPort();
+	}
+
+void RSocket::Connect(TSockAddr& aAddr, TRequestStatus& aStatus)
+	{
+	iImpl->Connect(aAddr, aStatus);
+	}
+
+void RSocket::CancelConnect()
+	{
+	iImpl->CancelConnect();
+	}
+
+void RSocket::Accept(RSocket& aBlankSocket, TRequestStatus& aStatus)
+	{
+	iImpl->Accept(*aBlankSocket.iImpl, aStatus);
+	}
+
+void RSocket::CancelAccept()
+	{
+	iImpl->CancelAccept();
+	}
+
+void RSocket::Write(const TDesC8& aDesc, TRequestStatus& aStatus)
+	{
+	iImpl->Write(aDesc, aStatus);
+	}
+
+void RSocket::HostWritev(const TPtrC8* aDescs, TInt aCount,
+						 TRequestStatus& aStatus)
+	{
+	iImpl->Writev(aDescs, aCount, aStatus);
+	}
+
+void RSocket::HostSendFile(const RFile& aFile, TInt aOffset, TInt aCount,
+						   TRequestStatus& aStatus, TSockXfrLength& aSent)
+	{
+	iImpl->SendFile(aFile.HostFd(), aOffset, aCount, aStatus, aSent);
+	}
+
+void RSocket::CancelWrite()
+	{
+	iImpl->CancelWrite();
+	}
+
+void RSocket::Recv(TDes8& aDesc, TUint /*aFlags*/, TRequestStatus& aStatus)
+	{
+	iImpl->Recv(aDesc, EFalse, aStatus, NULL);
+	}
+
+void RSocket::RecvOneOrMore(TDes8& aDesc, TUint /*aFlags*/,
+							TRequestStatus& aStatus, TSockXfrLength& aLen)
+	{
+	iImpl->Recv(aDesc, ETrue, aStatus, &aLen);
+	}
+
+void RSocket::CancelRecv()
+	{
+	iImpl->CancelRecv();
+	}
+
+void RSocket::Shutdown(TShutdown aHow, TRequestStatus& aStatus)
+	{
+	TInt error = iImpl->Shutdown(aHow);
+	TRequestStatus* status = &aStatus;
+	User::RequestComplete(status, error);
+	}
+
+void RSocket::CancelAll()
+	{
+	iImpl->CancelConnect();
+	iImpl->CancelAccept();
+	iImpl->CancelWrite();
+	iImpl->CancelRecv();
+	}
+
+void RSocket::HostDetach()
+	{
+	iImpl->Detach();
+	}
+
+// --------------------------------------------------------------------
+// RHostResolver...
+
+TInt RHostResolver::Open(RSocketServ& /*aServer*/, TUint aAddrFamily,
+						 TUint /*aProtocol*/)
+	{
+	if (aAddrFamily != KAfInet)
+		{
+		return KErrNotSupported;
+		}
+	iHandle = 1;
+	return KErrNone;
+	}
+
+TInt RHostResolver::Open(RSocketServ& aServer, TUint aAddrFamily,
+						 TUint aProtocol, RConnection& /*aConnection*/)
+	{
+	return Open(aServer, aAddrFamily, aProtocol);
+	}
+
+/** Note that this blocks the calling thread for the duration of
+	the lookup, which is typically only an issue with slow DNS.
+*/
+void RHostResolver::GetByName(const TDesC& aName, TNameEntry& aResult,
+							  TRequestStatus& aStatus)
+	{
+	aStatus = KRequestPending;
+	TRequestStatus* status = &aStatus;
+
+	// host names are ASCII anyway
+	char name[256];
+	TInt len = (aName.Length() < 255) ? aName.Length() : 255;
+	for (TInt i = 0; i < len; i++)
+		{
+		name[i] = (char)aName[i];
+		}
+	name[len] = '\0';
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo* info = NULL;
+	if (getaddrinfo(name, NULL, &hints, &info) != 0 || !info)
+		{
+		User::RequestComplete(status, KErrNotFound);
+		return;
+		}
+	struct sockaddr_in* addr = (struct sockaddr_in*)info->ai_addr;
+	aResult().iName.Copy(aName.Left(len));
+	aResult().iAddr = TInetAddr(ntohl(addr->sin_addr.s_addr), 0);
+	freeaddrinfo(info);
+	User::RequestComplete(status, KErrNone);
+	}
@@ -0,0 +1,213 @@
+// -*- symbian-c++ -*-
+
+//
+// es_sock.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __ES_SOCK_H__
+#define __ES_SOCK_H__
+
+#include <e32base.h>
+
+const TUint KAfInet = 0x0800;
+const TUint KSockStream = 1;
+const TUint KSockDatagram = 2;
+const TUint KUndefinedProtocol = 0xFFFFFFFE;
+
+// --------------------------------------------------------------------
+// addresses...
+
+/** On Symbian this is a descriptor with a family specific layout.
+	Here we only support IPv4, and keep the fields as such.
+*/
+class TSockAddr
+	{
+public:
+	TSockAddr() : iFamily(0), iPort(0), iAddress(0) {}
+	explicit TSockAddr(TUint aFamily) :
+		iFamily(aFamily), iPort(0), iAddress(0) {}
+	TUint Family() const { return iFamily; }
+	void SetFamily(TUint aFamily) { iFamily = aFamily; }
+	TUint Port() const { return iPort; }
+	void SetPort(TUint aPort) { iPort = aPort; }
+protected:
+	TUint iFamily;
+	TUint iPort;
+	TUint32 iAddress; // in host byte order, for KAfInet
+	};
+
+typedef TBuf<256> THostName;
+
+class TNameRecord
+	{
+public:
+	TNameRecord() : iFlags(0) {}
+	THostName iName;
+	TSockAddr iAddr;
+	TInt iFlags;
+	};
+
+/** Stands in for TPckgBuf<TNameRecord>.
+*/
+class TNameEntry
+	{
+public:
+	TNameRecord& operator()() { return iRecord; }
+	const TNameRecord& operator()() const { return iRecord; }
+private:
+	TNameRecord iRecord;
+	};
+
+/** Stands in for TPckgBuf<TInt>.
+*/
+class TSockXfrLength
+	{
+public:
+	TSockXfrLength() : iLength(0) {}
+	TInt& operator()() { return iLength; }
+	TInt operator()() const { return iLength; }
+private:
+	TInt iLength;
+	};
+
+// --------------------------------------------------------------------
+// sessions...
+
+/** There is no socket server on the host, so a session is merely
+	a flag.
+*/
+class RSocketServ
+	{
+public:
+	RSocketServ() : iHandle(0) {}
+	TInt Connect() { iHandle = 1; return KErrNone; }
+	// sessions may always be used by any thread
+	TInt ShareAuto() { return KErrNone; }
+	void Close() { iHandle = 0; }
+	TInt Handle() const { return iHandle; }
+private:
+	TInt iHandle;
+	};
+
+class TCommDbConnPref;
+
+/** Access points have no meaning on the host, so this is a no-op.
+*/
+class RConnection
+	{
+public:
+	RConnection() : iHandle(0) {}
+	TInt Open(RSocketServ& /*aServ*/) { iHandle = 1; return KErrNone; }
+	TInt Start() { return KErrNone; }
+	TInt Start(TCommDbConnPref& /*aPref*/) { return KErrNone; }
+	void Close() { iHandle = 0; }
+	TInt SubSessionHandle() const { return iHandle; }
+private:
+	TInt iHandle;
+	};
+
+class CHostSocket;
+class RFile;
+
+/** Does not need to be closed or zeroed after Close(), but may be,
+	as SET_SESSION_CLOSED does.
+*/
+class RSocket
+	{
+public:
+	enum TShutdown
+		{
+		ENormal,
+		EStopInput,
+		EStopOutput,
+		EImmediate
+		};
+public:
+	RSocket() : iImpl(NULL) {}
+	TInt Open(RSocketServ& aServer, TUint aAddrFamily,
+			  TUint aSockType, TUint aProtocol);
+	TInt Open(RSocketServ& aServer, TUint aAddrFamily,
+			  TUint aSockType, TUint aProtocol,
+			  RConnection& aConnection);
+	// opens a blank socket, for use with Accept()
+	TInt Open(RSocketServ& aServer);
+	void Close();
+	TInt SubSessionHandle() const { return iImpl ? 1 : 0; }
+
+	TInt Bind(TSockAddr& aAddr);
+	TInt Listen(TUint aQSize);
+	TUint LocalPort();
+	void Connect(TSockAddr& aAddr, TRequestStatus& aStatus);
+	void CancelConnect();
+	void Accept(RSocket& aBlankSocket, TRequestStatus& aStatus);
+	void CancelAccept();
+	void Write(const TDesC8& aDesc, TRequestStatus& aStatus);
+	void CancelWrite();
+	void Recv(TDes8& aDesc, TUint aFlags, TRequestStatus& aStatus);
+	void RecvOneOrMore(TDes8& aDesc, TUint aFlags,
+					   TRequestStatus& aStatus, TSockXfrLength& aLen);
+	void CancelRecv();
+	void Shutdown(TShutdown aHow, TRequestStatus& aStatus);
+	void CancelAll();
+
+	// host only
+	CHostSocket* HostImpl() const { return iImpl; }
+	// as Write() of all the buffers one after another, with gathered
+	// sends; the array must persist until the request completes
+	void HostWritev(const TPtrC8* aDescs, TInt aCount,
+					TRequestStatus& aStatus);
+	// sends aCount bytes of aFile from aOffset, as with Write(), with
+	// the number of bytes sent in aSent; completes with KErrEof if the
+	// file ends first
+	void HostSendFile(const RFile& aFile, TInt aOffset, TInt aCount,
+					  TRequestStatus& aStatus, TSockXfrLength& aSent);
+	// unregisters from the reactor of this thread, so that another
+	// thread may take over; there must be no requests pending
+	void HostDetach();
+private:
+	CHostSocket* iImpl;
+	};
+
+class RHostResolver
+	{
+public:
+	RHostResolver() : iHandle(0) {}
+	TInt Open(RSocketServ& aServer, TUint aAddrFamily, TUint aProtocol);
+	TInt Open(RSocketServ& aServer, TUint aAddrFamily, TUint aProtocol,
+			  RConnection& aConnection);
+	// resolves synchronously, completing the request right away
+	void GetByName(const TDesC& aName, TNameEntry& aResult,
+				   TRequestStatus& aStatus);
+	void Cancel() {}
+	void Close() { iHandle = 0; }
+	TInt SubSessionHandle() const { return iHandle; }
+private:
+	TInt iHandle;
+	};
+
+#endif // __ES_SOCK_H__
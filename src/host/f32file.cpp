@@ -0,0 +1,192 @@
+// -*- symbian-c++ -*-
+
+//
+// f32file.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <f32file.h>
+#include "hostreactor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------
+// RFile...
+
+/** Names are UTF-16 on Symbian; here they get encoded as UTF-8. */
+TInt RFile::OpenFd(const TDesC& aName, TUint aMode, TInt aFlags)
+	{
+	if (iFd >= 0)
+		{
+		return KErrInUse;
+		}
+	char name[1024];
+	TInt len = 0;
+	for (TInt i = 0; i < aName.Length(); i++)
+		{
+		TUint c = aName[i];
+		if (len + 4 >= (TInt)sizeof(name))
+			{
+			return KErrBadName;
+			}
+		if (c < 0x80)
+			{
+			name[len++] = (char)c;
+			}
+		else if (c < 0x800)
+			{
+			name[len++] = (char)(0xc0 | (c >> 6));
+			name[len++] = (char)(0x80 | (c & 0x3f));
+			}
+		else
+			{
+			name[len++] = (char)(0xe0 | (c >> 12));
+			name[len++] = (char)(0x80 | ((c >> 6) & 0x3f));
+			name[len++] = (char)(0x80 | (c & 0x3f));
+			}
+		}
+	name[len] = '\0';
+	TInt flags = aFlags | O_CLOEXEC |
+		((aMode & EFileWrite) ? O_RDWR : O_RDONLY);
+	TInt fd = open(name, flags, 0666);
+	if (fd < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	iFd = fd;
+	return KErrNone;
+	}
+
+TInt RFile::Open(RFs& /*aFs*/, const TDesC& aName, TUint aMode)
+	{
+	return OpenFd(aName, aMode, 0);
+	}
+
+TInt RFile::Create(RFs& /*aFs*/, const TDesC& aName, TUint aMode)
+	{
+	return OpenFd(aName, aMode, O_CREAT | O_EXCL);
+	}
+
+TInt RFile::Replace(RFs& /*aFs*/, const TDesC& aName, TUint aMode)
+	{
+	return OpenFd(aName, aMode, O_CREAT | O_TRUNC);
+	}
+
+TInt RFile::HostDuplicate(TInt aFd)
+	{
+	if (iFd >= 0)
+		{
+		return KErrInUse;
+		}
+	TInt fd = fcntl(aFd, F_DUPFD_CLOEXEC, 0);
+	if (fd < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	iFd = fd;
+	return KErrNone;
+	}
+
+void RFile::Close()
+	{
+	if (iFd >= 0)
+		{
+		close(iFd);
+		iFd = -1;
+		}
+	}
+
+TInt RFile::Read(TInt aPos, TDes8& aDes, TInt aLength) const
+	{
+	if (aLength > aDes.MaxLength())
+		{
+		aLength = aDes.MaxLength();
+		}
+	ssize_t n;
+	do
+		{
+		n = pread(iFd, const_cast<TUint8*>(aDes.Ptr()), aLength, aPos);
+		}
+	while (n < 0 && errno == EINTR);
+	if (n < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	aDes.SetLength(n);
+	return KErrNone;
+	}
+
+TInt RFile::Write(TInt aPos, const TDesC8& aDes)
+	{
+	TInt done = 0;
+	while (done < aDes.Length())
+		{
+		ssize_t n = pwrite(iFd, aDes.Ptr() + done, aDes.Length() - done,
+						   aPos + done);
+		if (n < 0)
+			{
+			if (errno == EINTR)
+				{
+				continue;
+				}
+			return HostErrorFromErrno(errno);
+			}
+		done += n;
+		}
+	return KErrNone;
+	}
+
+TInt RFile::Size(TInt& aSize) const
+	{
+	struct stat info;
+	if (fstat(iFd, &info) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	aSize = info.st_size;
+	return KErrNone;
+	}
+
+TInt RFile::SetSize(TInt aSize)
+	{
+	if (ftruncate(iFd, aSize) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	return KErrNone;
+	}
+
+TInt RFile::Flush()
+	{
+	if (fdatasync(iFd) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	return KErrNone;
+	}
@@ -0,0 +1,92 @@
+// -*- symbian-c++ -*-
+
+//
+// f32file.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __F32FILE_H__
+#define __F32FILE_H__
+
+#include <e32std.h>
+
+enum TFileMode
+	{
+	EFileShareExclusive = 0x0,
+	EFileShareReadersOnly = 0x1,
+	EFileShareAny = 0x2,
+	EFileStream = 0x0,
+	EFileStreamText = 0x100,
+	EFileRead = 0x0,
+	EFileWrite = 0x200
+	};
+
+/** There is no file server on the host, so a session is merely
+	a flag.
+*/
+class RFs
+	{
+public:
+	RFs() : iHandle(0) {}
+	TInt Connect() { iHandle = 1; return KErrNone; }
+	void Close() { iHandle = 0; }
+	TInt Handle() const { return iHandle; }
+private:
+	TInt iHandle;
+	};
+
+/** A file descriptor. Positioned reads and writes map to pread()
+	and pwrite(), so they do not move any file pointer. Sharing
+	modes are not enforced.
+*/
+class RFile
+	{
+public:
+	RFile() : iFd(-1) {}
+	TInt Open(RFs& aFs, const TDesC& aName, TUint aMode);
+	TInt Create(RFs& aFs, const TDesC& aName, TUint aMode);
+	TInt Replace(RFs& aFs, const TDesC& aName, TUint aMode);
+	void Close();
+	TInt SubSessionHandle() const { return (iFd >= 0) ? 1 : 0; }
+
+	TInt Read(TInt aPos, TDes8& aDes, TInt aLength) const;
+	TInt Write(TInt aPos, const TDesC8& aDes);
+	TInt Size(TInt& aSize) const;
+	TInt SetSize(TInt aSize);
+	TInt Flush();
+
+	// host only
+	TInt HostFd() const { return iFd; }
+	// opens a duplicate of the descriptor aFd
+	TInt HostDuplicate(TInt aFd);
+private:
+	TInt OpenFd(const TDesC& aName, TUint aMode, TInt aFlags);
+private:
+	TInt iFd;
+	};
+
+#endif // __F32FILE_H__
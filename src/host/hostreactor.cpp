@@ -0,0 +1,201 @@
+// -*- symbian-c++ -*-
+
+//
+// hostreactor.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "hostreactor.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+CHostReactor* CHostReactor::NewL()
+	{
+	CHostReactor* object = new (ELeave) CHostReactor;
+	CleanupStack::PushL(object);
+	object->ConstructL();
+	CleanupStack::Pop();
+	return object;
+	}
+
+void CHostReactor::ConstructL()
+	{
+	iEpollFd = -1;
+	iWakeFd = -1;
+	iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (iEpollFd < 0)
+		{
+		User::Leave(HostErrorFromErrno(errno));
+		}
+	iWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (iWakeFd < 0)
+		{
+		User::Leave(HostErrorFromErrno(errno));
+		}
+	// the wakeup fd is told apart by its NULL observer
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if (epoll_ctl(iEpollFd, EPOLL_CTL_ADD, iWakeFd, &event) < 0)
+		{
+		User::Leave(HostErrorFromErrno(errno));
+		}
+	}
+
+CHostReactor::~CHostReactor()
+	{
+	if (iWakeFd >= 0)
+		{
+		close(iWakeFd);
+		}
+	if (iEpollFd >= 0)
+		{
+		close(iEpollFd);
+		}
+	}
+
+TInt CHostReactor::Add(TInt aFd, MHostFdObserver& aObserver,
+					   TUint32 aEvents)
+	{
+	struct epoll_event event;
+	event.events = aEvents;
+	event.data.ptr = &aObserver;
+	if (epoll_ctl(iEpollFd, EPOLL_CTL_ADD, aFd, &event) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	return KErrNone;
+	}
+
+TInt CHostReactor::Modify(TInt aFd, MHostFdObserver& aObserver,
+						  TUint32 aEvents)
+	{
+	struct epoll_event event;
+	event.events = aEvents;
+	event.data.ptr = &aObserver;
+	if (epoll_ctl(iEpollFd, EPOLL_CTL_MOD, aFd, &event) < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	return KErrNone;
+	}
+
+void CHostReactor::Remove(TInt aFd)
+	{
+	struct epoll_event event; // for kernels older than 2.6.9
+	epoll_ctl(iEpollFd, EPOLL_CTL_DEL, aFd, &event);
+	}
+
+void CHostReactor::Wake()
+	{
+	TUint64 one = 1;
+	while (write(iWakeFd, &one, sizeof(one)) < 0 && errno == EINTR)
+		{
+		}
+	}
+
+TInt CHostReactor::Poll(TInt aTimeout)
+	{
+	struct epoll_event events[KMaxEvents];
+	TInt count = epoll_wait(iEpollFd, events, KMaxEvents, aTimeout);
+	if (count < 0)
+		{
+		// EINTR most likely; the caller will simply come back
+		return 0;
+		}
+	for (TInt i = 0; i < count; i++)
+		{
+		MHostFdObserver* observer =
+			static_cast<MHostFdObserver*>(events[i].data.ptr);
+		if (observer)
+			{
+			observer->FdReady(events[i].events);
+			}
+		else
+			{
+			TUint64 value;
+			while (read(iWakeFd, &value, sizeof(value)) < 0 &&
+				   errno == EINTR)
+				{
+				}
+			}
+		}
+	return count;
+	}
+
+// --------------------------------------------------------------------
+// error mapping...
+
+TInt HostErrorFromErrno(TInt aErrno)
+	{
+	switch (aErrno)
+		{
+		case 0:
+			return KErrNone;
+		case ENOMEM:
+		case ENOBUFS:
+			return KErrNoMemory;
+		case ECONNREFUSED:
+		case ENETUNREACH:
+		case EHOSTUNREACH:
+			return KErrCouldNotConnect;
+		case ETIMEDOUT:
+			return KErrTimedOut;
+		case ECONNRESET:
+		case ECONNABORTED:
+		case EPIPE:
+		case ENOTCONN:
+			return KErrDisconnected;
+		case EADDRINUSE:
+		case EISCONN:
+		case EALREADY:
+			return KErrInUse;
+		case EACCES:
+		case EPERM:
+			return KErrAccessDenied;
+		case EINVAL:
+			return KErrArgument;
+		case EBADF:
+			return KErrBadHandle;
+		case ENOENT:
+			return KErrNotFound;
+		case EEXIST:
+			return KErrAlreadyExists;
+		case ENOSPC:
+			return KErrDiskFull;
+		case EOPNOTSUPP:
+		case EAFNOSUPPORT:
+		case EPROTONOSUPPORT:
+			return KErrNotSupported;
+		case EMSGSIZE:
+			return KErrTooBig;
+		default:
+			return KErrGeneral;
+		}
+	}
@@ -0,0 +1,91 @@
+// -*- symbian-c++ -*-
+
+//
+// hostreactor.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __HOSTREACTOR_H__
+#define __HOSTREACTOR_H__
+
+#include <e32base.h>
+
+// --------------------------------------------------------------------
+// MHostFdObserver...
+
+/** Implemented by whatever owns a file descriptor that the reactor
+	watches. Observers must not run any user code (Python included)
+	from FdReady(); they should merely make progress with the
+	pending requests and complete them as appropriate.
+*/
+class MHostFdObserver
+	{
+public:
+	virtual void FdReady(TUint32 aEvents) = 0;
+	};
+
+// --------------------------------------------------------------------
+// CHostReactor...
+
+/** A thin wrapper for an epoll instance, plus an eventfd that
+	other threads may use to wake us up.
+*/
+NONSHARABLE_CLASS(CHostReactor) : public CBase
+	{
+public:
+	// how many events to take per epoll_wait
+	enum { KMaxEvents = 64 };
+public:
+	static CHostReactor* NewL();
+	~CHostReactor();
+
+	// the epoll descriptor
+	TInt Fd() const { return iEpollFd; }
+
+	// aEvents is a set of EPOLL* flags
+	TInt Add(TInt aFd, MHostFdObserver& aObserver, TUint32 aEvents);
+	TInt Modify(TInt aFd, MHostFdObserver& aObserver, TUint32 aEvents);
+	void Remove(TInt aFd);
+
+	// may be called from any thread
+	void Wake();
+
+	// waits for at most aTimeout milliseconds (-1 for no limit),
+	// and dispatches any events; returns the number of events
+	TInt Poll(TInt aTimeout);
+private:
+	CHostReactor() {}
+	void ConstructL();
+private:
+	TInt iEpollFd;
+	TInt iWakeFd;
+	};
+
+// maps an errno value to the closest Symbian error code
+TInt HostErrorFromErrno(TInt aErrno);
+
+#endif // __HOSTREACTOR_H__
@@ -0,0 +1,340 @@
+// -*- symbian-c++ -*-
+
+//
+// hostring.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "hostring.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include "hostreactor.h"
+
+// the number of submission queue entries to ask for
+const TUint KRingEntries = 256;
+
+// user data values that are not operations
+const TUint64 KEpollData = 0;
+const TUint64 KCancelData = 1;
+
+CHostRing* CHostRing::New(CHostReactor& aReactor)
+	{
+	CHostRing* object = new CHostRing(aReactor);
+	if (object && object->Construct() != KErrNone)
+		{
+		delete object;
+		object = NULL;
+		}
+	return object;
+	}
+
+CHostRing::CHostRing(CHostReactor& aReactor) :
+	iReactor(aReactor), iFd(-1)
+	{
+	}
+
+TInt CHostRing::Construct()
+	{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	iFd = syscall(__NR_io_uring_setup, KRingEntries, &params);
+	if (iFd < 0)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	// We want a single mapping for both rings, timeouts for the
+	// wait, and no dropped completions. Multishot poll came with
+	// resource tags, in 5.13, and there is no feature flag for it.
+	const TUint required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+		IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+	if ((params.features & required) != required)
+		{
+		return KErrNotSupported;
+		}
+
+	TUint sqSize = params.sq_off.array + params.sq_entries * sizeof(TUint);
+	TUint cqSize = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	iRingSize = (sqSize > cqSize) ? sqSize : cqSize;
+	iRingMem = mmap(NULL, iRingSize, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, iFd, IORING_OFF_SQ_RING);
+	if (iRingMem == MAP_FAILED)
+		{
+		iRingMem = NULL;
+		return HostErrorFromErrno(errno);
+		}
+	iSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	TAny* sqes = mmap(NULL, iSqesSize, PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE, iFd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+		{
+		return HostErrorFromErrno(errno);
+		}
+	iSqes = static_cast<struct io_uring_sqe*>(sqes);
+
+	TUint8* ring = static_cast<TUint8*>(iRingMem);
+	iSqHead = (TUint*)(ring + params.sq_off.head);
+	iSqTail = (TUint*)(ring + params.sq_off.tail);
+	iSqMask = *(TUint*)(ring + params.sq_off.ring_mask);
+	iSqEntries = params.sq_entries;
+	iSqArray = (TUint*)(ring + params.sq_off.array);
+	iSqLocalTail = *iSqTail;
+	iCqHead = (TUint*)(ring + params.cq_off.head);
+	iCqTail = (TUint*)(ring + params.cq_off.tail);
+	iCqMask = *(TUint*)(ring + params.cq_off.ring_mask);
+	iCqes = (struct io_uring_cqe*)(ring + params.cq_off.cqes);
+	return KErrNone;
+	}
+
+CHostRing::~CHostRing()
+	{
+	// closing the ring cancels anything still in flight, but our
+	// users should have cancelled their operations already
+	if (iSqes)
+		{
+		munmap(iSqes, iSqesSize);
+		}
+	if (iRingMem)
+		{
+		munmap(iRingMem, iRingSize);
+		}
+	if (iFd >= 0)
+		{
+		close(iFd);
+		}
+	}
+
+struct io_uring_sqe* CHostRing::NextSqe()
+	{
+	if (iSqLocalTail - __atomic_load_n(iSqHead, __ATOMIC_ACQUIRE) >=
+		iSqEntries)
+		{
+		// full, so must hand over what we have got already
+		Enter(0, 0);
+		}
+	TUint index = iSqLocalTail & iSqMask;
+	struct io_uring_sqe* sqe = &iSqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	iSqArray[index] = index;
+	iSqLocalTail++;
+	return sqe;
+	}
+
+struct io_uring_sqe* CHostRing::Prepare(THostRingOp& aOp,
+										MHostRingObserver& aObserver,
+										TInt aOpcode, TInt aFd)
+	{
+	if (aOp.iPending)
+		{
+		User::Panic(_L("HostRing"), 1);
+		}
+	aOp.iObserver = &aObserver;
+	aOp.iPending = ETrue;
+	aOp.iCancelled = EFalse;
+	struct io_uring_sqe* sqe = NextSqe();
+	sqe->opcode = aOpcode;
+	sqe->fd = aFd;
+	sqe->user_data = (TUint64)(uintptr_t)&aOp;
+	return sqe;
+	}
+
+void CHostRing::Recv(THostRingOp& aOp, MHostRingObserver& aObserver,
+					 TInt aFd, TUint8* aBuf, TInt aLength)
+	{
+	struct io_uring_sqe* sqe = Prepare(aOp, aObserver, IORING_OP_RECV, aFd);
+	sqe->addr = (TUint64)(uintptr_t)aBuf;
+	sqe->len = aLength;
+	Queued();
+	}
+
+void CHostRing::Send(THostRingOp& aOp, MHostRingObserver& aObserver,
+					 TInt aFd, const TUint8* aBuf, TInt aLength)
+	{
+	struct io_uring_sqe* sqe = Prepare(aOp, aObserver, IORING_OP_SEND, aFd);
+	sqe->addr = (TUint64)(uintptr_t)aBuf;
+	sqe->len = aLength;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	Queued();
+	}
+
+void CHostRing::SendMsg(THostRingOp& aOp, MHostRingObserver& aObserver,
+						TInt aFd, const struct msghdr* aMsg)
+	{
+	struct io_uring_sqe* sqe =
+		Prepare(aOp, aObserver, IORING_OP_SENDMSG, aFd);
+	sqe->addr = (TUint64)(uintptr_t)aMsg;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	Queued();
+	}
+
+void CHostRing::Accept(THostRingOp& aOp, MHostRingObserver& aObserver,
+					   TInt aFd)
+	{
+	struct io_uring_sqe* sqe =
+		Prepare(aOp, aObserver, IORING_OP_ACCEPT, aFd);
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	Queued();
+	}
+
+void CHostRing::Queued()
+	{
+	if (iIdleDepth && !*iIdleDepth)
+		{
+		Enter(0, 0);
+		}
+	}
+
+void CHostRing::Cancel(THostRingOp& aOp)
+	{
+	if (!aOp.iPending)
+		{
+		return;
+		}
+	aOp.iCancelled = ETrue;
+	struct io_uring_sqe* sqe = NextSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (TUint64)(uintptr_t)&aOp;
+	sqe->user_data = KCancelData;
+	// The operation may complete normally in the meantime, which
+	// is fine; but either way the buffer it refers to must not be
+	// touched by the kernel after we return.
+	while (aOp.iPending)
+		{
+		Enter(1, -1);
+		Reap();
+		}
+	}
+
+void CHostRing::ArmEpoll()
+	{
+	struct io_uring_sqe* sqe = NextSqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = iReactor.Fd();
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = KEpollData;
+	iEpollArmed = ETrue;
+	}
+
+TInt CHostRing::Enter(TUint aMinComplete, TInt aTimeout)
+	{
+	TUint toSubmit = iSqLocalTail - *iSqTail;
+	__atomic_store_n(iSqTail, iSqLocalTail, __ATOMIC_RELEASE);
+	TUint flags = 0;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	TAny* argp = NULL;
+	size_t argSize = 0;
+	if (aMinComplete)
+		{
+		flags |= IORING_ENTER_GETEVENTS;
+		if (aTimeout >= 0)
+			{
+			ts.tv_sec = aTimeout / 1000;
+			ts.tv_nsec = (aTimeout % 1000) * 1000000;
+			memset(&arg, 0, sizeof(arg));
+			arg.ts = (TUint64)(uintptr_t)&ts;
+			argp = &arg;
+			argSize = sizeof(arg);
+			flags |= IORING_ENTER_EXT_ARG;
+			}
+		}
+	TInt ret = syscall(__NR_io_uring_enter, iFd, toSubmit, aMinComplete,
+					   flags, argp, argSize);
+	// EINTR, ETIME and EBUSY (completion queue full) all just mean
+	// that the caller should look at what there is and come back
+	return (ret < 0) ? HostErrorFromErrno(errno) : KErrNone;
+	}
+
+/** Returns ETrue if anything was reaped.
+*/
+TBool CHostRing::Reap()
+	{
+	TBool any = EFalse;
+	TUint head = *iCqHead;
+	while (head != __atomic_load_n(iCqTail, __ATOMIC_ACQUIRE))
+		{
+		struct io_uring_cqe* cqe = &iCqes[head & iCqMask];
+		TUint64 data = cqe->user_data;
+		TInt res = cqe->res;
+		TUint flags = cqe->flags;
+		head++;
+		// release the entry first, as the observer may well
+		// make a new request
+		__atomic_store_n(iCqHead, head, __ATOMIC_RELEASE);
+		any = ETrue;
+
+		if (data == KEpollData)
+			{
+			iEpollPending = ETrue;
+			if (!(flags & IORING_CQE_F_MORE))
+				{
+				iEpollArmed = EFalse;
+				}
+			}
+		else if (data != KCancelData)
+			{
+			THostRingOp* op = (THostRingOp*)(uintptr_t)data;
+			op->iPending = EFalse;
+			op->iObserver->RingComplete(*op, res);
+			}
+		}
+	return any;
+	}
+
+void CHostRing::Poll(TInt aTimeout)
+	{
+	if (!iEpollArmed)
+		{
+		ArmEpoll();
+		}
+	TBool cqReady = (*iCqHead != __atomic_load_n(iCqTail, __ATOMIC_ACQUIRE));
+	if (aTimeout != 0 && !cqReady && !iEpollPending)
+		{
+		// submit, and wait, in one go
+		Enter(1, aTimeout);
+		}
+	else if (iSqLocalTail != *iSqTail)
+		{
+		Enter(0, 0);
+		}
+	Reap();
+	if (iEpollPending)
+		{
+		TInt count = iReactor.Poll(0);
+		// if we got a full batch, there may be more
+		iEpollPending = (count >= CHostReactor::KMaxEvents);
+		}
+	}
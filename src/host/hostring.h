@@ -0,0 +1,167 @@
+// -*- symbian-c++ -*-
+
+//
+// hostring.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __HOSTRING_H__
+#define __HOSTRING_H__
+
+#include <e32base.h>
+
+class CHostReactor;
+class THostRingOp;
+struct msghdr;
+
+// --------------------------------------------------------------------
+// MHostRingObserver...
+
+/** Gets told of the completion of a ring operation. As with
+	MHostFdObserver, no user code may be run from here.
+*/
+class MHostRingObserver
+	{
+public:
+	// aResult is as returned by the corresponding system call,
+	// i.e. a negated errno value on failure
+	virtual void RingComplete(THostRingOp& aOp, TInt aResult) = 0;
+	};
+
+/** One outstanding operation. The caller owns these, and must
+	keep them around until the operation has completed; Cancel()
+	makes sure that it has.
+*/
+class THostRingOp
+	{
+public:
+	THostRingOp() : iObserver(NULL), iPending(EFalse), iCancelled(EFalse) {}
+	TBool IsPending() const { return iPending; }
+	// whether Cancel() was called for the current operation
+	TBool IsCancelled() const { return iCancelled; }
+private:
+	MHostRingObserver* iObserver;
+	TBool iPending;
+	TBool iCancelled;
+	friend class CHostRing;
+	};
+
+// --------------------------------------------------------------------
+// CHostRing...
+
+/** An io_uring instance, used instead of the readiness based
+	reactor for stream reads and writes and for accepting, when the
+	host build is configured with HOST_ENGINE_URING.
+
+	Operations are only queued when requested, and the whole
+	queue is submitted as the scheduler goes to wait for the next
+	completions, which means that all the requests made during a
+	sweep of RunL() calls go to the kernel with a single system
+	call, in the same call that waits and reaps the completions.
+	The reactor's epoll descriptor is watched by the ring, so that
+	other descriptors (and wakeups from other threads) still work.
+*/
+NONSHARABLE_CLASS(CHostRing) : public CBase
+	{
+public:
+	// returns NULL if io_uring is not available on this kernel
+	static CHostRing* New(CHostReactor& aReactor);
+	~CHostRing();
+
+	// the io_uring descriptor, readable when there are completions
+	TInt Fd() const { return iFd; }
+	// whether Poll() would have reactor events to deliver
+	TBool HasPending() const { return iEpollPending; }
+
+	void Recv(THostRingOp& aOp, MHostRingObserver& aObserver,
+			  TInt aFd, TUint8* aBuf, TInt aLength);
+	void Send(THostRingOp& aOp, MHostRingObserver& aObserver,
+			  TInt aFd, const TUint8* aBuf, TInt aLength);
+	// aMsg must persist until the operation completes
+	void SendMsg(THostRingOp& aOp, MHostRingObserver& aObserver,
+				 TInt aFd, const struct msghdr* aMsg);
+	void Accept(THostRingOp& aOp, MHostRingObserver& aObserver,
+				TInt aFd);
+
+	// cancels the operation if pending, and waits for it to
+	// complete; the observer is told of the completion as usual
+	void Cancel(THostRingOp& aOp);
+
+	// submits any queued operations, and waits for at most aTimeout
+	// milliseconds (-1 for no limit) for completions to reap
+	void Poll(TInt aTimeout);
+	// Has operations get submitted as soon as queued while aDepth is
+	// zero, i.e. while the scheduler is neither running nor waiting,
+	// as when the caller waits on Fd() instead, nothing else would
+	// submit them.
+	void SetSubmitWhenIdle(const TInt* aDepth) { iIdleDepth = aDepth; }
+private:
+	CHostRing(CHostReactor& aReactor);
+	TInt Construct();
+	struct io_uring_sqe* NextSqe();
+	struct io_uring_sqe* Prepare(THostRingOp& aOp,
+								 MHostRingObserver& aObserver,
+								 TInt aOpcode, TInt aFd);
+	void Queued();
+	void ArmEpoll();
+	TInt Enter(TUint aMinComplete, TInt aTimeout);
+	TBool Reap();
+private:
+	CHostReactor& iReactor;
+	TInt iFd;
+
+	// the mappings
+	TAny* iRingMem;
+	TUint iRingSize;
+	struct io_uring_sqe* iSqes;
+	TUint iSqesSize;
+
+	// the shared submission queue state
+	TUint* iSqHead;
+	TUint* iSqTail;
+	TUint iSqMask;
+	TUint iSqEntries;
+	TUint* iSqArray;
+	// our tail, not yet visible to the kernel
+	TUint iSqLocalTail;
+
+	// the shared completion queue state
+	TUint* iCqHead;
+	TUint* iCqTail;
+	TUint iCqMask;
+	struct io_uring_cqe* iCqes;
+
+	// multishot poll of the epoll descriptor
+	TBool iEpollArmed;
+	// whether the reactor may have more to deliver
+	TBool iEpollPending;
+
+	// see SetSubmitWhenIdle()
+	const TInt* iIdleDepth;
+	};
+
+#endif // __HOSTRING_H__
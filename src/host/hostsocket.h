@@ -0,0 +1,162 @@
+// -*- symbian-c++ -*-
+
+//
+// hostsocket.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __HOSTSOCKET_H__
+#define __HOSTSOCKET_H__
+
+#include <es_sock.h>
+#include <sys/socket.h>
+#include "hostreactor.h"
+#include "hostring.h"
+
+// --------------------------------------------------------------------
+// CHostSocket...
+
+/** The implementation of an RSocket on the host.
+
+	The descriptor is nonblocking, and registered with the reactor of
+	the thread that first makes a request on it, edge triggered, for
+	both directions. Each request is first attempted right away; only
+	if the kernel is not ready do we wait for the next edge. There is
+	at most one pending request of each kind, as with RSocket.
+
+	With the io_uring engine, receiving, sending and accepting go
+	through the ring instead, and the descriptor is only registered
+	with the reactor for the duration of a connect.
+*/
+NONSHARABLE_CLASS(CHostSocket) :
+	public CBase, public MHostFdObserver, public MHostRingObserver
+	{
+public:
+	// aFd may be -1 for a blank socket
+	static CHostSocket* New(TInt aFd);
+	~CHostSocket();
+
+	TInt Fd() const { return iFd; }
+
+	TInt Bind(const TSockAddr& aAddr);
+	TInt Listen(TUint aQSize);
+	TUint LocalPort() const;
+	void Connect(const TSockAddr& aAddr, TRequestStatus& aStatus);
+	void CancelConnect();
+	void Accept(CHostSocket& aBlank, TRequestStatus& aStatus);
+	void CancelAccept();
+	void Write(const TDesC8& aDesc, TRequestStatus& aStatus);
+	void Writev(const TPtrC8* aDescs, TInt aCount, TRequestStatus& aStatus);
+	void SendFile(TInt aFileFd, TInt aOffset, TInt aCount,
+				  TRequestStatus& aStatus, TSockXfrLength& aSent);
+	void CancelWrite();
+	void Recv(TDes8& aDesc, TBool aOneOrMore, TRequestStatus& aStatus,
+			  TSockXfrLength* aLen);
+	void CancelRecv();
+	TInt Shutdown(RSocket::TShutdown aHow);
+	void Detach();
+
+private: // MHostFdObserver
+	void FdReady(TUint32 aEvents);
+
+private: // MHostRingObserver
+	void RingComplete(THostRingOp& aOp, TInt aResult);
+
+private:
+	CHostSocket(TInt aFd);
+	TInt Register();
+	void Unregister();
+	void ConnectDone(TInt aError);
+	void TryConnect();
+	void TryAccept();
+	void TrySend();
+	void TryRecv();
+	void SubmitSend();
+	TInt PrepareIov();
+	void AdvanceSend(TInt aCount);
+	void SubmitRecv();
+	void SendDone(TInt aError);
+	void TrySendFile();
+	void SendFileDone(TInt aError);
+	void RecvDone(TInt aError);
+	void AcceptDone(TInt aFd, TInt aError);
+	void RingAcceptComplete(TInt aResult);
+	void RingSendComplete(TInt aResult);
+	void RingRecvComplete(TInt aResult);
+	void Complete(TRequestStatus*& aStatus, TInt aError);
+	void AbortAccept();
+
+private:
+	// the most buffers given to a single sendmsg()
+	enum { KMaxSendIov = 64 };
+private:
+	TInt iFd;
+
+	// the scheduler whose reactor we are registered with, if any
+	CActiveScheduler* iScheduler;
+
+	TRequestStatus* iConnectStatus;
+
+	TRequestStatus* iAcceptStatus;
+	CHostSocket* iAcceptBlank;
+	// non-NULL while this blank socket is being accepted into
+	CHostSocket* iAcceptingFor;
+
+	// the buffers being sent, the one that we are at, and how much
+	// of it has gone
+	TRequestStatus* iSendStatus;
+	const TPtrC8* iSendDes;
+	TInt iSendCount;
+	TInt iSendIndex;
+	TInt iSendDone;
+	// the buffer of a plain Write()
+	TPtrC8 iSendOne;
+	// for sendmsg(), kept here for the ring until the send completes
+	struct msghdr iSendMsg;
+	struct iovec iSendIov[KMaxSendIov];
+
+	// non-NULL while sending a file, which always goes by readiness,
+	// as there is no sendfile() for the ring
+	TSockXfrLength* iSendFileLen;
+	TInt iSendFileFd;
+	TInt64 iSendFileOffset;
+	TInt iSendFileLeft;
+
+	TRequestStatus* iRecvStatus;
+	TDes8* iRecvDes;
+	TInt iRecvDone;
+	TBool iRecvOneOrMore;
+	TSockXfrLength* iRecvLen;
+
+	// the ring our operations went to, if any
+	CHostRing* iRing;
+	THostRingOp iAcceptOp;
+	THostRingOp iSendOp;
+	THostRingOp iRecvOp;
+	};
+
+#endif // __HOSTSOCKET_H__
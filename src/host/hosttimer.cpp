@@ -0,0 +1,194 @@
+// -*- symbian-c++ -*-
+
+//
+// hosttimer.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "hostreactor.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------
+// CHostTimer...
+
+/** The implementation of an RTimer on the host. There is at most
+	one pending request, which the timerfd completes in FdReady().
+*/
+NONSHARABLE_CLASS(CHostTimer) : public CBase, public MHostFdObserver
+	{
+public:
+	static CHostTimer* New();
+	~CHostTimer();
+	void After(TRequestStatus& aStatus, TInt aInterval);
+	void Cancel();
+private: // MHostFdObserver
+	void FdReady(TUint32 aEvents);
+private:
+	CHostTimer() {}
+	void Disarm();
+	void Complete(TInt aError);
+private:
+	TInt iFd;
+	// the scheduler whose reactor we are registered with, if any
+	CActiveScheduler* iScheduler;
+	TRequestStatus* iStatus;
+	};
+
+CHostTimer* CHostTimer::New()
+	{
+	CHostTimer* object = new CHostTimer;
+	if (!object)
+		{
+		return NULL;
+		}
+	object->iFd = timerfd_create(CLOCK_MONOTONIC,
+								 TFD_NONBLOCK | TFD_CLOEXEC);
+	if (object->iFd < 0)
+		{
+		object->iFd = -1;
+		delete object;
+		return NULL;
+		}
+	return object;
+	}
+
+CHostTimer::~CHostTimer()
+	{
+	Cancel();
+	if (iFd >= 0)
+		{
+		if (iScheduler)
+			{
+			iScheduler->Reactor().Remove(iFd);
+			}
+		close(iFd);
+		}
+	}
+
+void CHostTimer::After(TRequestStatus& aStatus, TInt aInterval)
+	{
+	_LIT(KPanicCategory, "RTimer");
+	__ASSERT_ALWAYS(!iStatus, User::Panic(KPanicCategory, 15));
+
+	aStatus = KRequestPending;
+	iStatus = &aStatus;
+
+	if (!iScheduler)
+		{
+		CActiveScheduler& scheduler = CActiveScheduler::HostCurrent();
+		TInt error = scheduler.Reactor().Add(iFd, *this, EPOLLIN);
+		if (error)
+			{
+			Complete(error);
+			return;
+			}
+		iScheduler = &scheduler;
+		}
+
+	if (aInterval <= 0)
+		{
+		Complete(KErrNone);
+		return;
+		}
+
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = aInterval / 1000000;
+	spec.it_value.tv_nsec = (aInterval % 1000000) * 1000;
+	if (timerfd_settime(iFd, 0, &spec, NULL) < 0)
+		{
+		Complete(HostErrorFromErrno(errno));
+		}
+	}
+
+void CHostTimer::Cancel()
+	{
+	if (iStatus)
+		{
+		Disarm();
+		Complete(KErrCancel);
+		}
+	}
+
+void CHostTimer::FdReady(TUint32 /*aEvents*/)
+	{
+	TUint64 expirations;
+	if (read(iFd, &expirations, sizeof(expirations)) < 0)
+		{
+		// a stale readiness from before we were disarmed
+		return;
+		}
+	if (iStatus)
+		{
+		Complete(KErrNone);
+		}
+	}
+
+void CHostTimer::Disarm()
+	{
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	timerfd_settime(iFd, 0, &spec, NULL);
+	}
+
+void CHostTimer::Complete(TInt aError)
+	{
+	CActiveScheduler::HostCurrent().RequestComplete(*iStatus, aError);
+	iStatus = NULL;
+	}
+
+// --------------------------------------------------------------------
+// RTimer...
+
+TInt RTimer::CreateLocal()
+	{
+	iImpl = CHostTimer::New();
+	return iImpl ? KErrNone : KErrNoMemory;
+	}
+
+void RTimer::After(TRequestStatus& aStatus,
+				   TTimeIntervalMicroSeconds32 aInterval)
+	{
+	iImpl->After(aStatus, aInterval.Int());
+	}
+
+void RTimer::Cancel()
+	{
+	if (iImpl)
+		{
+		iImpl->Cancel();
+		}
+	}
+
+void RTimer::Close()
+	{
+	delete iImpl;
+	iImpl = NULL;
+	}
@@ -0,0 +1,61 @@
+// -*- symbian-c++ -*-
+
+//
+// in_sock.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __IN_SOCK_H__
+#define __IN_SOCK_H__
+
+#include <es_sock.h>
+
+const TUint KProtocolInetTcp = 6;
+const TUint KProtocolInetUdp = 17;
+
+const TInt KErrNetUnreach = -190;
+const TInt KErrHostUnreach = -191;
+
+#define INET_ADDR(a,b,c,d) \
+	(TUint32)((((TUint32)(a)) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+const TUint32 KInetAddrAny = 0;
+
+class TInetAddr : public TSockAddr
+	{
+public:
+	TInetAddr() : TSockAddr(KAfInet) {}
+	TInetAddr(TUint32 aAddr, TUint aPort) : TSockAddr(KAfInet)
+		{ iAddress = aAddr; iPort = aPort; }
+	TInetAddr(const TSockAddr& aAddr) : TSockAddr(aAddr) {}
+	void SetAddress(TUint32 aAddr) { iFamily = KAfInet; iAddress = aAddr; }
+	TUint32 Address() const { return iAddress; }
+	static TInetAddr& Cast(TSockAddr& aAddr)
+		{ return static_cast<TInetAddr&>(aAddr); }
+	};
+
+#endif // __IN_SOCK_H__
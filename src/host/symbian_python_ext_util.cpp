@@ -0,0 +1,134 @@
+// -*- symbian-c++ -*-
+
+//
+// symbian_python_ext_util.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "symbian_python_ext_util.h"
+#include <stdio.h>
+
+// Like the PyS60 runtime, we keep the type objects and such in a
+// dictionary of our own rather than in the module namespace.
+static PyObject* gGlobals = NULL;
+
+PyObject* SPyGetGlobalString(const char* aName)
+	{
+	if (!gGlobals)
+		{
+		return NULL;
+		}
+	return PyDict_GetItemString(gGlobals, const_cast<char*>(aName));
+	}
+
+TInt SPyAddGlobalString(const char* aName, PyObject* aObject)
+	{
+	if (!gGlobals)
+		{
+		gGlobals = PyDict_New();
+		if (!gGlobals)
+			{
+			return -1;
+			}
+		}
+	return PyDict_SetItemString(gGlobals, const_cast<char*>(aName), aObject);
+	}
+
+static const char* ErrorName(TInt aError)
+	{
+	switch (aError)
+		{
+		case KErrNotFound: return "KErrNotFound";
+		case KErrGeneral: return "KErrGeneral";
+		case KErrCancel: return "KErrCancel";
+		case KErrNoMemory: return "KErrNoMemory";
+		case KErrNotSupported: return "KErrNotSupported";
+		case KErrArgument: return "KErrArgument";
+		case KErrBadHandle: return "KErrBadHandle";
+		case KErrOverflow: return "KErrOverflow";
+		case KErrAlreadyExists: return "KErrAlreadyExists";
+		case KErrInUse: return "KErrInUse";
+		case KErrNotReady: return "KErrNotReady";
+		case KErrAccessDenied: return "KErrAccessDenied";
+		case KErrEof: return "KErrEof";
+		case KErrDiskFull: return "KErrDiskFull";
+		case KErrTimedOut: return "KErrTimedOut";
+		case KErrCouldNotConnect: return "KErrCouldNotConnect";
+		case KErrDisconnected: return "KErrDisconnected";
+		case KErrTooBig: return "KErrTooBig";
+		default: return NULL;
+		}
+	}
+
+/** SymbianError is a builtin in PyS60, so we make it one here, too.
+*/
+static PyObject* SymbianErrorType()
+	{
+	PyObject* builtins = PyImport_AddModule(const_cast<char*>("__builtin__"));
+	if (!builtins)
+		{
+		return NULL;
+		}
+	PyObject* dict = PyModule_GetDict(builtins);
+	PyObject* type = PyDict_GetItemString(dict, const_cast<char*>("SymbianError"));
+	if (type)
+		{
+		return type;
+		}
+	type = PyErr_NewException(const_cast<char*>("exceptions.SymbianError"),
+							  PyExc_EnvironmentError, NULL);
+	if (!type)
+		{
+		return NULL;
+		}
+	PyDict_SetItemString(dict, const_cast<char*>("SymbianError"), type);
+	Py_DECREF(type); // the dictionary keeps it alive
+	return type;
+	}
+
+PyObject* SPyErr_SetFromSymbianOSErr(TInt aError)
+	{
+	PyObject* type = SymbianErrorType();
+	if (!type)
+		{
+		return NULL;
+		}
+	const char* name = ErrorName(aError);
+	char buf[32];
+	if (!name)
+		{
+		snprintf(buf, sizeof(buf), "Error %d", aError);
+		name = buf;
+		}
+	PyObject* value = Py_BuildValue("(is)", aError, name);
+	if (value)
+		{
+		PyErr_SetObject(type, value);
+		Py_DECREF(value);
+		}
+	return NULL;
+	}
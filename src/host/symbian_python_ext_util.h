@@ -0,0 +1,61 @@
+// -*- symbian-c++ -*-
+
+//
+// symbian_python_ext_util.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __SYMBIAN_PYTHON_EXT_UTIL_H__
+#define __SYMBIAN_PYTHON_EXT_UTIL_H__
+
+#include <Python.h>
+#include <e32std.h>
+
+// "u#" arguments get used as TText strings as they are, which would
+// silently misread them on a Python with a narrower Py_UNICODE
+static_assert(sizeof(TText) == Py_UNICODE_SIZE,
+			  "TText must match Py_UNICODE; build against a UCS-4 Python");
+
+/** Raises SymbianError, as PyS60 does, and returns NULL.
+*/
+PyObject* SPyErr_SetFromSymbianOSErr(TInt aError);
+
+/** Borrowed reference, or NULL.
+*/
+PyObject* SPyGetGlobalString(const char* aName);
+
+/** Steals no reference. Returns 0 on success, -1 on failure.
+*/
+TInt SPyAddGlobalString(const char* aName, PyObject* aObject);
+
+#define RETURN_ERROR_OR_PYNONE(error) \
+	if (error != KErrNone) \
+		return SPyErr_SetFromSymbianOSErr(error); \
+	else \
+		{ Py_INCREF(Py_None); return Py_None; }
+
+#endif // __SYMBIAN_PYTHON_EXT_UTIL_H__
@@ -33,11 +33,17 @@
 // SOFTWARE.
 
 #include <e32base.h> // active scheduler
+#include "settings.h"
+#if !ON_HOST
 #include <f32file.h> // RFs
+#endif
+#if SUPPORT_BT
 #include "btengine.h"
+#endif
 #include "local_epoc_py_utils.h"
 #include "apnsocketserv.h"
 #include "apnconnection.h"
+#include "socketaos.h"
 
 
 
@@ -46,6 +52,11 @@
 extern PyObject* apn_immediate_new(PyObject* /*self*/,
 								   PyObject* /*args*/);
 
+/** A module method.
+ */
+extern PyObject* apn_timer_new(PyObject* /*self*/,
+							   PyObject* /*args*/);
+
 /** A module method.
  */
 extern PyObject* apn_socket_new(PyObject* /*self*/,
@@ -68,6 +79,7 @@ extern PyObject* apn_flogger_new(PyObject* /*self*/,
 								 PyObject* /*args*/);
 #endif
 
+#if SUPPORT_BT
 /** A module method.
  */
 extern PyObject* apn_resolver_new(PyObject* /*self*/,
@@ -77,6 +89,7 @@ extern PyObject* apn_resolver_new(PyObject* /*self*/,
  */
 extern PyObject* apn_portdisc_new(PyObject* /*self*/,
 								  PyObject* /*args*/);
+#endif
 
 
 /** A module method.
@@ -110,6 +123,7 @@ static PyObject *apn_OnWins(PyObject* /*self*/,
 #endif
 	}
 
+#if !ON_HOST
 /** Returns:
 	KErrNotReady if no disk in drive;
 	KErrNone if disk not corrupt;
@@ -124,7 +138,7 @@ static PyObject* apn_CheckDisk(PyObject* /*self*/,
 		{
 		return NULL;
 		}
-	TPtrC drive((TUint16*)b, l);
+	TPtrC drive((TText*)b, l);
 
 	RFs fs;
 	TInt error = fs.Connect();
@@ -151,7 +165,7 @@ static PyObject* apn_ScanDrive(PyObject* /*self*/,
 		{
 		return NULL;
 		}
-	TPtrC drive((TUint16*)b, l);
+	TPtrC drive((TText*)b, l);
 
 	RFs fs;
 	TInt error = fs.Connect();
@@ -166,12 +180,14 @@ static PyObject* apn_ScanDrive(PyObject* /*self*/,
 
 	RETURN_ERROR_OR_PYNONE(error);
 	}
+#endif
 
 /** Module method table.
  */
 static const PyMethodDef apn_methods[] =
 	{
 	{"AoImmediate", (PyCFunction)apn_immediate_new, METH_NOARGS},
+	{"AoTimer", (PyCFunction)apn_timer_new, METH_NOARGS},
 	{"AoSocket", (PyCFunction)apn_socket_new, METH_NOARGS},
 	{"AoSocketServ", (PyCFunction)apn_socketserv_new, METH_NOARGS},
 	{"AoConnection", (PyCFunction)apn_connection_new, METH_NOARGS},
@@ -180,12 +196,16 @@ static const PyMethodDef apn_methods[] =
 #ifdef __HAS_FLOGGER__
 	{"AoFlogger", (PyCFunction)apn_flogger_new, METH_NOARGS},
 #endif
+#if SUPPORT_BT
 	{"AoResolver", (PyCFunction)apn_resolver_new, METH_NOARGS},
 	{"AoPortDiscoverer", (PyCFunction)apn_portdisc_new, METH_NOARGS},
+#endif
 	{"has_act_sched", (PyCFunction)apn_HasActSched, METH_NOARGS},
 	{"on_wins", (PyCFunction)apn_OnWins, METH_NOARGS},
+#if !ON_HOST
 	{"check_disk", (PyCFunction)apn_CheckDisk, METH_VARARGS},
 	{"scan_fat_disk", (PyCFunction)apn_ScanDrive, METH_VARARGS},
+#endif
 	{NULL, NULL}		   /* sentinel */
 	};
 
@@ -193,21 +213,30 @@ static const PyMethodDef apn_methods[] =
 
 
 extern TInt apn_immediate_ConstructType();
+extern TInt apn_timer_ConstructType();
 extern TInt apn_socket_ConstructType();
 extern TInt apn_loop_ConstructType();
 extern TInt apn_itc_ConstructType();
+extern TInt apn_buffer_ConstructType();
 #ifdef __HAS_FLOGGER__
 extern TInt apn_flogger_ConstructType();
 #endif
+#if SUPPORT_BT
 extern TInt apn_resolver_ConstructType();
 extern TInt apn_portdisc_ConstructType();
+#endif
 
 
 /** Module initializer function.
 
 	This function has no return value, but hopefully the caller
 	checks for any exceptions that may be set here.
+
+	On the host the function is looked up by name, not ordinal.
  */
+#if ON_HOST
+extern "C"
+#endif
 DL_EXPORT(void) initpyaosocket()
 	{
 	PyObject* module = Py_InitModule(
@@ -221,20 +250,49 @@ DL_EXPORT(void) initpyaosocket()
 
 	// If any of these fail, hopefully an exception will be set.
 	if (apn_immediate_ConstructType() < 0) return;
+	if (apn_timer_ConstructType() < 0) return;
 	if (apn_socket_ConstructType() < 0) return;
 	if (apn_socketserv_ConstructType() < 0) return;
 	if (apn_connection_ConstructType() < 0) return;
 	if (apn_loop_ConstructType() < 0) return;
 	if (apn_itc_ConstructType() < 0) return;
+	if (apn_buffer_ConstructType() < 0) return;
+
+	// for set_priority(); other values are okay, too
+	PyModule_AddIntConstant(module, "EPriorityIdle", CActive::EPriorityIdle);
+	PyModule_AddIntConstant(module, "EPriorityLow", CActive::EPriorityLow);
+	PyModule_AddIntConstant(module, "EPriorityStandard",
+							CActive::EPriorityStandard);
+	PyModule_AddIntConstant(module, "EPriorityUserInput",
+							CActive::EPriorityUserInput);
+	PyModule_AddIntConstant(module, "EPriorityHigh", CActive::EPriorityHigh);
+
+	// for read_frame()
+	PyModule_AddIntConstant(module, "EFrameU8", CSocketReader::EFrameU8);
+	PyModule_AddIntConstant(module, "EFrameU16Be",
+							CSocketReader::EFrameU16Be);
+	PyModule_AddIntConstant(module, "EFrameU16Le",
+							CSocketReader::EFrameU16Le);
+	PyModule_AddIntConstant(module, "EFrameU32Be",
+							CSocketReader::EFrameU32Be);
+	PyModule_AddIntConstant(module, "EFrameU32Le",
+							CSocketReader::EFrameU32Le);
+	PyModule_AddIntConstant(module, "EFrameVarint",
+							CSocketReader::EFrameVarint);
+
+	// the code of progress reports, as made by read_to_file()
+	PyModule_AddIntConstant(module, "KRequestPending", KRequestPending);
 #ifdef __HAS_FLOGGER__
 	if (apn_flogger_ConstructType() < 0) return;
 #endif
+#if SUPPORT_BT
 	if (apn_resolver_ConstructType() < 0) return;
 	if (apn_portdisc_ConstructType() < 0) return;
+#endif
 	}
 
 
-#ifndef EKA2
+#if !defined(EKA2) && !ON_HOST
 GLDEF_C TInt E32Dll(TDllReason)
 {
   return KErrNone;
@@ -49,7 +49,8 @@ enum TAoSocketPanicCodes
 	EPanicNextBeforeFirst,
 	EPanicWrongTransportMode,
 	EPanicSocketServNotSet,
-	EPanicArgumentError
+	EPanicArgumentError,
+	EPanicSocketDetached
 	};
 
 void AoSocketPanic(TInt aReason);
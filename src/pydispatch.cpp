@@ -0,0 +1,204 @@
+// -*- symbian-c++ -*-
+
+//
+// pydispatch.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pydispatch.h"
+#include "panic.h"
+#include "threadlocal.h"
+
+// --------------------------------------------------------------------
+// CPyDispatcher...
+
+/** The instance lives for as long as the thread does. It is created
+	on demand by AoLoop, and there is only ever one per thread, which
+	is why we need not care about the lifetimes of individual loops.
+*/
+CPyDispatcher* CPyDispatcher::Current()
+	{
+	TAoThreadLocals* locals = AoThreadLocals();
+	return locals ? locals->iDispatcher : NULL;
+	}
+
+CPyDispatcher* CPyDispatcher::InstanceL()
+	{
+	TAoThreadLocals& locals = AoThreadLocalsL();
+	if (!locals.iDispatcher)
+		{
+		locals.iDispatcher = new (ELeave) CPyDispatcher;
+		}
+	return locals.iDispatcher;
+	}
+
+CPyDispatcher::CPyDispatcher() :
+	CActive(EPriorityIdle)
+	{
+	CActiveScheduler::Add(this);
+	}
+
+CPyDispatcher::~CPyDispatcher()
+	{
+	Cancel();
+	}
+
+void CPyDispatcher::Enter(PyThreadState* aThreadState)
+	{
+	if (iLimit <= 0)
+		{
+		PyEval_RestoreThread(aThreadState);
+		return;
+		}
+
+	if (!iHeld)
+		{
+		PyEval_RestoreThread(aThreadState);
+		iHeld = ETrue;
+		iThreadState = aThreadState;
+		iCount = 0;
+		ScheduleRelease();
+		}
+	else if (aThreadState != iThreadState)
+		{
+		// we have the lock, but the request was made
+		// with a different thread state
+		PyThreadState_Swap(aThreadState);
+		iThreadState = aThreadState;
+		}
+	}
+
+void CPyDispatcher::Leave()
+	{
+	if (!iHeld)
+		{
+		PyEval_SaveThread();
+		return;
+		}
+
+	iCount++;
+	if (iCount >= iLimit)
+		{
+		// give other threads a chance
+		Release();
+		}
+	}
+
+/** We shall release the lock once nothing else is ready.
+*/
+void CPyDispatcher::ScheduleRelease()
+	{
+	if (!IsActive())
+		{
+		iStatus = KRequestPending;
+		SetActive();
+		TRequestStatus* status = &iStatus;
+		User::RequestComplete(status, KErrNone);
+		}
+	}
+
+void CPyDispatcher::Release()
+	{
+	if (iHeld)
+		{
+		PyEval_SaveThread();
+		iHeld = EFalse;
+		iThreadState = NULL;
+		iCount = 0;
+		}
+	}
+
+/** The lock will have been released when entering a nested loop,
+	so that we must start afresh, and then restore our state when
+	the loop exits, which is also when the lock gets reacquired.
+*/
+void CPyDispatcher::Push(TFrame& aFrame, TInt aLimit)
+	{
+	aFrame.iLimit = iLimit;
+	aFrame.iHeld = iHeld;
+	aFrame.iCount = iCount;
+	aFrame.iThreadState = iThreadState;
+	iLimit = aLimit;
+	iHeld = EFalse;
+	iCount = 0;
+	iThreadState = NULL;
+	}
+
+void CPyDispatcher::Pop(const TFrame& aFrame)
+	{
+	Release();
+	iLimit = aFrame.iLimit;
+	iHeld = aFrame.iHeld;
+	iCount = aFrame.iCount;
+	iThreadState = aFrame.iThreadState;
+
+	// the release we had scheduled may have run in the nested loop,
+	// and nothing else would release the lock before we block
+	if (iHeld)
+		{
+		ScheduleRelease();
+		}
+	}
+
+void CPyDispatcher::RunL()
+	{
+	Release();
+	}
+
+void CPyDispatcher::DoCancel()
+	{
+	// the request is always complete already
+	}
+
+// --------------------------------------------------------------------
+// dispatch API...
+
+void PyDispatchEnter(PyThreadState* aThreadState)
+	{
+	CPyDispatcher* dispatcher = CPyDispatcher::Current();
+	if (dispatcher)
+		{
+		dispatcher->Enter(aThreadState);
+		}
+	else
+		{
+		PyEval_RestoreThread(aThreadState);
+		}
+	}
+
+void PyDispatchLeave()
+	{
+	CPyDispatcher* dispatcher = CPyDispatcher::Current();
+	if (dispatcher)
+		{
+		dispatcher->Leave();
+		}
+	else
+		{
+		PyEval_SaveThread();
+		}
+	}
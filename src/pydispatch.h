@@ -0,0 +1,103 @@
+// -*- symbian-c++ -*-
+
+//
+// pydispatch.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// Batching of callbacks into Python under a single acquisition
+// of the interpreter lock.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __PYDISPATCH_H__
+#define __PYDISPATCH_H__
+
+#include "local_epoc_py_utils.h"
+#include <e32base.h>
+
+// --------------------------------------------------------------------
+// CPyDispatcher...
+
+/** The RunL() of every active object that calls into Python must
+	bracket the call with PyDispatchEnter() and PyDispatchLeave(),
+	instead of restoring and saving the thread state by itself.
+
+	Normally that amounts to acquiring and releasing the interpreter
+	lock around each callback. But an AoLoop may be told to batch
+	callbacks, in which case the lock is acquired by the first
+	callback, and then held on to until there are no more completed
+	requests, or until the batch limit is reached, whichever comes
+	first. Releasing is done by an idle priority active object, which
+	gets to run once every other ready active object has had its turn.
+
+	Note that while batching, callbacks must not block in a nested
+	wait (an e32.Ao_lock, for instance) other than that of another
+	AoLoop, as the lock would then get released behind our back.
+*/
+NONSHARABLE_CLASS(CPyDispatcher) : public CActive
+	{
+public:
+	// returns the instance for this thread, if there is one
+	static CPyDispatcher* Current();
+	// returns the instance for this thread, creating it if required
+	static CPyDispatcher* InstanceL();
+	~CPyDispatcher();
+
+	void Enter(PyThreadState* aThreadState);
+	void Leave();
+	// releases the lock if we are holding it
+	void Release();
+
+	// the state saved for the duration of a nested loop
+	struct TFrame
+		{
+		TInt iLimit;
+		TBool iHeld;
+		TInt iCount;
+		PyThreadState* iThreadState;
+		};
+	// a limit of zero means no batching
+	void Push(TFrame& aFrame, TInt aLimit);
+	void Pop(const TFrame& aFrame);
+private:
+	CPyDispatcher();
+	void ScheduleRelease();
+	void RunL();
+	void DoCancel();
+private:
+	// the maximum number of callbacks per batch, or zero
+	TInt iLimit;
+	// whether we are holding the interpreter lock between callbacks
+	TBool iHeld;
+	// the number of callbacks made in this batch
+	TInt iCount;
+	PyThreadState* iThreadState;
+	};
+
+void PyDispatchEnter(PyThreadState* aThreadState);
+void PyDispatchLeave();
+
+#endif // __PYDISPATCH_H__
@@ -0,0 +1,202 @@
+// -*- symbian-c++ -*-
+
+//
+// runstats.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "runstats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------------------
+// THistogram...
+
+THistogram::THistogram() :
+	iCount(0), iSum(0), iMin(0), iMax(0)
+	{
+	Mem::FillZ(iCounts, sizeof(iCounts));
+	}
+
+// Values below KSubBuckets get a bucket each. Otherwise the bucket
+// is given by the position of the highest set bit, and the
+// KSubBits bits that follow it.
+TInt THistogram::BucketOf(TInt64 aValue)
+	{
+	TUint64 value = (aValue < 0) ? 0 : (TUint64)aValue;
+	if (value < KSubBuckets)
+		{
+		return (TInt)value;
+		}
+	TInt top = 0;
+	for (TInt shift = 32; shift > 0; shift >>= 1)
+		{
+		if (value >> (top + shift))
+			{
+			top += shift;
+			}
+		}
+	if (top >= KMaxBits)
+		{
+		return KBuckets - 1;
+		}
+	TInt sub = (TInt)(value >> (top - KSubBits)) & (KSubBuckets - 1);
+	return KSubBuckets * (top - KSubBits + 1) + sub;
+	}
+
+TInt64 THistogram::BucketLow(TInt aBucket)
+	{
+	if (aBucket < KSubBuckets)
+		{
+		return aBucket;
+		}
+	TInt top = aBucket / KSubBuckets + KSubBits - 1;
+	TInt sub = aBucket % KSubBuckets;
+	return (TInt64)(KSubBuckets + sub) << (top - KSubBits);
+	}
+
+void THistogram::Record(TInt64 aValue)
+	{
+	if (aValue < 0)
+		{
+		// clocks are monotonic, but let us not trust that
+		aValue = 0;
+		}
+	if (!iCount || aValue < iMin)
+		{
+		iMin = aValue;
+		}
+	if (aValue > iMax)
+		{
+		iMax = aValue;
+		}
+	iCount++;
+	iSum += aValue;
+	iCounts[BucketOf(aValue)]++;
+	}
+
+TInt64 THistogram::Percentile(TInt aPerMille) const
+	{
+	if (!iCount)
+		{
+		return 0;
+		}
+	// the rank of the value we want, counting from one
+	TUint64 rank = ((TUint64)iCount * aPerMille + 999) / 1000;
+	if (rank < 1)
+		{
+		rank = 1;
+		}
+	TUint64 seen = 0;
+	for (TInt i = 0; i < KBuckets; i++)
+		{
+		seen += iCounts[i];
+		if (seen >= rank)
+			{
+			TInt64 low = BucketLow(i);
+			return (low < iMin) ? iMin : low;
+			}
+		}
+	return iMax;
+	}
+
+#if ON_HOST
+
+// --------------------------------------------------------------------
+// CRunStats...
+
+CRunStats* CRunStats::NewL()
+	{
+	return new (ELeave) CRunStats;
+	}
+
+CRunStats::~CRunStats()
+	{
+	for (TInt i = 0; i < iClassCount; i++)
+		{
+		delete iClasses[i];
+		}
+	}
+
+const char* CRunStats::ClassName(const CClassStats& aStats)
+	{
+	// a class at namespace scope is mangled as its name prefixed
+	// by the length of the name
+	const char* name = aStats.iName;
+	while (*name >= '0' && *name <= '9')
+		{
+		name++;
+		}
+	return (*name && strlen(name) == (size_t)atoi(aStats.iName)) ?
+		name : aStats.iName;
+	}
+
+CRunStats::CClassStats* CRunStats::Find(const char* aClass)
+	{
+	if (iLast && iLast->iName == aClass)
+		{
+		return iLast;
+		}
+	for (TInt i = 0; i < iClassCount; i++)
+		{
+		// the names of a class should be the same pointer, but
+		// need not be if the class is in more than one module
+		if (iClasses[i]->iName == aClass ||
+			!strcmp(iClasses[i]->iName, aClass))
+			{
+			iLast = iClasses[i];
+			return iLast;
+			}
+		}
+	if (iClassCount == KMaxClasses)
+		{
+		return NULL;
+		}
+	// must not leave here, and can do without on failure
+	CClassStats* stats = new CClassStats;
+	if (!stats)
+		{
+		return NULL;
+		}
+	stats->iName = aClass;
+	iClasses[iClassCount++] = stats;
+	iLast = stats;
+	return stats;
+	}
+
+void CRunStats::ActiveRun(const char* aClass, TInt64 aReadyAt,
+						  TInt64 aStartAt, TInt64 aEndAt)
+	{
+	CClassStats* stats = Find(aClass);
+	if (stats)
+		{
+		stats->iDelay.Record(aStartAt - aReadyAt);
+		stats->iRun.Record(aEndAt - aStartAt);
+		}
+	}
+
+#endif // ON_HOST
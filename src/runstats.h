@@ -0,0 +1,124 @@
+// -*- symbian-c++ -*-
+
+//
+// runstats.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// Statistics on how long the active objects of a thread wait,
+// and how long their RunL()s take.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __RUNSTATS_H__
+#define __RUNSTATS_H__
+
+#include "settings.h"
+#include <e32base.h>
+
+// --------------------------------------------------------------------
+// THistogram...
+
+/** A log-linear histogram of non-negative values: each power of two
+	is split into KSubBuckets linear buckets, so that any recorded
+	value is known to within 1/KSubBuckets of it. Values beyond
+	the range are counted in the last bucket.
+
+	Not thread safe; each thread records into histograms of its own.
+*/
+class THistogram
+	{
+public:
+	enum { KSubBits = 3, KSubBuckets = 1 << KSubBits };
+	// enough for values up to 2^40, i.e. some 18 minutes in ns
+	enum { KMaxBits = 40 };
+	enum { KBuckets = KSubBuckets * (KMaxBits - KSubBits + 1) };
+public:
+	THistogram();
+	void Record(TInt64 aValue);
+	TUint Count() const { return iCount; }
+	TInt64 Min() const { return iMin; }
+	TInt64 Max() const { return iMax; }
+	TInt64 Mean() const { return iCount ? (iSum / iCount) : 0; }
+	// aPerMille of 500 gives the median, for instance; the result
+	// is the lower bound of the bucket in which the value falls
+	TInt64 Percentile(TInt aPerMille) const;
+	TUint BucketCount(TInt aBucket) const { return iCounts[aBucket]; }
+	static TInt64 BucketLow(TInt aBucket);
+private:
+	static TInt BucketOf(TInt64 aValue);
+private:
+	TUint iCount;
+	TInt64 iSum;
+	TInt64 iMin;
+	TInt64 iMax;
+	TUint iCounts[KBuckets];
+	};
+
+#if ON_HOST
+
+// --------------------------------------------------------------------
+// CRunStats...
+
+/** Keeps dispatch delay and RunL() duration histograms for each
+	class of active object that the scheduler of this thread runs.
+	The dispatch delay is the time from the scheduler learning of
+	the completion of a request to the start of the RunL().
+*/
+NONSHARABLE_CLASS(CRunStats) : public CBase, public MHostRunMonitor
+	{
+public:
+	enum { KMaxClasses = 32 };
+	NONSHARABLE_CLASS(CClassStats) : public CBase
+		{
+	public:
+		const char* iName;
+		THistogram iDelay;
+		THistogram iRun;
+		};
+public:
+	static CRunStats* NewL();
+	~CRunStats();
+	TInt ClassCount() const { return iClassCount; }
+	const CClassStats& Class(TInt aIndex) const
+		{ return *iClasses[aIndex]; }
+	// the class name without its mangling, if simple enough
+	static const char* ClassName(const CClassStats& aStats);
+private: // MHostRunMonitor
+	void ActiveRun(const char* aClass, TInt64 aReadyAt,
+				   TInt64 aStartAt, TInt64 aEndAt);
+private:
+	CRunStats() {}
+	CClassStats* Find(const char* aClass);
+private:
+	CClassStats* iClasses[KMaxClasses];
+	TInt iClassCount;
+	// the most recently used entry
+	CClassStats* iLast;
+	};
+
+#endif // ON_HOST
+
+#endif // __RUNSTATS_H__
@@ -42,6 +42,18 @@
 #define ON_WINS 0
 #endif
 
+/* The host backend runs the same active objects natively on Linux,
+   on top of an epoll based scheduler, for load testing and
+   profiling. There is no Bluetooth support there.
+*/
+#ifdef __HOST_BACKEND__
+#define ON_HOST 1
+#else
+#define ON_HOST 0
+#endif
+
+#define SUPPORT_BT (!ON_HOST)
+
 #define SUPPORT_PEROON 0 // ON_WINS
 
 #define NO_SESSION_HANDLE_ACCESS SUPPORT_PEROON
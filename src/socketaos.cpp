@@ -33,6 +33,7 @@
 // SOFTWARE.
 
 #include <in_sock.h>
+#include "bufferpool.h"
 #include "panic.h"
 #include "socketaos.h"
 
@@ -286,8 +287,15 @@ void CResolvingConnecter::DoCancel()
 	// the same request twice
 	if (iStatus == KRequestPending)
 		{
+		// a connect that completed before the cancel took effect
+		// leaves its result, for those who look
+		TInt error = KErrCancel;
+		if (iState == 2)
+			{
+			error = iSocketConnecter->iStatus.Int();
+			}
 		TRequestStatus* status = &iStatus;
-		User::RequestComplete(status, KErrCancel);
+		User::RequestComplete(status, error);
 		}
 	}
 
@@ -391,8 +399,13 @@ CSocketWriter::CSocketWriter(MAoSockObserver& aObserver,
 
 CSocketWriter::~CSocketWriter()
 	{
+	if (iDeleted)
+		{
+		*iDeleted = ETrue;
+		}
 	Cancel();
-	ClearData();
+	FreeItems(iHead);
+	FreeItems(iDone);
 	}
 
 void CSocketWriter::DoCancel()
@@ -400,38 +413,201 @@ void CSocketWriter::DoCancel()
 	iSocket.CancelWrite();
 	}
 
+void CSocketWriter::FreeItems(TWriteItem*& aItems)
+	{
+	while (aItems)
+		{
+		TWriteItem* item = aItems;
+		aItems = item->iNext;
+		User::Free(item);
+		}
+	}
+
+/** Sends the queue from its head. RSocket has no gathered writes,
+	so on the device the writes go out one at a time, still without
+	waiting for the callbacks of the earlier ones.
+*/
+void CSocketWriter::Send()
+	{
+#if ON_HOST
+	TInt count = 0;
+	for (TWriteItem* item = iHead;
+		 item && count < KMaxGather;
+		 item = item->iNext)
+		{
+		iGather[count++].Set(item->iPtr, item->iLength);
+		}
+	iSending = count;
+	iSocket.HostWritev(iGather, count, iStatus);
+#else
+	iSending = 1;
+	iSendPtr.Set(iHead->iPtr, iHead->iLength);
+	iSocket.Write(iSendPtr, iStatus);
+#endif
+	SetActive();
+	}
+
+// Moves the queue up to and including aLast to be reported.
+void CSocketWriter::TakeDone(TWriteItem* aLast)
+	{
+	TWriteItem** tail = &iDone;
+	while (*tail)
+		{
+		tail = &(*tail)->iNext;
+		}
+	*tail = iHead;
+	iHead = aLast->iNext;
+	aLast->iNext = NULL;
+	if (!iHead)
+		{
+		iTail = NULL;
+		}
+	iSending = 0;
+	}
+
+/** The next send gets made before the callbacks, so that the
+	kernel need not wait for them.
+*/
 void CSocketWriter::RunL()
 	{
-	iObserver.DataWritten(iStatus.Int());
-	// note that the callback might do anything, such
-	// as destroying this object, so it is imperative
-	// that we do not do anything here
+	TInt error = iStatus.Int();
+	TWriteItem* last = iTail;
+	if (!error)
+		{
+		last = iHead;
+		for (TInt i = 1; i < iSending; i++)
+			{
+			last = last->iNext;
+			}
+		}
+	TakeDone(last);
+	if (iHead)
+		{
+		Send();
+		}
+	Report(error);
+	}
+
+void CSocketWriter::Report(TInt aError)
+	{
+	// note that the callbacks might do anything, such as destroying
+	// this object, or running a nested loop in which we report again
+	TBool deleted = EFalse;
+	TBool* outer = iDeleted;
+	iDeleted = &deleted;
+	while (iDone)
+		{
+		TWriteItem* item = iDone;
+		iDone = item->iNext;
+		TBool report = item->iReport;
+		iQueued -= item->iLength;
+		User::Free(item);
+		if (report)
+			{
+			iObserver.DataWritten(aError);
+			if (deleted)
+				{
+				if (outer)
+					{
+					*outer = ETrue;
+					}
+				return;
+				}
+			}
+		}
+	iDeleted = outer;
 	}
 
 void CSocketWriter::WriteDataL(const TDesC8& aData)
 	{
-	if (IsActive())
+	TInt length = aData.Length();
+	TWriteItem* item = static_cast<TWriteItem*>(
+		User::AllocL(sizeof(TWriteItem) + length));
+	TUint8* data = reinterpret_cast<TUint8*>(item + 1);
+	Mem::Copy(data, aData.Ptr(), length);
+	item->iNext = NULL;
+	item->iPtr = data;
+	item->iLength = length;
+	item->iReport = ETrue;
+	Queue(item, item);
+	}
+
+/** All the items get allocated first, so that nothing is queued
+	upon a leave. An empty batch still gets reported, with an empty
+	write.
+*/
+void CSocketWriter::WriteBatchL(const TPtrC8* aData, TInt aCount)
+	{
+	TInt count = (aCount > 0) ? aCount : 1;
+	TWriteItem* first = NULL;
+	TWriteItem* last = NULL;
+	for (TInt i = 0; i < count; i++)
 		{
-		AssertFail();
-		return;
+		TWriteItem* item = static_cast<TWriteItem*>(
+			User::Alloc(sizeof(TWriteItem)));
+		if (!item)
+			{
+			FreeItems(first);
+			User::LeaveNoMemory();
+			}
+		item->iNext = NULL;
+		item->iPtr = aCount ? aData[i].Ptr() : NULL;
+		item->iLength = aCount ? aData[i].Length() : 0;
+		item->iReport = (i == count - 1);
+		if (last)
+			{
+			last->iNext = item;
+			}
+		else
+			{
+			first = item;
+			}
+		last = item;
 		}
-	ClearData();
-	iData = HBufC8::NewL(aData.Length());
-	TPtr8 ptr(iData->Des());
-	ptr.Copy(aData);
-	iSocket.Write(*iData, iStatus);
-	SetActive();
+	Queue(first, last);
 	}
 
-void CSocketWriter::ClearData()
+void CSocketWriter::Queue(TWriteItem* aFirst, TWriteItem* aLast)
 	{
-	if (iData)
+	for (TWriteItem* item = aFirst; item; item = item->iNext)
 		{
-		delete iData;
-		iData = NULL;
+		iQueued += item->iLength;
+		}
+	if (iTail)
+		{
+		iTail->iNext = aFirst;
+		}
+	else
+		{
+		iHead = aFirst;
+		}
+	iTail = aLast;
+	if (!IsActive())
+		{
+		Send();
 		}
 	}
 
+void CSocketWriter::Clear()
+	{
+	Cancel();
+	FreeItems(iHead);
+	iTail = NULL;
+	iSending = 0;
+	FreeItems(iDone);
+	iQueued = 0;
+	}
+
+void CSocketWriter::Fail(TInt aError)
+	{
+	Cancel();
+	if (iTail)
+		{
+		TakeDone(iTail);
+		}
+	Report(aError);
+	}
+
 // -----------------------------------------------------------
 // CSocketReader...
 
@@ -440,65 +616,368 @@ CSocketReader::CSocketReader(MAoSockObserver& aObserver,
 	CActive(EPriorityStandard),
 	iObserver(aObserver),
 	iSocket(aSocket),
+	iPoolKeep(CBufferPool::KDefaultKeep),
 	// must initialize as has no default constructor
-	iDataPtr(NULL, 0, 0)
+	iDataPtr(NULL, 0, 0),
+	iCoalesceTimer(*this),
+	iIntoPtr(NULL, 0, 0),
+	iAheadPtr(NULL, 0, 0)
 	{
 	CActiveScheduler::Add(this);
 	}
 
 CSocketReader::~CSocketReader()
 	{
+	if (iDeleted)
+		{
+		*iDeleted = ETrue;
+		}
 	Cancel();
+	if (iTimerWheel)
+		{
+		iTimerWheel->Remove(iCoalesceTimer);
+		}
 	ClearData();
+	ClearDone();
+	if (iAhead)
+		{
+		iPool->Free(iAhead, iAheadSize, iPoolKeep);
+		}
 	}
 
 void CSocketReader::DoCancel()
 	{
+	// also okay if we merely completed the request ourselves
 	iSocket.CancelRecv();
+	iAdapting = EFalse;
+	iInto = EFalse;
+	iIntoPtr.Set(NULL, 0, 0);
+	iAheadRecv = EFalse;
+	iAheadPtr.Set(NULL, 0, 0);
+	iFromAhead = 0;
 	}
 
+/** Cancels the pending receive, unless it completes first, which it
+	may do even during the cancellation. Returns EFalse in that case,
+	with RunL() still to deliver the result as usual.
+*/
+TBool CSocketReader::Expire()
+	{
+	iSocket.CancelRecv();
+	User::WaitForRequest(iStatus);
+	TInt error = iStatus.Int();
+	// the wait took the signal, which either Cancel() or the
+	// scheduler is still to get
+	iStatus = KRequestPending;
+	TRequestStatus* status = &iStatus;
+	User::RequestComplete(status, error);
+	if (error != KErrCancel)
+		{
+		return EFalse;
+		}
+	Cancel();
+	return ETrue;
+	}
+
+/** Reads that can be served from the read-ahead buffer, and that
+	are made from within the callback, get delivered by the loop
+	here, without a trip through the scheduler. Frames or lines that
+	arrive together thus get delivered together.
+*/
 void CSocketReader::RunL()
 	{
-	iObserver.DataRead(iStatus.Int(), iDataPtr);
-	//iObserver.DataRead(iStatus.Int(), *iData);
+	TInt error = iStatus.Int();
+	TInt count = 0;
+	while (Deliver(error))
+		{
+		iInline = EFalse;
+		error = KErrNone;
+		if (++count == KMaxInline)
+			{
+			SelfComplete();
+			return;
+			}
+		}
+	}
 
-	// note that the callback might do anything, such
-	// as destroying this object, so it is imperative
-	// that we do not do anything here
+// Returns ETrue if another read is to be delivered right away.
+TBool CSocketReader::Deliver(TInt aError)
+	{
+	TInt error = aError;
+	ClearDone();
+	TPtrC8 data;
+	if (iMode != EReadSome)
+		{
+		if (!RecordReady(error, data))
+			{
+			// more data requested
+			return EFalse;
+			}
+		}
+	else if (iInto)
+		{
+		data.Set(iIntoPtr.Ptr(), iIntoPtr.Length());
+		iInto = EFalse;
+		iIntoPtr.Set(NULL, 0, 0);
+		}
+	else if (iFromAhead)
+		{
+		data.Set(iAhead + iAheadStart, iFromAhead);
+		ConsumeAhead(iFromAhead);
+		iFromAhead = 0;
+		}
+	else
+		{
+		// Set the buffer holding the data aside, so that when
+		// streaming, the next request can be made with another
+		// one before the data is delivered. That way the kernel
+		// need not wait for the callback.
+		if (iAdapting && error == KErrNone)
+			{
+			Adapt(iDataPtr.Length(), iDataPtr.MaxLength());
+			}
+		iAdapting = EFalse;
+		if (Coalesce(error))
+			{
+			// more data requested
+			return EFalse;
+			}
+		iDone = iBuf;
+		iDoneSize = iBufSize;
+		data.Set(iBuf, iPrefix + iDataPtr.Length());
+		iBuf = NULL;
+		iDataPtr.Set(NULL, 0, 0);
+		}
+	TInt rearmError = KErrNone;
+	if (iStreaming && error == KErrNone)
+		{
+		TRAP(rearmError, RecvSomeL(iStreamSize));
+		}
+	if (error || rearmError)
+		{
+		iStreaming = EFalse;
+		}
+
+	// note that the callback might do anything, such as destroying
+	// this object, or running a nested loop in which we deliver again
+	TBool deleted = EFalse;
+	TBool* outer = iDeleted;
+	iDeleted = &deleted;
+	iObserver.DataRead(error, data);
+	if (deleted)
+		{
+		if (outer)
+			{
+			*outer = ETrue;
+			}
+		return EFalse;
+		}
+	iDeleted = outer;
+	ClearDone();
+	if (rearmError && !IsBusy())
+		{
+		// unless the callback has made another read, which then
+		// stands on its own
+		iObserver.DataRead(rearmError, KNullDesC8);
+		// again, do not do anything here
+		return EFalse;
+		}
+	return iInline;
 	}
 
 void CSocketReader::ReadSomeL(TInt aMaxSize)
 	{
-	if (IsActive())
+	if (IsBusy())
 		{
 		AssertFail();
 		return;
 		}
-	ClearData();
+	iStreaming = EFalse;
+	RecvSomeL(aMaxSize);
+	}
 
-	// may have MaxLength() larger than requested
-	iData = HBufC8::NewL(aMaxSize);
-	iDataPtr.Set(const_cast<TUint8*>(iData->Ptr()), 0, aMaxSize);
-	iDataPtr.FillZ(); // not necessary
-	iSocket.RecvOneOrMore(iDataPtr, 0, iStatus, iDummyLen);
-	//iSocket.RecvOneOrMore(iData->Des(), 0, iStatus, iDummyLen);
+void CSocketReader::StartStreamingL(TInt aMaxSize)
+	{
+	if (IsBusy())
+		{
+		AssertFail();
+		return;
+		}
+	RecvSomeL(aMaxSize);
+	iStreaming = ETrue;
+	iStreamSize = aMaxSize;
+	}
+
+void CSocketReader::StopStreaming()
+	{
+	iStreaming = EFalse;
+	if (iTimerWheel)
+		{
+		iTimerWheel->Remove(iCoalesceTimer);
+		}
+	if (iInline)
+		{
+		iInline = EFalse;
+		iFromAhead = 0;
+		iInto = EFalse;
+		iIntoPtr.Set(NULL, 0, 0);
+		}
+	Cancel();
+	}
 
+// Anything left over in the read-ahead buffer is delivered first.
+void CSocketReader::RecvSomeL(TInt aMaxSize)
+	{
+	iMode = EReadSome;
+	iPrefix = 0;
+	TInt ahead = iAheadEnd - iAheadStart;
+	if (ahead > 0)
+		{
+		iFromAhead = (ahead < aMaxSize) ? ahead : aMaxSize;
+		CompleteAhead();
+		return;
+		}
+	TInt size = aMaxSize;
+	if (iAdaptMax > 0 && iAdaptSize < size)
+		{
+		size = iAdaptSize;
+		}
+	AllocDataL(size);
+	iAdapting = (iAdaptMax > 0);
+	iSocket.RecvOneOrMore(iDataPtr, 0, iStatus, iDummyLen);
 	SetActive();
 	}
 
+void CSocketReader::SetAdaptive(TInt aMin, TInt aMax)
+	{
+	if (aMin == iAdaptMin && aMax == iAdaptMax)
+		{
+		return;
+		}
+	iAdaptMin = aMin;
+	iAdaptMax = aMax;
+	// start small, as most sockets are mostly idle
+	iAdaptSize = aMin;
+	iAdaptLow = 0;
+	}
+
+void CSocketReader::SetCoalescingL(TInt aBytes, TInt aMicroSeconds)
+	{
+	if (aBytes > 0 && !iTimerWheel)
+		{
+		iTimerWheel = CTimerWheel::InstanceL();
+		}
+	iCoalesceBytes = aBytes;
+	// the wheel counts in milliseconds
+	iCoalesceTime = aMicroSeconds / 1000 + (aMicroSeconds % 1000 != 0);
+	}
+
+/** Returns ETrue if the data received so far is being held back
+	for more, which has been asked for. An error that comes while
+	holding data back is delivered as success, as the data would
+	otherwise be lost; the next receive is bound to fail again.
+*/
+TBool CSocketReader::Coalesce(TInt& aError)
+	{
+	if (!iStreaming || iCoalesceBytes == 0)
+		{
+		return EFalse;
+		}
+	TInt length = iPrefix + iDataPtr.Length();
+	TInt size = iPrefix + iDataPtr.MaxLength();
+	TBool first = (iPrefix == 0);
+	if (aError == KErrNone && length < iCoalesceBytes && length < size &&
+		(first || iCoalesceTimer.IsQueued()))
+		{
+		if (first)
+			{
+			iTimerWheel->Add(iCoalesceTimer, iCoalesceTime);
+			}
+		iPrefix = length;
+		iDataPtr.Set(iBuf + length, 0, size - length);
+		iSocket.RecvOneOrMore(iDataPtr, 0, iStatus, iDummyLen);
+		SetActive();
+		return ETrue;
+		}
+	iTimerWheel->Remove(iCoalesceTimer);
+	if (aError && length > 0)
+		{
+		aError = KErrNone;
+		}
+	return EFalse;
+	}
+
+/** Delivers what has been coalesced, by way of RunL(), unless
+	the receive has completed already, in which case RunL() will
+	see that the time is up.
+*/
+void CSocketReader::TimerExpired(TWheelTimer& /*aTimer*/)
+	{
+	if (IsActive() && iStatus == KRequestPending)
+		{
+		Cancel();
+		SelfComplete();
+		}
+	}
+
+/** Somewhat like TCP receive autotuning, but all we have to go by
+	is how much of each buffer got filled. A full one suggests that
+	there was more to be had; doubling the size right away keeps the
+	number of callbacks low for bulk transfers. Shrinking is more
+	cautious, so that the size does not flap with bursty traffic.
+*/
+void CSocketReader::Adapt(TInt aLength, TInt aSize)
+	{
+	if (aLength >= aSize)
+		{
+		iAdaptLow = 0;
+		if (aSize >= iAdaptSize)
+			{
+			iAdaptSize = (iAdaptSize > iAdaptMax / 2) ?
+				iAdaptMax : (iAdaptSize * 2);
+			}
+		}
+	else if (aLength < aSize / 4)
+		{
+		if (++iAdaptLow >= KShrinkAfter)
+			{
+			iAdaptLow = 0;
+			iAdaptSize = (iAdaptSize / 2 < iAdaptMin) ?
+				iAdaptMin : (iAdaptSize / 2);
+			}
+		}
+	else
+		{
+		iAdaptLow = 0;
+		}
+	}
+
 void CSocketReader::ReadExactL(TInt aSize)
 	{
-	if (IsActive())
+	if (IsBusy())
 		{
 		AssertFail();
 		return;
 		}
-	ClearData();
-
-	// may have MaxLength() larger than requested
-	iData = HBufC8::NewL(aSize);
-	iDataPtr.Set(const_cast<TUint8*>(iData->Ptr()), 0, aSize);
-	iDataPtr.FillZ(); // not necessary
+	iStreaming = EFalse;
+	iMode = EReadSome;
+	iAdapting = EFalse;
+	TInt ahead = iAheadEnd - iAheadStart;
+	if (ahead >= aSize)
+		{
+		iFromAhead = aSize;
+		CompleteAhead();
+		return;
+		}
+	AllocDataL(aSize);
+	// what we have read ahead goes first
+	iPrefix = ahead;
+	if (ahead > 0)
+		{
+		Mem::Copy(iBuf, iAhead + iAheadStart, ahead);
+		ConsumeAhead(ahead);
+		iDataPtr.Set(iBuf + ahead, 0, aSize - ahead);
+		}
 	// note that we want to use Recv() here instead of Read(),
 	// as in the event of cancellation, we use CancelRecv();
 	// do not know whether a Read() can be cancelled with that
@@ -507,12 +986,839 @@ void CSocketReader::ReadExactL(TInt aSize)
 	SetActive();
 	}
 
-void CSocketReader::ClearData()
+void CSocketReader::ReadInto(TUint8* aData, TInt aMaxSize)
 	{
-	if (iData)
+	if (IsBusy())
 		{
-		iDataPtr.Set(NULL, 0, 0);
-		delete iData;
-		iData = NULL;
+		AssertFail();
+		return;
+		}
+	iStreaming = EFalse;
+	iMode = EReadSome;
+	iAdapting = EFalse;
+	iInto = ETrue;
+	iIntoPtr.Set(aData, 0, aMaxSize);
+	if (HasReadAhead())
+		{
+		TakeReadAhead(iIntoPtr);
+		CompleteAhead();
+		return;
+		}
+	iSocket.RecvOneOrMore(iIntoPtr, 0, iStatus, iDummyLen);
+	SetActive();
+	}
+
+void CSocketReader::TakeReadAhead(TDes8& aData)
+	{
+	TInt length = iAheadEnd - iAheadStart;
+	TInt room = aData.MaxLength() - aData.Length();
+	if (length > room)
+		{
+		length = room;
+		}
+	aData.Append(iAhead + iAheadStart, length);
+	ConsumeAhead(length);
+	}
+
+void CSocketReader::ReadUntilL(const TDesC8& aDelim, TInt aMaxLen)
+	{
+	if (IsBusy())
+		{
+		AssertFail();
+		return;
+		}
+	iDelim = aDelim;
+	iMaxLen = aMaxLen;
+	iMode = EReadUntil;
+	ReadAheadL();
+	}
+
+void CSocketReader::ReadFrameL(TFrameHeader aHeader, TInt aMaxSize)
+	{
+	if (IsBusy())
+		{
+		AssertFail();
+		return;
+		}
+	iHeader = aHeader;
+	iMaxLen = aMaxSize;
+	iMode = EReadFrame;
+	ReadAheadL();
+	}
+
+// Either completes right away, or asks for more data. The limit of
+// the read only caps the read-ahead buffer, which starts out small,
+// and grows as the record turns out to need more room.
+void CSocketReader::ReadAheadL()
+	{
+	ReserveAheadL(KMinAhead);
+	iStreaming = EFalse;
+	iScanned = 0;
+	TInt skip;
+	if (FindRecord(skip) != 0)
+		{
+		// already have a record, or know that there is none
+		CompleteAhead();
+		}
+	else
+		{
+		GrowAheadL();
+		RecvAhead();
+		}
+	}
+
+// Returns EFalse if more data is required, and has been asked for.
+// Otherwise sets aData to the record to deliver, or aError to the
+// error to deliver instead.
+TBool CSocketReader::RecordReady(TInt& aError, TPtrC8& aData)
+	{
+	if (iAheadRecv)
+		{
+		iAheadRecv = EFalse;
+		if (aError)
+			{
+			iMode = EReadSome;
+			return ETrue;
+			}
+		iAheadEnd += iAheadPtr.Length();
+		iAheadPtr.Set(NULL, 0, 0);
+		}
+	TInt skip = 0;
+	TInt length = FindRecord(skip);
+	if (length == 0)
+		{
+		TRAPD(error, GrowAheadL());
+		if (error)
+			{
+			iMode = EReadSome;
+			aError = error;
+			return ETrue;
+			}
+		RecvAhead();
+		return EFalse;
+		}
+	iMode = EReadSome;
+	if (length < 0)
+		{
+		aError = length;
+		return ETrue;
+		}
+	aData.Set(iAhead + iAheadStart + skip, length - skip);
+	ConsumeAhead(length);
+	return ETrue;
+	}
+
+// Returns KErrNotFound if aDelim does not occur within the data.
+static TInt FindDelimiter(const TUint8* aData, TInt aLength,
+						  const TDesC8& aDelim)
+	{
+	if (aLength < aDelim.Length())
+		{
+		return KErrNotFound;
 		}
+#if ON_HOST
+	// these are vectorized in any decent C library
+	const TAny* found = (aDelim.Length() == 1) ?
+		memchr(aData, aDelim[0], aLength) :
+		memmem(aData, aLength, aDelim.Ptr(), aDelim.Length());
+	return found ? (static_cast<const TUint8*>(found) - aData) :
+		KErrNotFound;
+#else
+	return TPtrC8(aData, aLength).Find(aDelim);
+#endif
+	}
+
+/** Returns the length of the first record in the read-ahead buffer,
+	header and delimiter included, or zero if there is no complete
+	record yet, or an error if there never will be. aSkip is set to
+	the length of any header, which is not delivered.
+*/
+TInt CSocketReader::FindRecord(TInt& aSkip)
+	{
+	aSkip = 0;
+	if (iMode == EReadFrame)
+		{
+		return FindFrame(aSkip);
+		}
+	TInt ahead = iAheadEnd - iAheadStart;
+	TInt length = (ahead < iMaxLen) ? ahead : iMaxLen;
+	// no need to look at what we have looked at before, except
+	// for where a delimiter may have been cut short
+	TInt pos = FindDelimiter(iAhead + iAheadStart + iScanned,
+							 length - iScanned, iDelim);
+	if (pos != KErrNotFound)
+		{
+		pos += iScanned;
+		iScanned = 0;
+		return pos + iDelim.Length();
+		}
+	if (ahead >= iMaxLen)
+		{
+		return KErrOverflow;
+		}
+	iScanned = ahead - iDelim.Length() + 1;
+	if (iScanned < 0)
+		{
+		iScanned = 0;
+		}
+	return 0;
+	}
+
+/** Returns the length of the header, or zero if incomplete, or
+	KErrCorrupt if malformed.
+*/
+static TInt ParseFrameHeader(CSocketReader::TFrameHeader aHeader,
+							 const TUint8* aData, TInt aLength,
+							 TUint32& aSize)
+	{
+	switch (aHeader)
+		{
+	case CSocketReader::EFrameU8:
+		if (aLength < 1) return 0;
+		aSize = aData[0];
+		return 1;
+	case CSocketReader::EFrameU16Be:
+		if (aLength < 2) return 0;
+		aSize = (aData[0] << 8) | aData[1];
+		return 2;
+	case CSocketReader::EFrameU16Le:
+		if (aLength < 2) return 0;
+		aSize = aData[0] | (aData[1] << 8);
+		return 2;
+	case CSocketReader::EFrameU32Be:
+		if (aLength < 4) return 0;
+		aSize = (TUint32(aData[0]) << 24) | (aData[1] << 16) |
+			(aData[2] << 8) | aData[3];
+		return 4;
+	case CSocketReader::EFrameU32Le:
+		if (aLength < 4) return 0;
+		aSize = aData[0] | (aData[1] << 8) | (aData[2] << 16) |
+			(TUint32(aData[3]) << 24);
+		return 4;
+	default:
+		{
+		aSize = 0;
+		for (TInt i = 0; i < CSocketReader::KMaxFrameHeader; i++)
+			{
+			if (i == aLength)
+				{
+				return 0;
+				}
+			if (i == CSocketReader::KMaxFrameHeader - 1 && aData[i] > 0x0f)
+				{
+				// would not fit in 32 bits
+				return KErrCorrupt;
+				}
+			aSize |= TUint32(aData[i] & 0x7f) << (7 * i);
+			if (!(aData[i] & 0x80))
+				{
+				return i + 1;
+				}
+			}
+		return KErrCorrupt;
+		}
+		}
+	}
+
+TInt CSocketReader::FindFrame(TInt& aSkip)
+	{
+	TInt ahead = iAheadEnd - iAheadStart;
+	TUint32 size;
+	TInt header = ParseFrameHeader(iHeader, iAhead + iAheadStart,
+								   ahead, size);
+	if (header <= 0)
+		{
+		return header;
+		}
+	if (size > TUint32(iMaxLen))
+		{
+		return KErrOverflow;
+		}
+	if (ahead < header + TInt(size))
+		{
+		return 0;
+		}
+	aSkip = header;
+	return header + size;
+	}
+
+// Makes room for more of an incomplete record. A frame needs as much
+// as its header says, once we have the header, and a delimited
+// record gets twice the room whenever the buffer is full, up to the
+// limit, beyond which FindRecord() would have given up.
+void CSocketReader::GrowAheadL()
+	{
+	TInt ahead = iAheadEnd - iAheadStart;
+	TInt size = 0;
+	if (iMode == EReadFrame)
+		{
+		TUint32 frame;
+		TInt header = ParseFrameHeader(iHeader, iAhead + iAheadStart,
+									   ahead, frame);
+		size = (header > 0) ? (header + TInt(frame)) : KMaxFrameHeader;
+		}
+	else if (ahead >= iAheadSize)
+		{
+		size = (iAheadSize < iMaxLen / 2) ? (iAheadSize * 2) : iMaxLen;
+		}
+	ReserveAheadL(size);
+	}
+
+// Receives more data into the read-ahead buffer, first moving the
+// data there to the start of the buffer if there is little room
+// at the end. There is always room for at least one byte, as
+// GrowAheadL() has made room for the record, and we only ask for
+// more while it is incomplete.
+void CSocketReader::RecvAhead()
+	{
+	if (iAheadStart > 0 && (iAheadSize - iAheadEnd) < iAheadSize / 4)
+		{
+		Mem::Copy(iAhead, iAhead + iAheadStart, iAheadEnd - iAheadStart);
+		iAheadEnd -= iAheadStart;
+		iAheadStart = 0;
+		}
+	iAheadPtr.Set(iAhead + iAheadEnd, 0, iAheadSize - iAheadEnd);
+	iAheadRecv = ETrue;
+	iSocket.RecvOneOrMore(iAheadPtr, 0, iStatus, iDummyLen);
+	SetActive();
+	}
+
+void CSocketReader::ReserveAheadL(TInt aSize)
+	{
+	if (iAhead && iAheadSize >= aSize)
+		{
+		return;
+		}
+	if (!iPool)
+		{
+		iPool = CBufferPool::InstanceL();
+		}
+	TInt size;
+	TUint8* ahead = iPool->AllocL(
+		(aSize > KMinAhead) ? aSize : KMinAhead, size);
+	TInt length = iAheadEnd - iAheadStart;
+	if (iAhead)
+		{
+		Mem::Copy(ahead, iAhead + iAheadStart, length);
+		iPool->Free(iAhead, iAheadSize, iPoolKeep);
+		}
+	iAhead = ahead;
+	iAheadSize = size;
+	iAheadStart = 0;
+	iAheadEnd = length;
+	}
+
+void CSocketReader::ConsumeAhead(TInt aLength)
+	{
+	iAheadStart += aLength;
+	if (iAheadStart == iAheadEnd)
+		{
+		iAheadStart = iAheadEnd = 0;
+		}
+	}
+
+// Completes a read served from the read-ahead buffer, or if made
+// from within the callback, has RunL() deliver it next.
+void CSocketReader::CompleteAhead()
+	{
+	if (iDeleted)
+		{
+		iInline = ETrue;
+		}
+	else
+		{
+		SelfComplete();
+		}
+	}
+
+void CSocketReader::SelfComplete()
+	{
+	iStatus = KRequestPending;
+	SetActive();
+	TRequestStatus* status = &iStatus;
+	User::RequestComplete(status, KErrNone);
+	}
+
+// Any buffer still being read into goes back to the pool first.
+void CSocketReader::AllocDataL(TInt aSize)
+	{
+	ClearData();
+	if (!iPool)
+		{
+		iPool = CBufferPool::InstanceL();
+		}
+	// the buffer may be larger than requested, but we only
+	// want as much as requested
+	iBuf = iPool->AllocL(aSize, iBufSize);
+	iDataPtr.Set(iBuf, 0, aSize);
+	}
+
+TUint8* CSocketReader::DetachData(TInt& aCapacity, CBufferPool*& aPool,
+								  TInt& aKeep)
+	{
+	TUint8* buf = iDone;
+	aCapacity = iDoneSize;
+	aPool = iPool;
+	aKeep = iPoolKeep;
+	iDone = NULL;
+	return buf;
+	}
+
+void CSocketReader::ClearData()
+	{
+	if (iBuf)
+		{
+		iDataPtr.Set(NULL, 0, 0);
+		iPool->Free(iBuf, iBufSize, iPoolKeep);
+		iBuf = NULL;
+		}
+	}
+
+// The read-ahead buffer also goes back to the pool once drained,
+// as a large record may have grown it, and the data delivered from
+// it is no longer needed either.
+void CSocketReader::ClearDone()
+	{
+	if (iDone)
+		{
+		iPool->Free(iDone, iDoneSize, iPoolKeep);
+		iDone = NULL;
+		}
+	if (iAhead && iAheadStart == iAheadEnd && !iAheadRecv)
+		{
+		iPool->Free(iAhead, iAheadSize, iPoolKeep);
+		iAhead = NULL;
+		iAheadSize = 0;
+		}
+	}
+
+// -----------------------------------------------------------
+// CSocketRelay...
+
+CSocketRelay::CSocketRelay(MAoSockObserver& aObserver,
+						   RSocket& aFrom) :
+	CActive(EPriorityStandard),
+	iObserver(aObserver),
+	iFrom(aFrom),
+	iPtr(NULL, 0, 0)
+	{
+	CActiveScheduler::Add(this);
+	}
+
+CSocketRelay::~CSocketRelay()
+	{
+	Cancel();
+	ClearBuf();
+	}
+
+void CSocketRelay::DoCancel()
+	{
+	if (!iTo)
+		{
+		// Abort() has completed the request already
+		return;
+		}
+	if (iWriting)
+		{
+		iTo->CancelWrite();
+		}
+	else
+		{
+		iFrom.CancelRecv();
+		}
+	}
+
+void CSocketRelay::StartL(RSocket& aTo, CSocketReader* aReader)
+	{
+	if (IsActive())
+		{
+		AssertFail();
+		return;
+		}
+	if (!iBuf)
+		{
+		if (!iPool)
+			{
+			iPool = CBufferPool::InstanceL();
+			}
+		iBuf = iPool->AllocL(KChunkSize, iBufSize);
+		}
+	iTo = &aTo;
+	iReader = aReader;
+	iCount = 0;
+	Recv();
+	}
+
+void CSocketRelay::Abort(TInt aError)
+	{
+	if (!IsActive())
+		{
+		return;
+		}
+	Cancel();
+	// a write may have gone through before the cancel did
+	if (iWriting && iStatus == KErrNone)
+		{
+		iCount += iPtr.Length();
+		}
+	iTo = NULL;
+	iWriting = EFalse;
+	iStatus = KRequestPending;
+	SetActive();
+	TRequestStatus* status = &iStatus;
+	User::RequestComplete(status, aError);
+	}
+
+// Takes what has been read ahead first, if anything.
+void CSocketRelay::Recv()
+	{
+	iPtr.Set(iBuf, 0, KChunkSize);
+	if (iReader && iReader->HasReadAhead())
+		{
+		iReader->TakeReadAhead(iPtr);
+		Write();
+		return;
+		}
+	iReader = NULL;
+	iWriting = EFalse;
+	iFrom.RecvOneOrMore(iPtr, 0, iStatus, iDummyLen);
+	SetActive();
+	}
+
+void CSocketRelay::Write()
+	{
+	iWriting = ETrue;
+	iTo->Write(iPtr, iStatus);
+	SetActive();
+	}
+
+void CSocketRelay::RunL()
+	{
+	TInt error = iStatus.Int();
+	if (error == KErrNone)
+		{
+		if (iWriting)
+			{
+			iCount += iPtr.Length();
+			Recv();
+			}
+		else
+			{
+			Write();
+			}
+		return;
+		}
+	if (error == KErrEof && !iWriting)
+		{
+		error = KErrNone;
+		}
+	// the buffer is only needed again if restarted
+	ClearBuf();
+	iObserver.DataRelayed(error, iCount);
+	// note that the callback might do anything, such
+	// as destroying this object
+	}
+
+void CSocketRelay::ClearBuf()
+	{
+	if (iBuf)
+		{
+		iPtr.Set(NULL, 0, 0);
+		iPool->Free(iBuf, iBufSize, CBufferPool::KDefaultKeep);
+		iBuf = NULL;
+		}
+	}
+
+// -----------------------------------------------------------
+// CFileReceiver...
+
+CFileReceiver::CFileReceiver(MAoSockObserver& aObserver,
+							 RSocket& aFrom) :
+	CActive(EPriorityStandard),
+	iObserver(aObserver),
+	iFrom(aFrom),
+	iPtr(NULL, 0, 0)
+	{
+	CActiveScheduler::Add(this);
+	}
+
+CFileReceiver::~CFileReceiver()
+	{
+	Cancel();
+	iFile.Close();
+	iFs.Close();
+	if (iBuf)
+		{
+		iPool->Free(iBuf, iBufSize, CBufferPool::KDefaultKeep);
+		}
+	}
+
+void CFileReceiver::DoCancel()
+	{
+	iFrom.CancelRecv();
+	iFile.Close();
+	}
+
+void CFileReceiver::StartL(const TDesC& aPath, TInt aOffset,
+						   TInt aLength, TInt aInterval,
+						   CSocketReader* aReader)
+	{
+	if (IsActive())
+		{
+		AssertFail();
+		return;
+		}
+	if (!iFs.Handle())
+		{
+		User::LeaveIfError(iFs.Connect());
+		}
+	TUint mode = EFileWrite | EFileShareExclusive;
+	TInt error = iFile.Open(iFs, aPath, mode);
+	if (error == KErrNotFound)
+		{
+		error = iFile.Create(iFs, aPath, mode);
+		}
+	User::LeaveIfError(error);
+	if (!iBuf)
+		{
+		if (!iPool)
+			{
+			iPool = CBufferPool::InstanceL();
+			}
+		TRAP(error, iBuf = iPool->AllocL(KChunkSize, iBufSize));
+		if (error)
+			{
+			iFile.Close();
+			User::Leave(error);
+			}
+		}
+	iReader = aReader;
+	iOffset = aOffset;
+	iLength = aLength;
+	iCount = 0;
+	iInterval = aInterval;
+	iNextReport = aInterval;
+	Recv();
+	}
+
+// Takes what has been read ahead first, if anything, and never
+// asks for more than there is left to receive.
+void CFileReceiver::Recv()
+	{
+	TInt size = KChunkSize;
+	if (iLength >= 0 && iLength - iCount < size)
+		{
+		size = iLength - iCount;
+		}
+	iPtr.Set(iBuf, 0, size);
+	if (iReader && iReader->HasReadAhead())
+		{
+		iReader->TakeReadAhead(iPtr);
+		iStatus = KRequestPending;
+		SetActive();
+		TRequestStatus* status = &iStatus;
+		User::RequestComplete(status, KErrNone);
+		return;
+		}
+	iReader = NULL;
+	iFrom.RecvOneOrMore(iPtr, 0, iStatus, iDummyLen);
+	SetActive();
+	}
+
+void CFileReceiver::RunL()
+	{
+	TInt error = iStatus.Int();
+	if (error == KErrEof && iLength < 0)
+		{
+		Finish(KErrNone);
+		return;
+		}
+	if (error == KErrNone)
+		{
+		error = iFile.Write(iOffset + iCount, iPtr);
+		}
+	if (error)
+		{
+		Finish(error);
+		return;
+		}
+	iCount += iPtr.Length();
+	if (iCount == iLength)
+		{
+		Finish(KErrNone);
+		return;
+		}
+	Recv();
+	if (iInterval > 0 && iCount >= iNextReport)
+		{
+		iNextReport = iCount - (iCount % iInterval) + iInterval;
+		iObserver.DataSaved(KRequestPending, iCount);
+		// note that the callback might do anything, such
+		// as destroying this object
+		}
+	}
+
+void CFileReceiver::Finish(TInt aError)
+	{
+	iFile.Close();
+	iObserver.DataSaved(aError, iCount);
+	// again, do not do anything here
+	}
+
+// -----------------------------------------------------------
+// CFileSender...
+
+CFileSender::CFileSender(MAoSockObserver& aObserver, RSocket& aTo) :
+	CActive(EPriorityStandard),
+	iObserver(aObserver),
+	iTo(aTo)
+#if !ON_HOST
+	, iPtr(NULL, 0, 0)
+#endif
+	{
+	CActiveScheduler::Add(this);
+	}
+
+CFileSender::~CFileSender()
+	{
+	Cancel();
+	iFile.Close();
+	iFs.Close();
+#if !ON_HOST
+	if (iBuf)
+		{
+		iPool->Free(iBuf, iBufSize, CBufferPool::KDefaultKeep);
+		}
+#endif
+	}
+
+void CFileSender::DoCancel()
+	{
+	iTo.CancelWrite();
+	iFile.Close();
+	}
+
+void CFileSender::OpenL(const TDesC& aPath, TInt aFd)
+	{
+	if (aFd >= 0)
+		{
+#if ON_HOST
+		User::LeaveIfError(iFile.HostDuplicate(aFd));
+		return;
+#else
+		User::Leave(KErrNotSupported);
+#endif
+		}
+	if (!iFs.Handle())
+		{
+		User::LeaveIfError(iFs.Connect());
+		}
+	User::LeaveIfError(iFile.Open(iFs, aPath,
+								  EFileRead | EFileShareReadersOnly));
+	}
+
+void CFileSender::StartL(const TDesC& aPath, TInt aFd,
+						 TInt aOffset, TInt aCount)
+	{
+	if (IsActive())
+		{
+		AssertFail();
+		return;
+		}
+	OpenL(aPath, aFd);
+	TInt error = KErrNone;
+	if (aCount < 0)
+		{
+		TInt size;
+		error = iFile.Size(size);
+		aCount = (size > aOffset) ? (size - aOffset) : 0;
+		}
+#if !ON_HOST
+	if (!error && !iBuf)
+		{
+		if (!iPool)
+			{
+			TRAP(error, iPool = CBufferPool::InstanceL());
+			}
+		if (!error)
+			{
+			TRAP(error, iBuf = iPool->AllocL(KChunkSize, iBufSize));
+			}
+		}
+#endif
+	if (error)
+		{
+		iFile.Close();
+		User::Leave(error);
+		}
+	iOffset = aOffset;
+	iCount = aCount;
+	iSent() = 0;
+#if ON_HOST
+	iTo.HostSendFile(iFile, iOffset, iCount, iStatus, iSent);
+	SetActive();
+#else
+	error = Send();
+	if (error)
+		{
+		iStatus = KRequestPending;
+		SetActive();
+		TRequestStatus* status = &iStatus;
+		User::RequestComplete(status, error);
+		}
+#endif
+	}
+
+#if !ON_HOST
+// Reads the next chunk, and writes it, unless there is an error.
+TInt CFileSender::Send()
+	{
+	TInt size = iCount - iSent();
+	if (size > KChunkSize)
+		{
+		size = KChunkSize;
+		}
+	iPtr.Set(iBuf, 0, KChunkSize);
+	TInt error = iFile.Read(iOffset + iSent(), iPtr, size);
+	if (error)
+		{
+		return error;
+		}
+	if (iPtr.Length() == 0 && size > 0)
+		{
+		return KErrEof;
+		}
+	iTo.Write(iPtr, iStatus);
+	SetActive();
+	return KErrNone;
+	}
+#endif
+
+void CFileSender::RunL()
+	{
+	TInt error = iStatus.Int();
+#if !ON_HOST
+	if (error == KErrNone && iPtr.Length() > 0)
+		{
+		iSent() += iPtr.Length();
+		iPtr.SetLength(0);
+		if (iSent() < iCount)
+			{
+			error = Send();
+			if (!error)
+				{
+				return;
+				}
+			}
+		}
+#endif
+	Finish(error);
+	}
+
+void CFileSender::Finish(TInt aError)
+	{
+	iFile.Close();
+	iObserver.FileSent(aError, iSent());
+	// note that the callback might do anything, such
+	// as destroying this object
 	}
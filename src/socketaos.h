@@ -34,8 +34,12 @@
 
 #include <e32std.h>
 #include <es_sock.h>
+#include <f32file.h>
 #include "local_symbian_utils.h"
 #include "settings.h"
+#include "timerwheel.h"
+
+class CBufferPool;
 
 // --------------------------------------------------------------------
 // MAoSockObserver...
@@ -48,6 +52,10 @@ public:
 	virtual void ClientAccepted(TInt aError) = 0;
 	virtual void ClientConnected(TInt aError) = 0;
 	virtual void SocketConfigured(TInt aError) = 0;
+	virtual void DataRelayed(TInt aError, TInt64 aCount) = 0;
+	// aError is KRequestPending for progress reports
+	virtual void DataSaved(TInt aError, TInt aCount) = 0;
+	virtual void FileSent(TInt aError, TInt aCount) = 0;
 	};
 
 // --------------------------------------------------------------------
@@ -181,21 +189,71 @@ private:
 // Note that the Series 60 SDK 'sockets' example provides
 // a useful example for an active object like this.
 
+/** Any number of writes may be made without waiting for earlier
+	ones to complete. Those made while a send is in progress are
+	queued, and go out together once it completes, as a single
+	gathered send on the host. Each write, or batch of writes, is
+	reported in turn, in the order made. An error fails every write
+	queued, since the stream is then broken.
+*/
 NONSHARABLE_CLASS(CSocketWriter) : public CActive
 	{
+public:
+	// the most writes that go out in a single send
+	enum { KMaxGather = 64 };
 public:
 	CSocketWriter(MAoSockObserver& aObserver, RSocket& aSocket);
 	~CSocketWriter();
 	// the passed data need not persist after call
 	void WriteDataL(const TDesC8& aData);
+	// Sends straight from each of aData in turn, the memory of which
+	// must persist until the write is reported, or until Clear().
+	// The lot gets reported once, as a single write.
+	void WriteBatchL(const TPtrC8* aData, TInt aCount);
+	// whether there are writes not yet reported
+	TBool IsBusy() const { return iHead || iDone; }
+	// the number of bytes of the writes not yet reported
+	TInt QueuedBytes() const { return iQueued; }
+	// drops every write, without reporting any
+	void Clear();
+	// cancels, and reports aError for every write
+	void Fail(TInt aError);
 protected:
 	void DoCancel();
 	void RunL();
+private:
+	// a queued write, followed by any copy of the data
+	class TWriteItem
+		{
+	public:
+		TWriteItem* iNext;
+		const TUint8* iPtr;
+		TInt iLength;
+		// unset for all but the last of a batch
+		TBool iReport;
+		};
 private:
 	MAoSockObserver& iObserver;
 	RSocket& iSocket;
-	HBufC8* iData;
-	void ClearData();
+	// the queue, the first iSending items of which are being sent
+	TWriteItem* iHead;
+	TWriteItem* iTail;
+	TInt iSending;
+	TInt iQueued;
+	// the writes still to be reported
+	TWriteItem* iDone;
+	// non-NULL while reporting; set to ETrue if we get deleted
+	TBool* iDeleted;
+#if ON_HOST
+	TPtrC8 iGather[KMaxGather];
+#else
+	TPtrC8 iSendPtr;
+#endif
+	void Send();
+	void Queue(TWriteItem* aFirst, TWriteItem* aLast);
+	void TakeDone(TWriteItem* aLast);
+	void Report(TInt aError);
+	static void FreeItems(TWriteItem*& aItems);
 	};
 
 // --------------------------------------------------------------------
@@ -204,23 +262,322 @@ private:
 // Note that the Series 60 SDK 'sockets' example provides
 // a useful example for an active object like this.
 
-NONSHARABLE_CLASS(CSocketReader) : public CActive
+NONSHARABLE_CLASS(CSocketReader) :
+	public CActive, public MWheelTimerObserver
 	{
+public:
+	// the longest delimiter that ReadUntilL() accepts
+	enum { KMaxDelimiter = 16 };
+	// the smallest read-ahead buffer we bother with
+	enum { KMinAhead = 4096 };
+	// how many underfilled receives in a row make the adaptive
+	// receive size shrink
+	enum { KShrinkAfter = 4 };
+	// how many reads served from the read-ahead buffer we deliver
+	// in one go, before letting other objects run
+	enum { KMaxInline = 16 };
+	// the longest frame header, that of EFrameVarint
+	enum { KMaxFrameHeader = 5 };
+	// frame length prefixes for ReadFrameL()
+	enum TFrameHeader
+		{
+		EFrameU8,
+		EFrameU16Be,
+		EFrameU16Le,
+		EFrameU32Be,
+		EFrameU32Le,
+		// unsigned LEB128, at most five bytes
+		EFrameVarint,
+		EFrameHeaderCount
+		};
 public:
 	CSocketReader(MAoSockObserver& aObserver, RSocket& aSocket);
 	~CSocketReader();
 	void ReadSomeL(TInt aMaxSize);
 	void ReadExactL(TInt aSize);
+	// Delivers the data up to and including the next occurrence
+	// of aDelim, or KErrOverflow if there is none within the first
+	// aMaxLen bytes. Reads ahead, keeping any data beyond the
+	// delimiter for subsequent reads of any kind.
+	void ReadUntilL(const TDesC8& aDelim, TInt aMaxLen);
+	// Delivers the payload of the next frame, which begins with a
+	// length of format aHeader, or KErrOverflow if the length
+	// exceeds aMaxSize, or KErrCorrupt if it is malformed. Reads
+	// ahead as ReadUntilL() does.
+	void ReadFrameL(TFrameHeader aHeader, TInt aMaxSize);
+	// Receives at most aMaxSize bytes into memory owned by the caller,
+	// which must stay put until delivery or cancellation. The data
+	// delivered is that memory.
+	void ReadInto(TUint8* aData, TInt aMaxSize);
+	// Moves as much read-ahead data as fits into aData, for a read
+	// that does not go through us.
+	void TakeReadAhead(TDes8& aData);
+	// Keeps a RecvOneOrMore() of up to aMaxSize bytes pending, by
+	// making the next request before delivering each chunk. Ends
+	// with StopStreaming(), with any error delivered, or with
+	// another kind of read.
+	void StartStreamingL(TInt aMaxSize);
+	void StopStreaming();
+	TBool IsStreaming() const { return iStreaming; }
+	// like IsActive(), but also true while a read made from within
+	// the callback is waiting to be delivered without a request
+	TBool IsBusy() const { return IsActive() || iInline; }
+	// whether there is data received but not yet delivered
+	TBool HasReadAhead() const { return iAheadEnd > iAheadStart; }
+	// Has ReadSomeL() and StartStreamingL() receive at most as much
+	// as has recently been arriving at a time, between aMin and aMax
+	// bytes, and still no more than asked for. Growing happens as
+	// soon as a receive fills its buffer, and shrinking after a few
+	// that fill less than a quarter. Zero bounds turn this off.
+	void SetAdaptive(TInt aMin, TInt aMax);
+	// While streaming, keeps receiving into the same buffer until
+	// it holds at least aBytes bytes, or is full, or aMicroSeconds
+	// have passed since the first byte, and only then delivers.
+	// The time is rounded up to ticks of the timing wheel. Zero
+	// bytes turn this off.
+	void SetCoalescingL(TInt aBytes, TInt aMicroSeconds);
+	// how many idle buffers per size class the pool may keep when
+	// we give a buffer back to it
+	void SetPoolKeep(TInt aKeep) { iPoolKeep = aKeep; }
+	// Hands over the buffer holding the data being delivered, to be
+	// given back to aPool with aKeep by the new owner. Returns NULL
+	// if the data is in the read-ahead buffer instead.
+	TUint8* DetachData(TInt& aCapacity, CBufferPool*& aPool, TInt& aKeep);
+	// Cancels the pending receive for a deadline. Returns EFalse if
+	// it has completed after all, the result then being delivered.
+	TBool Expire();
 protected:
 	void DoCancel();
 	void RunL();
+private: // MWheelTimerObserver
+	void TimerExpired(TWheelTimer& aTimer);
 private:
 	MAoSockObserver& iObserver;
 	RSocket& iSocket;
-	HBufC8* iData;
+	// drawn from the pool of this thread; the one being read into,
+	// and the one whose data is being delivered
+	TUint8* iBuf;
+	TInt iBufSize;
+	TUint8* iDone;
+	TInt iDoneSize;
+	CBufferPool* iPool;
+	TInt iPoolKeep;
 	TPtr8 iDataPtr;
+	// the number of bytes at the start of iBuf that were taken
+	// from the read-ahead buffer, ahead of iDataPtr
+	TInt iPrefix;
 	TSockXfrLength iDummyLen;
+	TBool iStreaming;
+	TInt iStreamSize;
+
+	// see SetAdaptive(); iAdapting is set while the pending
+	// receive is one of those whose size adapts
+	TInt iAdaptMin;
+	TInt iAdaptMax;
+	TInt iAdaptSize;
+	TInt iAdaptLow;
+	TBool iAdapting;
+
+	// see SetCoalescingL(); the timer is queued from the first
+	// byte of a delivery that is being coalesced
+	TInt iCoalesceBytes;
+	TInt iCoalesceTime;
+	TWheelTimer iCoalesceTimer;
+	CTimerWheel* iTimerWheel;
+
+	// set while reading into the memory of the caller
+	TBool iInto;
+	TPtr8 iIntoPtr;
+
+	// The read-ahead buffer, also from the pool. The data not yet
+	// delivered is between iAheadStart and iAheadEnd; it is moved
+	// to the start of the buffer when room runs out at the end.
+	TUint8* iAhead;
+	TInt iAheadSize;
+	TInt iAheadStart;
+	TInt iAheadEnd;
+	// the part being received into, while iAheadRecv is set
+	TPtr8 iAheadPtr;
+	TBool iAheadRecv;
+	// the number of bytes to deliver from the read-ahead buffer
+	// upon completion, in place of received data
+	TInt iFromAhead;
+	// what is being read into the read-ahead buffer, if anything
+	enum TMode
+		{
+		EReadSome,
+		EReadUntil,
+		EReadFrame
+		};
+	TMode iMode;
+	TBuf8<KMaxDelimiter> iDelim;
+	TFrameHeader iHeader;
+	TInt iMaxLen;
+	// how far the data has been searched for the delimiter
+	TInt iScanned;
+
+	// set when a read made from the callback can be delivered
+	// right away, without completing a request
+	TBool iInline;
+
+	// set while delivering, to tell RunL() if we get deleted
+	TBool* iDeleted;
+	void AllocDataL(TInt aSize);
+	void RecvSomeL(TInt aMaxSize);
+	void Adapt(TInt aLength, TInt aSize);
+	TBool Coalesce(TInt& aError);
+	void SelfComplete();
+	void CompleteAhead();
+	void ReadAheadL();
+	TBool Deliver(TInt aError);
+	void ReserveAheadL(TInt aSize);
+	void GrowAheadL();
+	void ConsumeAhead(TInt aLength);
+	void RecvAhead();
+	TInt FindRecord(TInt& aSkip);
+	TInt FindFrame(TInt& aSkip);
+	TBool RecordReady(TInt& aError, TPtrC8& aData);
 	void ClearData();
+	void ClearDone();
+	};
+
+// --------------------------------------------------------------------
+// CSocketRelay (active object)...
+
+/** Pumps data from one socket to another, by receiving into a
+	buffer from the pool and writing it all out before receiving
+	again, so that a slow receiver holds back the sender. Finishes
+	with KErrNone at the end of the stream, or with the first error
+	on either side, and reports the number of bytes relayed.
+*/
+NONSHARABLE_CLASS(CSocketRelay) : public CActive
+	{
+public:
+	enum { KChunkSize = 16384 };
+public:
+	CSocketRelay(MAoSockObserver& aObserver, RSocket& aFrom);
+	~CSocketRelay();
+	// Relays to aTo, which must stay open until completion or
+	// cancellation. If aReader is given, any data it has read
+	// ahead gets relayed first.
+	void StartL(RSocket& aTo, CSocketReader* aReader);
+	// Cancels the pending request, if any, and then completes
+	// with aError, so that the observer does get told. For when
+	// the socket relayed to goes away.
+	void Abort(TInt aError);
+protected:
+	void DoCancel();
+	void RunL();
+private:
+	MAoSockObserver& iObserver;
+	RSocket& iFrom;
+	// NULL once aborted
+	RSocket* iTo;
+	// not NULL while there may be read-ahead data to relay
+	CSocketReader* iReader;
+	TUint8* iBuf;
+	TInt iBufSize;
+	CBufferPool* iPool;
+	TPtr8 iPtr;
+	TSockXfrLength iDummyLen;
+	// whether the pending request is a write
+	TBool iWriting;
+	TInt64 iCount;
+	void Recv();
+	void Write();
+	void ClearBuf();
+	};
+
+// --------------------------------------------------------------------
+// CFileReceiver (active object)...
+
+/** Receives data from a socket into a file, a buffer from the pool
+	at a time, writing each at its position in the file before
+	receiving more. Finishes with KErrNone once the requested number
+	of bytes has been written, or at the end of the stream if no
+	number was given, or with the first error. Reports progress
+	every time another interval's worth has been written.
+*/
+NONSHARABLE_CLASS(CFileReceiver) : public CActive
+	{
+public:
+	enum { KChunkSize = 65536 };
+public:
+	CFileReceiver(MAoSockObserver& aObserver, RSocket& aFrom);
+	~CFileReceiver();
+	// A negative aLength means until the end of the stream, and
+	// a zero aInterval means no progress reports. The file is
+	// created if it does not exist, and otherwise written over
+	// starting at aOffset. If aReader is given, any data it has
+	// read ahead gets written first.
+	void StartL(const TDesC& aPath, TInt aOffset, TInt aLength,
+				TInt aInterval, CSocketReader* aReader);
+protected:
+	void DoCancel();
+	void RunL();
+private:
+	MAoSockObserver& iObserver;
+	RSocket& iFrom;
+	CSocketReader* iReader;
+	RFs iFs;
+	RFile iFile;
+	TUint8* iBuf;
+	TInt iBufSize;
+	CBufferPool* iPool;
+	TPtr8 iPtr;
+	TSockXfrLength iDummyLen;
+	TInt iOffset;
+	TInt iLength;
+	TInt iCount;
+	TInt iInterval;
+	TInt iNextReport;
+	void Recv();
+	TBool Save();
+	void Finish(TInt aError);
+	};
+
+// --------------------------------------------------------------------
+// CFileSender (active object)...
+
+/** Sends a file, or a part of it, over a socket. On the host the
+	kernel does the copying, with sendfile(). Elsewhere the file gets
+	read a buffer from the pool at a time, each written before the
+	next is read. Finishes with KErrNone once all has been sent, with
+	KErrEof if the file turns out to end first, or with the first
+	error.
+*/
+NONSHARABLE_CLASS(CFileSender) : public CActive
+	{
+public:
+	enum { KChunkSize = 65536 };
+public:
+	CFileSender(MAoSockObserver& aObserver, RSocket& aTo);
+	~CFileSender();
+	// Sends aCount bytes from aOffset, or up to the end of the file
+	// if aCount is negative. The file at aPath is sent unless aFd is
+	// non-negative, and file descriptors are only supported on the
+	// host.
+	void StartL(const TDesC& aPath, TInt aFd, TInt aOffset, TInt aCount);
+protected:
+	void DoCancel();
+	void RunL();
+private:
+	MAoSockObserver& iObserver;
+	RSocket& iTo;
+	RFs iFs;
+	RFile iFile;
+	TInt iOffset;
+	TInt iCount;
+	TSockXfrLength iSent;
+#if !ON_HOST
+	TUint8* iBuf;
+	TInt iBufSize;
+	CBufferPool* iPool;
+	TPtr8 iPtr;
+	TInt Send();
+#endif
+	void OpenL(const TDesC& aPath, TInt aFd);
+	void Finish(TInt aError);
 	};
 
 #endif // __SOCKETAOS_H__
@@ -0,0 +1,95 @@
+// -*- symbian-c++ -*-
+
+//
+// threadlocal.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// Per-thread state shared by the active objects of this library.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "threadlocal.h"
+#include "bufferpool.h"
+#include "pydispatch.h"
+#include "runstats.h"
+#include "timerwheel.h"
+
+#if ON_HOST
+// Frees the locals when the thread exits. Thread locals get
+// destroyed in the reverse order of construction, so this must be
+// constructed after the scheduler of the thread.
+NONSHARABLE_CLASS(TAoThreadLocalsOwner)
+	{
+public:
+	~TAoThreadLocalsOwner() { FreeAoThreadLocals(); }
+	};
+#endif
+
+TAoThreadLocals* AoThreadLocals()
+	{
+	return static_cast<TAoThreadLocals*>(Dll::Tls());
+	}
+
+TAoThreadLocals& AoThreadLocalsL()
+	{
+	TAoThreadLocals* locals = AoThreadLocals();
+	if (!locals)
+		{
+		locals = new (ELeave) TAoThreadLocals;
+		TInt error = Dll::SetTls(locals);
+		if (error)
+			{
+			delete locals;
+			User::Leave(error);
+			}
+#if ON_HOST
+		CActiveScheduler::HostCurrent();
+		static thread_local TAoThreadLocalsOwner owner;
+#endif
+		}
+	return *locals;
+	}
+
+void FreeAoThreadLocals()
+	{
+	TAoThreadLocals* locals = AoThreadLocals();
+	if (!locals)
+		{
+		return;
+		}
+	Dll::SetTls(NULL);
+	delete locals->iDispatcher;
+	delete locals->iTimerWheel;
+#if ON_HOST
+	if (locals->iRunStats)
+		{
+		CActiveScheduler::HostCurrent().HostSetMonitor(NULL);
+		delete locals->iRunStats;
+		}
+#endif
+	delete locals->iBufferPool;
+	delete locals;
+	}
@@ -0,0 +1,83 @@
+// -*- symbian-c++ -*-
+
+//
+// threadlocal.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// Per-thread state shared by the active objects of this library.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __THREADLOCAL_H__
+#define __THREADLOCAL_H__
+
+#include <e32base.h>
+
+class CBufferPool;
+class CPyDispatcher;
+class CRunStats;
+class CTimerWheel;
+
+// --------------------------------------------------------------------
+// TAoThreadLocals...
+
+/** There is only one thread local storage slot per DLL, so all of
+	our per-thread singletons share it by way of this structure.
+	It is created on demand, and lives for as long as the thread
+	does, as do the objects it points to. On the host they get
+	freed when the thread exits, before its scheduler is. On the
+	device they only get freed along with a scheduler that AoLoop
+	installed, when the last loop of the thread is closed.
+*/
+class TAoThreadLocals
+	{
+public:
+	TAoThreadLocals() :
+		iDispatcher(NULL), iTimerWheel(NULL), iRunStats(NULL),
+		iBufferPool(NULL), iLoopCount(0), iScheduler(NULL) {}
+	CPyDispatcher* iDispatcher;
+	CTimerWheel* iTimerWheel;
+	// only while statistics are being kept
+	CRunStats* iRunStats;
+	CBufferPool* iBufferPool;
+	// the number of loops open in this thread, and the scheduler
+	// installed by the first one, if the thread had none
+	TInt iLoopCount;
+	CActiveScheduler* iScheduler;
+	};
+
+// returns the locals of this thread, or NULL if there are none yet
+TAoThreadLocals* AoThreadLocals();
+
+// returns the locals of this thread, creating them if required
+TAoThreadLocals& AoThreadLocalsL();
+
+// Deletes the locals of this thread, and the objects they point
+// to, if there are any. The scheduler that the active ones were
+// added to must still be installed.
+void FreeAoThreadLocals();
+
+#endif // __THREADLOCAL_H__
@@ -0,0 +1,396 @@
+// -*- symbian-c++ -*-
+
+//
+// timerwheel.cpp
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// A hierarchical timing wheel for large numbers of timers.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "timerwheel.h"
+#include "threadlocal.h"
+#include "panic.h"
+
+/** Returns the index of the lowest bit set in a nonzero word,
+	with a de Bruijn sequence, as not all of our compilers have
+	a builtin for it.
+*/
+static TInt LowestBit(TUint32 aWord)
+	{
+	static const TUint8 KTable[32] =
+		{
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+		};
+	return KTable[((aWord & (~aWord + 1)) * 0x077CB531U) >> 27];
+	}
+
+static void LinkLast(TWheelLink& aHead, TWheelLink& aLink)
+	{
+	aLink.iNext = &aHead;
+	aLink.iPrev = aHead.iPrev;
+	aHead.iPrev->iNext = &aLink;
+	aHead.iPrev = &aLink;
+	}
+
+static TBool IsEmpty(const TWheelLink& aHead)
+	{
+	return aHead.iNext == &aHead;
+	}
+
+// --------------------------------------------------------------------
+// CTimerWheel...
+
+CTimerWheel* CTimerWheel::InstanceL()
+	{
+	TAoThreadLocals& locals = AoThreadLocalsL();
+	if (!locals.iTimerWheel)
+		{
+		CTimerWheel* object = new (ELeave) CTimerWheel;
+		CleanupStack::PushL(object);
+		object->ConstructL();
+		CleanupStack::Pop();
+		locals.iTimerWheel = object;
+		}
+	return locals.iTimerWheel;
+	}
+
+CTimerWheel::CTimerWheel() :
+	CActive(EPriorityStandard)
+	{
+	for (TInt i = 0; i < KSlots; i++)
+		{
+		iSlots[i].iNext = iSlots[i].iPrev = &iSlots[i];
+		}
+	iExpired.iNext = iExpired.iPrev = &iExpired;
+	CActiveScheduler::Add(this);
+	}
+
+void CTimerWheel::ConstructL()
+	{
+	TTimeIntervalMicroSeconds32 period;
+	User::LeaveIfError(UserHal::TickPeriod(period));
+	iTickPeriod = period.Int();
+	if (iTickPeriod <= 0)
+		{
+		User::Leave(KErrGeneral);
+		}
+	User::LeaveIfError(iTimer.CreateLocal());
+	iTime = User::TickCount();
+	}
+
+CTimerWheel::~CTimerWheel()
+	{
+	Cancel();
+	iTimer.Close();
+	}
+
+/** Rounds up, and is careful not to overflow for long intervals.
+*/
+TUint32 CTimerWheel::MilliSecondsToTicks(TInt aMilliSeconds) const
+	{
+	if (aMilliSeconds <= 0)
+		{
+		return 0;
+		}
+	TUint32 ms = aMilliSeconds;
+	TUint32 period = iTickPeriod;
+	return (ms / period) * 1000 +
+		((ms % period) * 1000 + period - 1) / period;
+	}
+
+void CTimerWheel::Add(TWheelTimer& aTimer, TInt aMilliSeconds)
+	{
+	Remove(aTimer);
+
+	TUint32 now = User::TickCount();
+	if (iCount == 0 && (TInt32)(now - iTime) > 0)
+		{
+		// nothing to process in between
+		iTime = now;
+		}
+
+	// the current tick is already partly over, so the timer could
+	// otherwise expire a little early
+	TUint32 ticks = MilliSecondsToTicks(aMilliSeconds);
+	if (ticks > 0)
+		{
+		ticks++;
+		}
+	aTimer.iExpires = now + ticks;
+	Insert(aTimer);
+	iCount++;
+
+	if (!IsActive())
+		{
+		Arm();
+		}
+	else if (iStatus == KRequestPending &&
+			 (TInt32)(aTimer.iExpires - iArmedFor) < 0)
+		{
+		Cancel();
+		Arm();
+		}
+	}
+
+void CTimerWheel::Remove(TWheelTimer& aTimer)
+	{
+	if (!aTimer.IsQueued())
+		{
+		return;
+		}
+	if (aTimer.iSlot >= 0)
+		{
+		iCount--;
+		}
+	Unlink(aTimer);
+	}
+
+void CTimerWheel::Insert(TWheelTimer& aTimer)
+	{
+	TUint32 expires = aTimer.iExpires;
+	TUint32 delta = expires - iTime;
+	TInt slot;
+	if (delta < KRootSize)
+		{
+		slot = expires & (KRootSize - 1);
+		}
+	else if ((TInt32)delta < 0)
+		{
+		// already due, so goes to the slot processed next
+		slot = iTime & (KRootSize - 1);
+		}
+	else
+		{
+		if (delta >= KMaxTicks)
+			{
+			// waits at the top, and gets put back when its slot
+			// comes around
+			delta = KMaxTicks - 1;
+			expires = iTime + delta;
+			}
+		TInt level = 0;
+		while (delta >= (1U << (KRootBits + (level + 1) * KLevelBits)))
+			{
+			level++;
+			}
+		TInt index = (expires >> (KRootBits + level * KLevelBits)) &
+			(KLevelSize - 1);
+		slot = KRootSize + level * KLevelSize + index;
+		}
+	aTimer.iSlot = slot;
+	LinkLast(iSlots[slot], aTimer);
+	SetBit(slot);
+	}
+
+void CTimerWheel::Unlink(TWheelTimer& aTimer)
+	{
+	aTimer.iPrev->iNext = aTimer.iNext;
+	aTimer.iNext->iPrev = aTimer.iPrev;
+	aTimer.iNext = aTimer.iPrev = NULL;
+	if (aTimer.iSlot >= 0 && IsEmpty(iSlots[aTimer.iSlot]))
+		{
+		ClearBit(aTimer.iSlot);
+		}
+	}
+
+/** Moves the timers of a slot of a level above the root one level
+	(or more) down, relative to the current time.
+*/
+void CTimerWheel::Cascade(TInt aLevel, TInt aIndex)
+	{
+	TInt slot = KRootSize + aLevel * KLevelSize + aIndex;
+	TWheelLink& head = iSlots[slot];
+	if (IsEmpty(head))
+		{
+		return;
+		}
+	TWheelLink* link = head.iNext;
+	head.iPrev->iNext = NULL;
+	head.iNext = head.iPrev = &head;
+	ClearBit(slot);
+	while (link)
+		{
+		TWheelLink* next = link->iNext;
+		Insert(*static_cast<TWheelTimer*>(link));
+		link = next;
+		}
+	}
+
+/** Processes every tick up to and including aNow, moving the timers
+	that expire into iExpired. Ticks whose slots are empty are
+	skipped over in one go, except where a cascade is due.
+*/
+void CTimerWheel::Advance(TUint32 aNow)
+	{
+	while ((TInt32)(aNow - iTime) >= 0)
+		{
+		if (iCount == 0)
+			{
+			iTime = aNow + 1;
+			return;
+			}
+
+		TInt index = iTime & (KRootSize - 1);
+		if (index == 0)
+			{
+			for (TInt level = 0; level < KLevels; level++)
+				{
+				TInt i = (iTime >> (KRootBits + level * KLevelBits)) &
+					(KLevelSize - 1);
+				Cascade(level, i);
+				if (i != 0)
+					{
+					break;
+					}
+				}
+			}
+
+		TInt next = FindRoot(index);
+		if (next != index)
+			{
+			TUint32 skip = ((next < 0) ? KRootSize : next) - index;
+			TUint32 remaining = aNow - iTime + 1;
+			iTime += (skip < remaining) ? skip : remaining;
+			continue;
+			}
+
+		TWheelLink& head = iSlots[index];
+		while (!IsEmpty(head))
+			{
+			TWheelTimer& timer = *static_cast<TWheelTimer*>(head.iNext);
+			Unlink(timer);
+			timer.iSlot = -1;
+			LinkLast(iExpired, timer);
+			iCount--;
+			}
+		iTime++;
+		}
+	}
+
+// returns the first nonempty root slot from aFrom on, or -1
+TInt CTimerWheel::FindRoot(TInt aFrom) const
+	{
+	TInt word = aFrom >> 5;
+	TUint32 bits = iMap[word] & (~0U << (aFrom & 31));
+	for (;;)
+		{
+		if (bits)
+			{
+			return (word << 5) + LowestBit(bits);
+			}
+		if (++word >= KRootSize / 32)
+			{
+			return -1;
+			}
+		bits = iMap[word];
+		}
+	}
+
+/** Returns the tick at which there may next be something to do,
+	which is either the next nonempty root slot, or the next time the
+	root level wraps around and something needs moving down into it.
+	Requires that there be timers in the slots.
+*/
+TUint32 CTimerWheel::NextWakeup() const
+	{
+	TInt index = iTime & (KRootSize - 1);
+	TInt next = FindRoot(index);
+	if (next >= 0)
+		{
+		return iTime + (next - index);
+		}
+	TUint32 wrap = iTime + (KRootSize - index);
+	TInt i = (wrap >> KRootBits) & (KLevelSize - 1);
+	if (i != 0 && !IsSet(KRootSize + i))
+		{
+		// nothing to move down, so the root level tells all
+		next = FindRoot(0);
+		if (next >= 0)
+			{
+			return wrap + next;
+			}
+		}
+	return wrap;
+	}
+
+void CTimerWheel::Arm()
+	{
+	if (!IsEmpty(iExpired))
+		{
+		iStatus = KRequestPending;
+		SetActive();
+		TRequestStatus* status = &iStatus;
+		User::RequestComplete(status, KErrNone);
+		return;
+		}
+	if (iCount == 0)
+		{
+		return;
+		}
+
+	iArmedFor = NextWakeup();
+	TInt32 ticks = iArmedFor - User::TickCount();
+	TInt delay = 0;
+	if (ticks > 0)
+		{
+		delay = (ticks > KMaxDelay / iTickPeriod) ?
+			KMaxDelay : ticks * iTickPeriod;
+		}
+	iTimer.After(iStatus, delay);
+	SetActive();
+	}
+
+/** Note that a timer may be removed, or another one added, by any
+	callback, and that a callback may also run a nested loop, in
+	which we may get to run again. Hence we only ever take the first
+	expired timer, and make sure we are armed before calling out.
+*/
+void CTimerWheel::RunL()
+	{
+	Advance(User::TickCount());
+	while (!IsEmpty(iExpired))
+		{
+		TWheelTimer& timer = *static_cast<TWheelTimer*>(iExpired.iNext);
+		Unlink(timer);
+		if (!IsActive())
+			{
+			Arm();
+			}
+		timer.iObserver.TimerExpired(timer);
+		}
+	if (!IsActive())
+		{
+		Arm();
+		}
+	}
+
+void CTimerWheel::DoCancel()
+	{
+	// does nothing if we completed the request ourselves
+	iTimer.Cancel();
+	}
@@ -0,0 +1,163 @@
+// -*- symbian-c++ -*-
+
+//
+// timerwheel.h
+//
+// Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+// and the authors.	 All rights reserved.
+//
+// Authors: Tero Hasu <tero.hasu@hut.fi>
+//
+// A hierarchical timing wheel for large numbers of timers.
+//
+
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation files
+// (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge,
+// publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TIMERWHEEL_H__
+#define __TIMERWHEEL_H__
+
+#include <e32base.h>
+
+class TWheelTimer;
+
+// --------------------------------------------------------------------
+// MWheelTimerObserver...
+
+class MWheelTimerObserver
+	{
+public:
+	// the timer is no longer queued when this gets called
+	virtual void TimerExpired(TWheelTimer& aTimer) = 0;
+	};
+
+// --------------------------------------------------------------------
+// TWheelTimer...
+
+class TWheelLink
+	{
+public:
+	TWheelLink() : iNext(NULL), iPrev(NULL) {}
+	TWheelLink* iNext;
+	TWheelLink* iPrev;
+	};
+
+/** A timer entry, embedded in whatever object wants timing. It must
+	not be destroyed while queued, which CTimerWheel::Remove() takes
+	care of.
+*/
+class TWheelTimer : public TWheelLink
+	{
+public:
+	TWheelTimer(MWheelTimerObserver& aObserver) :
+		iObserver(aObserver), iExpires(0), iSlot(0) {}
+	TBool IsQueued() const { return iNext != NULL; }
+private:
+	MWheelTimerObserver& iObserver;
+	// in ticks of the wheel
+	TUint32 iExpires;
+	// the slot we are in while queued
+	TInt iSlot;
+	friend class CTimerWheel;
+	};
+
+// --------------------------------------------------------------------
+// CTimerWheel...
+
+/** A hierarchical timing wheel, as in the classic Linux kernel
+	timers, driven by a single RTimer. There is one instance per
+	thread, shared by every loop run in the thread.
+
+	The wheel ticks with the system tick, and has a root level of 256
+	slots of one tick each, and three levels of 64 slots, each slot
+	spanning the whole of the level below. Adding and removing a
+	timer are constant time operations, and so is expiring one, since
+	a timer gets moved down a level at most three times. Timers further
+	away than the wheel reaches wait in the top level, and simply get
+	put back there when their slot comes around.
+
+	The RTimer is only ever armed for the next nonempty root slot, or
+	for the next time that a slot of the level above needs to be moved
+	down, so there is no periodic wakeup, and no wakeup at all when
+	there are no timers.
+*/
+NONSHARABLE_CLASS(CTimerWheel) : public CActive
+	{
+public:
+	// returns the instance for this thread, creating it if required
+	static CTimerWheel* InstanceL();
+	~CTimerWheel();
+
+	// queues the timer to expire once at least aMilliSeconds have
+	// passed, requeuing it if already queued
+	void Add(TWheelTimer& aTimer, TInt aMilliSeconds);
+	// does nothing unless queued
+	void Remove(TWheelTimer& aTimer);
+private:
+	enum
+		{
+		KRootBits = 8,
+		KRootSize = 1 << KRootBits,
+		KLevelBits = 6,
+		KLevelSize = 1 << KLevelBits,
+		KLevels = 3,
+		KSlots = KRootSize + KLevels * KLevelSize,
+		// the number of ticks that the wheel reaches
+		KMaxTicks = 1 << (KRootBits + KLevels * KLevelBits),
+		// the longest we arm the RTimer for, in microseconds
+		KMaxDelay = 30 * 60 * 1000000
+		};
+private:
+	CTimerWheel();
+	void ConstructL();
+	void RunL();
+	void DoCancel();
+	TUint32 MilliSecondsToTicks(TInt aMilliSeconds) const;
+	void Insert(TWheelTimer& aTimer);
+	void Unlink(TWheelTimer& aTimer);
+	void Cascade(TInt aLevel, TInt aIndex);
+	void Advance(TUint32 aNow);
+	void SetBit(TInt aSlot) { iMap[aSlot >> 5] |= (1U << (aSlot & 31)); }
+	void ClearBit(TInt aSlot) { iMap[aSlot >> 5] &= ~(1U << (aSlot & 31)); }
+	TBool IsSet(TInt aSlot) const
+		{ return (iMap[aSlot >> 5] >> (aSlot & 31)) & 1; }
+	TInt FindRoot(TInt aFrom) const;
+	TUint32 NextWakeup() const;
+	void Arm();
+private:
+	RTimer iTimer;
+	// the length of a tick, in microseconds
+	TInt iTickPeriod;
+	// the next tick that has not been processed yet
+	TUint32 iTime;
+	// the number of timers in the slots
+	TInt iCount;
+	// the tick that iTimer has been armed to complete at
+	TUint32 iArmedFor;
+
+	// the root level first, then the levels above it in order
+	TWheelLink iSlots[KSlots];
+	// which slots are nonempty
+	TUint32 iMap[KSlots / 32];
+	// timers that have expired but have not been run yet
+	TWheelLink iExpired;
+	};
+
+#endif // __TIMERWHEEL_H__
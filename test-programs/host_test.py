@@ -0,0 +1,1441 @@
+#
+# host_test.py
+# 
+# Copyright 2008 Helsinki Institute for Information Technology (HIIT)
+# and the authors.  All rights reserved.
+# 
+# Authors: Tero Hasu <tero.hasu@hut.fi>
+#
+
+# Permission is hereby granted, free of charge, to any person
+# obtaining a copy of this software and associated documentation files
+# (the "Software"), to deal in the Software without restriction,
+# including without limitation the rights to use, copy, modify, merge,
+# publish, distribute, sublicense, and/or sell copies of the Software,
+# and to permit persons to whom the Software is furnished to do so,
+# subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+# BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+# ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+
+# Exercises the host build of the module (see "make host"), on a
+# loopback TCP connection. Run with "make host-test".
+
+import os
+import select
+import socket
+import struct
+import thread
+import tempfile
+import time
+from pyaosocket import AoLoop, AoImmediate, AoItc, AoTimer, AoSocketServ
+from pyaosocket import AoSocket
+from pyaosocket import EPriorityLow, EPriorityHigh
+from pyaosocket import EFrameU8, EFrameU16Be, EFrameU16Le
+from pyaosocket import EFrameU32Be, EFrameU32Le, EFrameVarint
+from pyaosocket import KRequestPending
+
+PORT = 28451
+KErrCancel = -3
+KErrTimedOut = -33
+
+loop = AoLoop()
+loop.open()
+
+log = []
+
+def check(cond, msg):
+    if not cond:
+        raise AssertionError(msg)
+
+next_port = [PORT]
+
+def new_port():
+    # every listener gets a port of its own, so that connections
+    # lingering from earlier tests make no difference
+    port = next_port[0]
+    next_port[0] += 1
+    return port
+
+class SocketPair:
+    """A client socket connected to a server socket accepted by a
+    listener, all with a session of their own. Any extra arguments
+    go to connect_tcp, after the callback and its parameter."""
+
+    def __init__(self, *connect_args):
+        self.serv = AoSocketServ()
+        self.serv.connect()
+        self.listener = AoSocket()
+        self.client = AoSocket()
+        self.server = AoSocket()
+        try:
+            self.connect(connect_args)
+        except:
+            self.close()
+            raise
+
+    def connect(self, connect_args):
+        for s in (self.listener, self.client, self.server):
+            s.set_socket_serv(self.serv)
+        port = new_port()
+        self.listener.open_tcp()
+        self.listener.listen_tcp(u"127.0.0.1", port, 5)
+        self.server.blank()
+        pending = ["accept", "connect"]
+        def on_done(code, *args):
+            what = args[-1]
+            check(code == 0, "%s error %d" % (what, code))
+            pending.remove(what)
+            if not pending:
+                loop.stop()
+        self.listener.accept_client(self.server, on_done, "accept")
+        self.client.open_tcp()
+        self.client.connect_tcp(u"127.0.0.1", port, on_done, "connect",
+                                *connect_args)
+        loop.start()
+
+    def close(self):
+        for s in (self.client, self.server, self.listener):
+            s.close()
+        self.serv.close()
+
+def imm_cb(code, param):
+    log.append(("immediate", code, param))
+    loop.stop()
+
+def test_immediate():
+    imm = AoImmediate()
+    imm.open()
+    try:
+        imm.complete(imm_cb, "imm")
+        loop.start()
+        check(log.pop() == ("immediate", 0, "imm"), "immediate")
+    finally:
+        imm.close()
+
+def test_batching():
+    # more completions than fit in one batch, plus another thread
+    # that needs the interpreter lock in between
+    loop.set_batching(4)
+    imms = [AoImmediate() for i in range(10)]
+    state = {"count": 0, "ticks": 0}
+    def ticker():
+        while state["count"] < len(imms):
+            state["ticks"] += 1
+            time.sleep(0.001)
+    def cb(code, param):
+        state["count"] += 1
+        if state["count"] == len(imms):
+            loop.stop()
+    try:
+        for imm in imms:
+            imm.open()
+            imm.complete(cb, None)
+        thread.start_new_thread(ticker, ())
+        loop.start()
+        check(state["count"] == len(imms), "batched callbacks")
+        test_immediate()
+    finally:
+        for imm in imms:
+            imm.close()
+        loop.set_batching(0)
+
+    # a nested loop in a batched callback, after which the outer loop
+    # must not block holding the lock
+    loop.set_batching(64)
+    imm = AoImmediate()
+    timer = AoTimer()
+    nested = {"done": False, "ticks": 0}
+    def nested_ticker():
+        while not nested["done"]:
+            nested["ticks"] += 1
+            time.sleep(0.01)
+    def on_timer(code, param):
+        nested["done"] = True
+        loop.stop()
+    def nested_cb(code, param):
+        loop.run_once(0)
+        timer.after(300, on_timer, None)
+    try:
+        imm.open()
+        timer.open()
+        thread.start_new_thread(nested_ticker, ())
+        imm.complete(nested_cb, None)
+        loop.start()
+        check(nested["ticks"] >= 10, "lock held after nested loop")
+    finally:
+        nested["done"] = True
+        imm.close()
+        timer.close()
+        loop.set_batching(0)
+
+def test_priority():
+    low = AoImmediate()
+    high = AoImmediate()
+    order = []
+    try:
+        low.open()
+        high.open()
+        low.set_priority(EPriorityLow)
+        high.set_priority(EPriorityHigh)
+
+        def cb(code, param):
+            order.append(param)
+            if len(order) == 2:
+                loop.stop()
+        low.complete(cb, "low")
+        high.complete(cb, "high")
+        loop.start()
+        check(order == ["high", "low"], "strict priority")
+
+        # a busy high priority object must not starve the other
+        del order[:]
+        def busy(code, param):
+            order.append(param)
+            if "low" in order:
+                loop.stop()
+            elif len(order) < 1000:
+                high.complete(busy, "high")
+        low.complete(cb, "low")
+        high.complete(busy, "high")
+        loop.start()
+        check(order.index("low") < 10, "aging")
+    finally:
+        low.close()
+        high.close()
+
+def test_run_once():
+    # nothing to do: returns after the timeout, or right away
+    t = time.time()
+    check(loop.run_once(0) == 0, "idle step")
+    check(loop.run_once(50) == 0, "idle step with timeout")
+    check(time.time() - t >= 0.045, "step timeout")
+
+    # everything that is ready gets handled in one step
+    imms = [AoImmediate() for i in range(3)]
+    timer = AoTimer()
+    got = []
+    def cb(code, param):
+        got.append(param)
+    try:
+        for imm in imms:
+            imm.open()
+            imm.complete(cb, "imm")
+        check(loop.run_once(1000) >= 3, "ready count")
+        check(got == ["imm"] * 3, "ready callbacks")
+
+        # otherwise the first completion ends the wait
+        timer.open()
+        timer.after(20, cb, "timer")
+        t = time.time()
+        check(loop.run_once(5000) == 1, "timer step")
+        check(got[-1] == "timer", "timer callback")
+        check(time.time() - t < 1, "step ended early")
+    finally:
+        for imm in imms:
+            imm.close()
+        timer.close()
+
+def test_stats():
+    check(loop.stats() == {}, "no stats by default")
+    loop.set_stats(1)
+    imm = AoImmediate()
+    count = {"n": 0}
+    def cb(code, param):
+        count["n"] += 1
+        if count["n"] < 100:
+            imm.complete(cb, None)
+        else:
+            loop.stop()
+    try:
+        imm.open()
+        imm.complete(cb, None)
+        loop.start()
+        stats = loop.stats()
+        check("CAoImmediate" in stats, "stats by class")
+        for name in ("delay", "run"):
+            hist = stats["CAoImmediate"][name]
+            check(hist["count"] == 100, "%s count" % name)
+            check(hist["min"] <= hist["p50"] <= hist["p99"] <= hist["max"],
+                  "%s percentiles" % name)
+            check(sum([n for low, n in hist["buckets"]]) == 100,
+                  "%s buckets" % name)
+        # a callback does take some time
+        check(stats["CAoImmediate"]["run"]["max"] > 0, "run time")
+    finally:
+        imm.close()
+        loop.set_stats(0)
+    check(loop.stats() == {}, "stats off")
+
+def test_timer():
+    # enough timers, far enough apart, to have them cascade down
+    # from the upper levels of the wheel
+    timers = [AoTimer() for i in range(5000)]
+    fired = []
+    def cb(code, param):
+        check(code == 0, "timer error %d" % code)
+        index, due = param
+        check(time.time() >= due - 0.001, "timer %d early" % index)
+        fired.append(index)
+        if len(fired) >= len(timers) - 2:
+            loop.stop()
+    try:
+        start = time.time()
+        for i, t in enumerate(timers):
+            t.open()
+            ms = (i * 7919) % 700
+            t.after(ms, cb, (i, start + ms / 1000.0))
+        timers[0].cancel()
+        # pushed out, well past the others, as a slow run may take a
+        # while to get through them
+        timers[1].reschedule(1500)
+        loop.start()
+        check(0 not in fired and 1 not in fired, "cancel, reschedule")
+        loop.start()
+        check(fired[-1] == 1, "reschedule")
+        check(time.time() - start >= 1.5, "rescheduled late enough")
+    finally:
+        for t in timers:
+            t.close()
+
+def itc_cb(code, param):
+    log.append(("itc", code, param))
+    loop.stop()
+
+def test_itc():
+    itc = AoItc()
+    itc.open()
+    try:
+        itc.request(itc_cb, "itc")
+        def signal():
+            time.sleep(0.05)
+            itc.complete()
+        thread.start_new_thread(signal, ())
+        loop.start()
+        check(log.pop() == ("itc", 0, "itc"), "itc")
+    finally:
+        itc.close()
+
+def test_echo():
+    serv = AoSocketServ()
+    serv.connect()
+    listener = AoSocket()
+    client = AoSocket()
+    server = AoSocket()
+    state = {}
+    payload = "hello, world" * 1000
+    port = new_port()
+    try:
+        for s in (listener, client, server):
+            s.set_socket_serv(serv)
+        listener.open_tcp()
+        listener.listen_tcp(u"127.0.0.1", port, 5)
+        server.blank()
+
+        def on_read(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"] = state.get("got", "") + data
+            if len(state["got"]) < len(payload):
+                server.read_some(4096, on_read, None)
+            else:
+                loop.stop()
+        def on_accept(code, sock, param):
+            check(code == 0, "accept error %d" % code)
+            server.read_some(4096, on_read, None)
+        def on_written(code, param):
+            check(code == 0, "write error %d" % code)
+        def on_connect(code, param):
+            check(code == 0, "connect error %d" % code)
+            client.write_data(payload, on_written, None)
+
+        listener.accept_client(server, on_accept, None)
+        client.open_tcp()
+        client.connect_tcp(u"127.0.0.1", port, on_connect, None)
+        pool = loop.pool_stats()
+        loop.start()
+        check(state["got"] == payload, "echo payload")
+        # the buffers of earlier reads get reused
+        after = loop.pool_stats()
+        check(after["hits"] > pool["hits"], "pool hits")
+        check(after["idle_count"] <= 4, "pool limit")
+
+        # end of stream is reported as an error, as on the device
+        def on_eof(code, data, param):
+            state["eof"] = code
+            loop.stop()
+        client.send_eof()
+        server.read_some(16, on_eof, None)
+        loop.start()
+        check(state["eof"] != 0, "eof")
+    finally:
+        client.close()
+        server.close()
+        listener.close()
+        serv.close()
+
+def test_selector():
+    # drive the loop from select(), as another event loop would
+    fd = loop.fileno()
+    imm = AoImmediate()
+    itc = AoItc()
+    pair = None
+    state = {"got": ""}
+    def run_until(key):
+        deadline = time.time() + 5
+        while key not in state:
+            check(time.time() < deadline, "selector timeout on " + key)
+            r, w, x = select.select([fd], [], [], 1)
+            if r:
+                loop.process_ready()
+    try:
+        # completed from outside of any callback
+        imm.open()
+        imm.complete(lambda code, param: state.update(imm=code), None)
+        run_until("imm")
+
+        # completed by another thread
+        itc.open()
+        itc.request(lambda code, param: state.update(itc=code), None)
+        thread.start_new_thread(lambda: (time.sleep(0.05), itc.complete()),
+                                ())
+        run_until("itc")
+
+        # socket requests made from within callbacks
+        pair = SocketPair()
+        client, server = pair.client, pair.server
+        def on_read(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"] += data
+            if len(state["got"]) < 10000:
+                server.read_some(1000, on_read, None)
+            else:
+                state["done"] = True
+        server.read_some(1000, on_read, None)
+        client.write_data("x" * 10000, lambda code, param: None, None)
+        run_until("done")
+        check(state["got"] == "x" * 10000, "selector payload")
+    finally:
+        imm.close()
+        itc.close()
+        if pair:
+            pair.close()
+
+def test_zero_copy():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {}
+    payload = "abcdef" * 100
+    try:
+        server.set_zero_copy(1)
+        def on_read(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["data"] = data
+            loop.stop()
+        server.read_exact(len(payload), on_read, None)
+        client.write_data(payload, lambda code, param: None, None)
+        loop.start()
+
+        data = state.pop("data")
+        check(type(data) is not str, "buffer object")
+        check(len(data) == len(payload), "buffer length")
+        check(str(data) == payload, "buffer contents")
+        check(data[1] == "b" and data[-1] == "f", "buffer index")
+        check(data[6:9] == "abc", "buffer slice")
+        check(str(buffer(data)) == payload, "old buffer interface")
+        check(memoryview(data).tobytes() == payload, "new buffer interface")
+        # released buffers go back to the pool
+        recycled = loop.pool_stats()["recycled"]
+        del data
+        check(loop.pool_stats()["recycled"] == recycled + 1, "recycled")
+    finally:
+        pair.close()
+
+def test_streaming():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"got": "", "chunks": 0}
+    payload = "0123456789" * 10000
+    try:
+        def on_chunk(code, data, param):
+            check(code == 0, "read error %d" % code)
+            check(len(data) <= 4096, "chunk size")
+            state["got"] += data
+            state["chunks"] += 1
+            if len(state["got"]) == len(payload):
+                server.stop_reading()
+                loop.stop()
+        server.start_reading(4096, on_chunk, None)
+        client.write_data(payload, lambda code, param: None, None)
+        loop.start()
+        check(state["got"] == payload, "streamed payload")
+        check(state["chunks"] >= len(payload) / 4096, "chunk count")
+
+        # an ordinary read may follow, and the end of the stream
+        # ends streaming
+        def on_eof(code, data, param):
+            state["eof"] = code
+            loop.stop()
+        server.start_reading(4096, on_eof, None)
+        client.send_eof()
+        loop.start()
+        check(state["eof"] != 0, "eof while streaming")
+        server.read_some(16, on_eof, None)
+        loop.start()
+    finally:
+        pair.close()
+
+def test_read_until():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"lines": []}
+    try:
+        def on_line(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["lines"].append(data)
+            if len(state["lines"]) == 3:
+                loop.stop()
+            else:
+                server.read_until("\r\n", 64, on_line, None)
+        def on_written(code, param):
+            check(code == 0, "write error %d" % code)
+            if param:
+                client.write_data(param[0], on_written, param[1:])
+        server.read_until("\r\n", 64, on_line, None)
+        # the delimiter gets split across writes, and several
+        # lines arrive in one
+        parts = ["first\r", "\nsecond\r\nthi", "rd\r\nrest"]
+        client.write_data(parts[0], on_written, parts[1:])
+        loop.start()
+        check(state["lines"] == ["first\r\n", "second\r\n", "third\r\n"],
+              "lines read")
+
+        # what was read ahead goes to the next read of any kind
+        def on_rest(code, data, param):
+            state["rest"] = data
+            loop.stop()
+        server.read_some(16, on_rest, None)
+        loop.start()
+        check(state["rest"] == "rest", "read-ahead data")
+
+        # no delimiter within the limit
+        def on_overflow(code, data, param):
+            state["overflow"] = code
+            loop.stop()
+        client.write_data("x" * 32, lambda code, param: None, None)
+        server.read_until("\n", 16, on_overflow, None)
+        loop.start()
+        check(state["overflow"] == -9, "overflow")
+        server.read_exact(32, on_rest, None)
+        loop.start()
+        check(state["rest"] == "x" * 32, "data after overflow")
+
+        # a large limit only caps the buffer, which grows as the
+        # record needs it, and goes back to the pool once drained
+        pool = loop.pool_stats()
+        line = "y" * 10000 + "\n"
+        client.write_data(line, lambda code, param: None, None)
+        server.read_until("\n", 16 << 20, on_rest, None)
+        loop.start()
+        check(state["rest"] == line, "long record")
+        after = loop.pool_stats()
+        check(after["recycled"] > pool["recycled"], "read-ahead released")
+
+        try:
+            server.read_until("", 16, on_rest, None)
+            check(False, "empty delimiter")
+        except ValueError:
+            pass
+    finally:
+        pair.close()
+
+def test_read_frame():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"frames": []}
+    big = "b" * 10000
+    try:
+        def on_frame(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["frames"].append(data)
+            if len(state["frames"]) == 4:
+                loop.stop()
+            else:
+                server.read_frame(EFrameU32Be, 65536, on_frame, None)
+        server.read_frame(EFrameU32Be, 65536, on_frame, None)
+        # several frames at once, one of them empty, and one
+        # larger than the smallest read-ahead buffer
+        frames = ["one", "", "three", big]
+        wire = "".join([struct.pack(">I", len(f)) + f for f in frames])
+        client.write_data(wire, lambda code, param: None, None)
+        loop.start()
+        check(state["frames"] == ["one", "", "three", big], "frames read")
+
+        # the other header formats
+        def on_one(code, data, param):
+            state["one"] = (code, data)
+            loop.stop()
+        for header, prefix in ((EFrameU8, "\x03"),
+                               (EFrameU16Le, "\x03\x00"),
+                               (EFrameU16Be, "\x00\x03"),
+                               (EFrameU32Le, "\x03\x00\x00\x00"),
+                               (EFrameVarint, "\x03")):
+            client.write_data(prefix + "abc", lambda code, param: None, None)
+            server.read_frame(header, 16, on_one, None)
+            loop.start()
+            check(state["one"] == (0, "abc"), "header %d" % header)
+        client.write_data("\xac\x02" + "v" * 300,
+                          lambda code, param: None, None)
+        server.read_frame(EFrameVarint, 300, on_one, None)
+        loop.start()
+        check(state["one"] == (0, "v" * 300), "multibyte varint")
+
+        # too long, with the data left unread
+        client.write_data("\x00\x20" + "x" * 32,
+                          lambda code, param: None, None)
+        server.read_frame(EFrameU16Be, 16, on_one, None)
+        loop.start()
+        check(state["one"][0] == -9, "overflow")
+        server.read_exact(34, on_one, None)
+        loop.start()
+        check(state["one"] == (0, "\x00\x20" + "x" * 32),
+              "data after overflow")
+
+        # the limit does not size the buffer, which goes back to the
+        # pool once drained
+        pool = loop.pool_stats()
+        client.write_data("\x00\x00\x00\x03abc",
+                          lambda code, param: None, None)
+        server.read_frame(EFrameU32Be, 16 << 20, on_one, None)
+        loop.start()
+        check(state["one"] == (0, "abc"), "frame under a large limit")
+        after = loop.pool_stats()
+        check(after["discarded"] == pool["discarded"], "read-ahead size")
+        check(after["recycled"] > pool["recycled"], "read-ahead released")
+    finally:
+        pair.close()
+
+def test_adaptive_read():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"got": 0, "sizes": []}
+    payload = "a" * 300000
+    try:
+        try:
+            server.set_adaptive_read(512, 256)
+            check(False, "bad bounds")
+        except ValueError:
+            pass
+        server.set_adaptive_read(256, 32768)
+        def on_chunk(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"] += len(data)
+            state["sizes"].append(len(data))
+            if state["got"] == len(payload):
+                server.stop_reading()
+                loop.stop()
+        server.start_reading(65536, on_chunk, None)
+        client.write_data(payload, lambda code, param: None, None)
+        loop.start()
+        sizes = state["sizes"]
+        check(sizes[0] <= 256, "starts small")
+        check(max(sizes) > 256, "grows")
+        check(max(sizes) <= 32768, "stays within bounds")
+
+        # never more than asked for
+        def on_some(code, data, param):
+            state["some"] = data
+            loop.stop()
+        client.write_data("b" * 1000, lambda code, param: None, None)
+        server.read_some(100, on_some, None)
+        loop.start()
+        check(len(state["some"]) <= 100, "size asked for")
+    finally:
+        pair.close()
+
+def test_read_into():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {}
+    buf = bytearray(16)
+    try:
+        def on_read(code, count, param):
+            state["read"] = (code, count)
+            loop.stop()
+        server.read_into(buf, 4, 8, on_read, None)
+        client.write_data("abcdefghij", lambda code, param: None, None)
+        loop.start()
+        check(state["read"] == (0, 8), "read into")
+        check(str(buf[4:12]) == "abcdefgh", "data in place")
+        check(buf[:4] == bytearray(4), "before offset untouched")
+
+        # the rest, synchronously, at the start
+        check(server.sync_read_into(buf, 0, 2) == 2, "sync read into")
+        check(str(buf[:2]) == "ij", "sync data in place")
+
+        # read-ahead data comes first
+        def on_line(code, data, param):
+            state["line"] = data
+            loop.stop()
+        client.write_data("line\nmore", lambda code, param: None, None)
+        server.read_until("\n", 16, on_line, None)
+        loop.start()
+        check(state["line"] == "line\n", "line")
+        server.read_into(buf, 0, -1, on_read, None)
+        loop.start()
+        check(state["read"] == (0, 4) and str(buf[:4]) == "more",
+              "read-ahead into")
+
+        for args in ((buf, 17, 1), (buf, 8, 9), ("immutable", 0, 1)):
+            try:
+                server.read_into(args[0], args[1], args[2], on_read, None)
+                check(False, "bad read_into %r" % (args[1:],))
+            except (ValueError, TypeError, BufferError):
+                pass
+    finally:
+        pair.close()
+
+def test_read_coalescing():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"chunks": []}
+    try:
+        server.set_read_coalescing(1000, 200000)
+        def on_chunk(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["chunks"].append(data)
+            if sum(map(len, state["chunks"])) >= param:
+                loop.stop()
+        # many small writes, each of which might otherwise be a
+        # callback of its own
+        for i in range(10):
+            client.sync_write("x" * 100)
+        server.start_reading(4096, on_chunk, 1000)
+        loop.start()
+        check(state["chunks"] == ["x" * 1000], "coalesced")
+        server.stop_reading()
+
+        # below the watermark, the budget runs out
+        state["chunks"] = []
+        server.start_reading(4096, on_chunk, 10)
+        client.sync_write("y" * 10)
+        started = time.time()
+        loop.start()
+        check(state["chunks"] == ["y" * 10], "delivered upon budget")
+        check(time.time() - started >= 0.15, "held back for the budget")
+        server.stop_reading()
+
+        try:
+            server.set_read_coalescing(1000, 0)
+            check(False, "no budget")
+        except ValueError:
+            pass
+    finally:
+        pair.close()
+
+def test_relay():
+    # a -> b is one connection, c -> d another; b relays to c
+    pairs = []
+    state = {"got": ""}
+    payload = "r" * 100000
+    try:
+        pairs.append(SocketPair())
+        pairs.append(SocketPair())
+        a, b = pairs[0].client, pairs[0].server
+        c, d = pairs[1].client, pairs[1].server
+
+        # some data read ahead on b gets relayed, too
+        def on_line(code, data, param):
+            check(data == "hello\n", "line")
+            loop.stop()
+        a.write_data("hello\nahead", lambda code, param: None, None)
+        b.read_until("\n", 64, on_line, None)
+        loop.start()
+
+        def maybe_done():
+            if "relayed" in state and len(state["got"]) == 5 + len(payload):
+                loop.stop()
+        def on_relayed(code, count, param):
+            state["relayed"] = (code, count)
+            maybe_done()
+        def on_data(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"] += data
+            d.read_some(65536, on_data, None)
+            maybe_done()
+        def on_written(code, param):
+            check(code == 0, "write error %d" % code)
+            a.send_eof()
+        b.relay_to(c, on_relayed, None)
+        try:
+            b.read_some(16, on_data, None)
+            check(False, "read while relaying")
+        except EnvironmentError:
+            pass
+        try:
+            b.sync_read(16)
+            check(False, "sync read while relaying")
+        except EnvironmentError:
+            pass
+        try:
+            c.sync_write("x")
+            check(False, "sync write to a relay target")
+        except EnvironmentError:
+            pass
+        d.read_some(65536, on_data, None)
+        a.write_data(payload, on_written, None)
+        loop.start()
+        check(state["relayed"] == (0, 5 + len(payload)), "relay result")
+        check(state["got"] == "ahead" + payload, "relayed data")
+
+        # closing the target while the relay runs completes it,
+        # with what got through until then
+        pairs.append(SocketPair())
+        e, f = pairs[2].client, pairs[2].server
+        state["got"] = ""
+        del state["relayed"]
+        def on_cut(code, count, param):
+            state["relayed"] = (code, count)
+            loop.stop()
+        def on_more(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"] += data
+            c.close()
+        f.relay_to(c, on_cut, None)
+        d.cancel_read()
+        d.read_some(65536, on_more, None)
+        e.write_data(payload, lambda code, param: None, None)
+        loop.start()
+        code, count = state["relayed"]
+        check(code == KErrCancel, "relay cut off")
+        check(len(state["got"]) <= count <= len(payload), "relayed so far")
+    finally:
+        for pair in pairs:
+            pair.close()
+
+def test_read_to_file():
+    state = {"progress": []}
+    payload = "".join([chr(i % 251) for i in range(200000)])
+    fd, path = tempfile.mkstemp()
+    os.write(fd, "0123456789")
+    os.close(fd)
+    pair = None
+    try:
+        pair = SocketPair()
+        a, b = pair.client, pair.server
+
+        # what b has read ahead goes into the file first
+        def on_line(code, data, param):
+            check(data == "hello\n", "line")
+            loop.stop()
+        a.write_data("hello\nahead", lambda code, param: None, None)
+        b.read_until("\n", 64, on_line, None)
+        loop.start()
+
+        def on_saved(code, count, param):
+            if code == KRequestPending:
+                state["progress"].append(count)
+                return
+            state["saved"] = (code, count)
+            loop.stop()
+        b.read_to_file(unicode(path), 10, 5 + len(payload),
+                       on_saved, None, 65536)
+        try:
+            b.read_some(16, lambda code, data, param: None, None)
+            check(False, "read while saving")
+        except EnvironmentError:
+            pass
+        try:
+            b.sync_read(16)
+            check(False, "sync read while saving")
+        except EnvironmentError:
+            pass
+        a.write_data(payload, lambda code, param: None, None)
+        loop.start()
+        check(state["saved"] == (0, 5 + len(payload)), "save result")
+        progress = state["progress"]
+        check(len(progress) >= 2, "progress reports")
+        for i in range(len(progress)):
+            check(progress[i] >= (i + 1) * 65536, "progress interval")
+        f = open(path, "rb")
+        check(f.read() == "0123456789ahead" + payload, "file contents")
+        f.close()
+
+        # without a length, the end of the stream completes the save
+        state["progress"] = []
+        b.read_to_file(unicode(path), 0, -1, on_saved, None)
+        a.write_data("tail", lambda code, param: a.send_eof(), None)
+        loop.start()
+        check(state["saved"] == (0, 4), "save to eof")
+        check(state["progress"] == [], "no progress reports")
+        f = open(path, "rb")
+        check(f.read(8) == "tail4567", "overwritten in place")
+        f.close()
+    finally:
+        if pair:
+            pair.close()
+        os.remove(path)
+
+def test_write_queue():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"order": [], "got": []}
+    pieces = ["%d:" % i + "q" * (i * 37 % 5000) for i in range(200)]
+    pieces[10] = "b" * 1000000
+    total = sum([len(p) for p in pieces]) + len("last")
+    try:
+        def maybe_done():
+            if (len(state["order"]) == len(pieces) + 1 and
+                sum([len(d) for d in state["got"]]) == total):
+                loop.stop()
+        def on_written(code, param):
+            check(code == 0, "write error %d" % code)
+            state["order"].append(param)
+            if param == 0:
+                # a write made from a callback goes to the back
+                client.write_data("last", on_written, "last")
+            maybe_done()
+        def on_data(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"].append(data)
+            server.read_some(65536, on_data, None)
+            maybe_done()
+        # no waiting for the callback of one write before the next
+        for i in range(len(pieces)):
+            client.write_data(pieces[i], on_written, i)
+        try:
+            client.sync_write("x")
+            check(False, "sync write while queued")
+        except EnvironmentError:
+            pass
+        server.read_some(65536, on_data, None)
+        loop.start()
+        check(state["order"] == range(len(pieces)) + ["last"],
+              "callback order")
+        check("".join(state["got"]) == "".join(pieces) + "last",
+              "written data")
+
+        # cancelling drops whatever is queued, without callbacks
+        state["order"] = []
+        client.write_data("b" * 4000000, on_written, "big")
+        client.write_data("after", on_written, "after")
+        client.cancel_write()
+        timer = AoTimer()
+        timer.open()
+        timer.after(50, lambda code, param: loop.stop(), None)
+        loop.start()
+        timer.close()
+        check(state["order"] == [], "no callbacks after cancel")
+    finally:
+        pair.close()
+
+def test_zero_copy_write():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"written": [], "got": []}
+    big = bytearray("z" * 2000000)
+    expected = str(big) + "str" + "view" + "text"
+    try:
+        def maybe_done():
+            if (len(state["written"]) == 4 and
+                sum([len(d) for d in state["got"]]) == len(expected)):
+                loop.stop()
+        def on_written(code, param):
+            check(code == 0, "write error %d" % code)
+            state["written"].append(param)
+            if param == "big":
+                # no longer pinned
+                big.append("!")
+            maybe_done()
+        def on_data(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"].append(data)
+            server.read_some(65536, on_data, None)
+            maybe_done()
+        client.set_zero_copy_write(1)
+        client.write_data(big, on_written, "big")
+        client.write_data("str", on_written, "str")
+        client.write_data(memoryview("view"), on_written, "view")
+        client.write_data(u"text", on_written, "text")
+        # the memory being sent from cannot be resized
+        try:
+            big.append("!")
+            check(False, "resized while pinned")
+        except BufferError:
+            pass
+        server.read_some(65536, on_data, None)
+        loop.start()
+        check(state["written"] == ["big", "str", "view", "text"],
+              "callback order")
+        check("".join(state["got"]) == expected, "written data")
+        check(len(big) == 2000001, "released")
+
+        # cancelling releases the memory, too
+        client.write_data(big, on_written, "again")
+        client.cancel_write()
+        big.append("!")
+    finally:
+        pair.close()
+
+def test_write_file():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"got": []}
+    content = "".join([chr(i % 253) for i in range(3000000)])
+    fd, path = tempfile.mkstemp()
+    os.write(fd, content)
+    try:
+        def on_data(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"].append(data)
+            server.read_some(65536, on_data, None)
+            maybe_done()
+        def maybe_done():
+            if ("sent" in state and
+                sum([len(d) for d in state["got"]]) == state["sent"][1]):
+                loop.stop()
+        def on_sent(code, count, param):
+            state["sent"] = (code, count)
+            maybe_done()
+        def send(file, offset, count):
+            state["got"] = []
+            del state["sent"]
+            client.write_file(file, offset, count, on_sent, None)
+            loop.start()
+            return state["sent"], "".join(state["got"])
+        server.read_some(65536, on_data, None)
+
+        # up to the end of the file, by path
+        state["sent"] = None
+        client.write_file(unicode(path), 100, -1, on_sent, None)
+        try:
+            client.write_data("x", lambda code, param: None, None)
+            check(False, "write while sending a file")
+        except EnvironmentError:
+            pass
+        loop.start()
+        check(state["sent"] == (0, len(content) - 100), "file result")
+        check("".join(state["got"]) == content[100:], "file data")
+
+        # a part, by descriptor
+        result, data = send(fd, 5, 1000)
+        check(result == (0, 1000), "fd result")
+        check(data == content[5:1005], "fd data")
+
+        # the file ending first
+        result, data = send(fd, len(content) - 10, 50)
+        check(result[0] != 0 and result[1] == 10, "short file")
+        check(data == content[-10:], "short file data")
+
+        # cancelling makes no callback
+        state["sent"] = None
+        client.write_file(fd, 0, -1, on_sent, None)
+        client.cancel_write()
+        check(state["sent"] is None, "no callback after cancel")
+    finally:
+        pair.close()
+        os.close(fd)
+        os.remove(path)
+
+def test_write_batch():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"written": [], "got": []}
+    body = bytearray("b" * 500000)
+    batch = ["HEAD\r\n", body, buffer("xxTRAILER", 2), memoryview("!")]
+    expected = "HEAD\r\n" + str(body) + "TRAILER!" + "one" + "two"
+    try:
+        def maybe_done():
+            if (len(state["written"]) == 3 and
+                sum([len(d) for d in state["got"]]) == len(expected)):
+                loop.stop()
+        def on_written(code, param):
+            check(code == 0, "write error %d" % code)
+            state["written"].append(param)
+            maybe_done()
+        def on_data(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"].append(data)
+            server.read_some(65536, on_data, None)
+            maybe_done()
+        # one callback for the lot, in order with other writes
+        client.write_batch(batch, on_written, "batch")
+        client.write_batch([], on_written, "empty")
+        client.write_batch(("one", "two"), on_written, "pair")
+        try:
+            body.append("!")
+            check(False, "resized while pinned")
+        except BufferError:
+            pass
+        try:
+            client.write_batch(["ok", u"text"], on_written, "bad")
+            check(False, "unicode in batch")
+        except TypeError:
+            pass
+        server.read_some(65536, on_data, None)
+        loop.start()
+        check(state["written"] == ["batch", "empty", "pair"],
+              "callback order")
+        check("".join(state["got"]) == expected, "written data")
+        body.append("!")
+    finally:
+        pair.close()
+
+def test_write_watermarks():
+    pair = SocketPair()
+    client, server = pair.client, pair.server
+    state = {"events": [], "got": 0}
+    chunk = "w" * 100000
+    try:
+        def on_written(code, param):
+            check(code == 0, "write error %d" % code)
+            state["events"].append(param)
+        def on_drain(code, param):
+            check(code == 0, "drain error %d" % code)
+            state["events"].append(param)
+            loop.stop()
+        def on_data(code, data, param):
+            check(code == 0, "read error %d" % code)
+            state["got"] += len(data)
+            server.read_some(65536, on_data, None)
+        client.set_write_watermarks(250000, 100000, on_drain, "drain")
+        # the producer is told to pause once the high mark is reached
+        pauses = []
+        for i in range(5):
+            pauses.append(client.write_data(chunk, on_written, i))
+        check(pauses == [0, 0, 1, 1, 1], "backpressure %r" % pauses)
+        server.read_some(65536, on_data, None)
+        loop.start()
+        # the low mark is reached once all but the last write are out
+        check(state["events"][:5] == [0, 1, 2, 3, "drain"],
+              "drain order %r" % state["events"])
+        check(client.write_data(chunk, on_written, 5) == 0, "resumed")
+
+        try:
+            client.set_write_watermarks(10, 10)
+            check(False, "low mark not below high")
+        except ValueError:
+            pass
+        client.set_write_watermarks(0, 0)
+    finally:
+        pair.close()
+
+def test_pool_size():
+    serv = AoSocketServ()
+    serv.connect()
+    try:
+        serv.set_pool_size(0)
+        check(loop.pool_stats()["idle_count"] == 0, "pool trimmed")
+        serv.set_pool_size(8)
+        try:
+            serv.set_pool_size(-1)
+            check(False, "negative pool size")
+        except ValueError:
+            pass
+    finally:
+        serv.close()
+
+def test_cancel():
+    serv = AoSocketServ()
+    serv.connect()
+    listener = AoSocket()
+    client = AoSocket()
+    server = AoSocket()
+    state = {}
+    port = new_port()
+    try:
+        for s in (listener, client, server):
+            s.set_socket_serv(serv)
+        listener.open_tcp()
+        listener.listen_tcp(u"127.0.0.1", port, 5)
+        server.blank()
+
+        def no_cb(*args):
+            raise AssertionError("cancelled request completed")
+        listener.accept_client(server, no_cb, None)
+        listener.cancel_accept()
+
+        server.close()
+        server.set_socket_serv(serv)
+        server.blank()
+        def on_accept(code, sock, param):
+            check(code == 0, "accept error %d" % code)
+            state["accepted"] = True
+            if "connected" in state:
+                loop.stop()
+        def on_connect(code, param):
+            check(code == 0, "connect error %d" % code)
+            state["connected"] = True
+            if "accepted" in state:
+                loop.stop()
+        listener.accept_client(server, on_accept, None)
+        client.open_tcp()
+        client.connect_tcp(u"127.0.0.1", port, on_connect, None)
+        loop.start()
+
+        # a pending read must be cancellable, with the buffer
+        # released, and the socket still usable afterwards
+        server.read_some(64, no_cb, None)
+        server.cancel_read()
+        def on_read(code, data, param):
+            check(code == 0 and data == "after", "read after cancel")
+            loop.stop()
+        server.read_some(64, on_read, None)
+        check(client.sync_write("after") == None, "sync_write")
+        loop.start()
+    finally:
+        client.close()
+        server.close()
+        listener.close()
+        serv.close()
+
+def test_deadline():
+    # a connect deadline that does not pass
+    pair = SocketPair(1000)
+    client, server = pair.client, pair.server
+    state = {}
+    try:
+        # nothing gets sent, so the read must time out
+        def on_timeout(code, data, param):
+            state["timeout"] = (code, data, time.time() - param)
+            loop.stop()
+        server.read_some(64, on_timeout, time.time(), 50)
+        loop.start()
+        code, data, elapsed = state["timeout"]
+        check(code == KErrTimedOut and data is None, "read deadline")
+        check(elapsed >= 0.05, "read deadline too early")
+
+        # the socket is still usable, and a deadline that does not
+        # pass makes no difference
+        def on_read(code, data, param):
+            check(code == 0 and data == "in time", "read in time")
+            loop.stop()
+        server.read_exact(7, on_read, None, 1000)
+        def on_write(code, param):
+            check(code == 0, "write error %d" % code)
+        client.write_data("in time", on_write, None, 1000)
+        loop.start()
+
+        # data arriving just as the deadline passes, in the same tick
+        # of the wheel, with the timer sending it coming first; with
+        # the ring engine the receive then completes while being
+        # cancelled, and whichever way that goes, nothing is lost.
+        # The data comes from a plain socket, as sending on ours
+        # would have the completion collected right away.
+        race()
+
+        # a write deadline passing in a loop nested in a write
+        # callback, which then closes the socket
+        def on_nested(code, param):
+            if param == "first":
+                check(code == 0, "write error %d" % code)
+                while "late" not in state:
+                    loop.run_once(1000)
+                client.close()
+                loop.stop()
+            else:
+                state["late"] = code
+        client.write_data("a", on_nested, "first", 100)
+        client.write_data("b" * 32000000, on_nested, "big", 100)
+        loop.start()
+        check(state["late"] == KErrTimedOut, "nested write deadline")
+    finally:
+        pair.close()
+
+def race():
+    serv = AoSocketServ()
+    serv.connect()
+    listener = AoSocket()
+    server = AoSocket()
+    timer = AoTimer()
+    raw = None
+    state = {}
+    port = new_port()
+    try:
+        for s in (listener, server):
+            s.set_socket_serv(serv)
+        listener.open_tcp()
+        listener.listen_tcp(u"127.0.0.1", port, 5)
+        server.blank()
+        def on_accept(code, sock, param):
+            check(code == 0, "accept error %d" % code)
+            loop.stop()
+        listener.accept_client(server, on_accept, None)
+        raw = socket.create_connection(("127.0.0.1", port))
+        loop.start()
+
+        def on_race(code, data, param):
+            state["race"] = (code, data)
+            loop.stop()
+        timer.open()
+        timer.after(50, lambda code, param: raw.sendall("race"), None)
+        server.read_some(64, on_race, None, 50)
+        loop.start()
+        if state["race"][0] == KErrTimedOut:
+            # the data must still be there, and is not if it got
+            # received and then dropped
+            server.read_some(64, on_race, None, 1000)
+            loop.start()
+        check(state["race"] == (0, "race"), "data at the deadline")
+    finally:
+        if raw:
+            raw.close()
+        timer.close()
+        server.close()
+        listener.close()
+        serv.close()
+
+def test_thread_exit():
+    # threads that use the per-thread objects, and then exit, which
+    # must free those objects, and not leave them to a scheduler
+    # that is gone
+    done = thread.allocate_lock()
+    def worker():
+        try:
+            wloop = AoLoop()
+            wloop.open()
+            wloop.set_batching(4)
+            wloop.set_stats(True)
+            timer = AoTimer()
+            timer.open()
+            timer.after(1, lambda code, param: wloop.stop(), None)
+            wloop.start()
+            check(wloop.pool_stats()["idle_count"] == 0, "worker pool")
+            timer.close()
+            wloop.close()
+        finally:
+            done.release()
+    for i in range(20):
+        done.acquire()
+        thread.start_new_thread(worker, ())
+    done.acquire()
+    done.release()
+    # let the last one get all the way out
+    time.sleep(0.05)
+
+def test_handover():
+    # the listening thread hands each accepted socket over to the
+    # loop of a worker thread
+    serv = AoSocketServ()
+    serv.connect()
+    serv.share()
+    listener = AoSocket()
+    client = AoSocket()
+    server = AoSocket()
+    handed = []
+    ready = thread.allocate_lock()
+    ready.acquire()
+    finished = thread.allocate_lock()
+    finished.acquire()
+    state = {}
+
+    def worker():
+        wloop = AoLoop()
+        wloop.open()
+        itc = AoItc()
+        itc.open()
+        def on_written(code, param):
+            state["worker_write"] = code
+            wloop.stop()
+        def on_read(code, data, param):
+            sock = handed[0]
+            sock.write_data(data.upper(), on_written, None)
+        def on_handed(code, param):
+            sock = handed[0]
+            sock.attach()
+            sock.read_exact(5, on_read, None)
+        itc.request(on_handed, None)
+        state["itc"] = itc
+        ready.release()
+        wloop.start()
+        # hand it back, as the object gets deallocated by the
+        # listening thread
+        handed[0].close()
+        handed[0].detach()
+        itc.close()
+        wloop.close()
+        finished.release()
+
+    port = new_port()
+    try:
+        for s in (listener, client, server):
+            s.set_socket_serv(serv)
+        listener.open_tcp()
+        listener.listen_tcp(u"127.0.0.1", port, 5)
+        server.blank()
+        thread.start_new_thread(worker, ())
+        ready.acquire()
+
+        def on_reply(code, data, param):
+            state["reply"] = data
+            loop.stop()
+        def on_accept(code, sock, param):
+            check(code == 0, "accept error %d" % code)
+            # only idle sockets may be handed over
+            sock.read_some(5, on_reply, None)
+            try:
+                sock.detach()
+                check(False, "detached with a read pending")
+            except AssertionError:
+                raise
+            except Exception:
+                pass
+            sock.cancel_read()
+            sock.detach()
+            handed.append(sock)
+            state["itc"].complete()
+        def on_connect(code, param):
+            check(code == 0, "connect error %d" % code)
+            client.write_data("hello", lambda code, param: None, None)
+            client.read_exact(5, on_reply, None)
+        listener.accept_client(server, on_accept, None)
+        client.open_tcp()
+        client.connect_tcp(u"127.0.0.1", port, on_connect, None)
+        loop.start()
+        finished.acquire()
+        check(state.get("reply") == "HELLO", "reply from worker")
+        check(state.get("worker_write") == 0, "worker write")
+    finally:
+        client.close()
+        listener.close()
+        serv.close()
+
+test_immediate()
+test_itc()
+test_timer()
+test_run_once()
+test_stats()
+test_batching()
+test_priority()
+test_echo()
+test_cancel()
+test_zero_copy()
+test_streaming()
+test_read_until()
+test_read_frame()
+test_adaptive_read()
+test_read_into()
+test_read_coalescing()
+test_relay()
+test_read_to_file()
+test_write_queue()
+test_zero_copy_write()
+test_write_file()
+test_write_batch()
+test_write_watermarks()
+test_pool_size()
+test_selector()
+test_deadline()
+test_thread_exit()
+test_handover()
+loop.close()
+print "all done"